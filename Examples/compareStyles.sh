@@ -0,0 +1,77 @@
+#!/bin/sh
+# Compares the size and speed of the code generated in the switch and table styles
+# for each chart in this directory and the directories below it.
+# Usage: ./compareStyles.sh [path/to/cogent.jar] [charts...]
+# For each chart it prints the text size of the generated code compiled on its own, and
+# the median and 99th percentile time per dispatch from the program that --bench writes.
+# A chart with a preamble of its own (chartName_preamble.h next to it) is compiled with
+# it. Otherwise a stub preamble is written, with an event class for each trigger in the
+# chart. Charts that cogent reports errors for, such as the error examples, are skipped.
+JAR=${1:-cogent.jar}
+[ $# -gt 0 ] && shift
+CHARTS=${*:-$(ls *.puml */*.puml)}
+CC=${CC:-cc}
+CFLAGS=${CFLAGS:--Os}
+BENCH_CFLAGS=${BENCH_CFLAGS:--O2}
+DISPATCHES=${DISPATCHES:-200000}
+OUT=$(mktemp -d)
+kept=no
+printf "%-32s %-6s %10s %10s %10s\n" chart style text p50ns p99ns
+for source in $CHARTS
+do
+    name=$(basename "$source" .puml)
+    dir=$(dirname "$source")
+    for style in switch table
+    do
+        work="$OUT/$name/$style"
+        mkdir -p "$work"
+        if ! java -cp "$JAR" cogent.Main --fatal --bench --style=$style "$name" "$source" "$work/$name.c" > "$work/log.txt" 2>&1
+        then
+            printf "%-32s %-6s %s\n" "$name" $style "skipped: cogent reported errors, see $work/log.txt"
+            kept=yes
+            continue
+        fi
+        if [ -f "$dir/${name}_preamble.h" ]
+        then
+            includes="-I$dir"
+        else
+            # The event classes are the triggers that are not 'after' ones.
+            classes=$(grep -e '->' "$source" | sed -n 's/^[^:]*: *\([A-Za-z_][A-Za-z0-9_]*\).*/\1/p' \
+                      | grep -v '^after$' | sort -u | tr '\n' ',')
+            {
+                echo "#include <assert.h>"
+                echo "#include <stdbool.h>"
+                echo "typedef enum eventClass_e { ${classes} TICK } eventClass_t ;"
+                echo "typedef struct event_s { eventClass_t tag ; } event_t ;"
+                echo "#define eventClassOf( event_p ) ((event_p)->tag)"
+                echo "typedef int status_t ;"
+                echo "typedef bool bool_t ;"
+                echo "#define OK_STATUS 0"
+                echo "#define assertThat(x) (assert(x))"
+                echo "#define assertUnreachable() (assert(0))"
+                # Declarations of the named guards and actions, for compiling the code on its own.
+                echo "#ifndef BENCH_GUARD_COUNT"
+                sed -n 's/^#define BENCH_GUARD_\([A-Za-z0-9_]*\)(.*/bool_t \1( event_t *e, status_t s ) ;/p' "$work/${name}_bench.c"
+                sed -n 's/^#define BENCH_ACTION_\([A-Za-z0-9_]*\)(.*/status_t \1( event_t *e, status_t s ) ;/p' "$work/${name}_bench.c"
+                echo "#endif"
+            } > "$work/${name}_preamble.h"
+            includes=""
+        fi
+        if ! $CC $CFLAGS -I"$work" $includes -c "$work/$name.c" -o "$work/$name.o" > "$work/cc.txt" 2>&1 ||
+           ! $CC $BENCH_CFLAGS -I"$work" $includes "$work/${name}_bench.c" -o "$work/bench" >> "$work/cc.txt" 2>&1
+        then
+            printf "%-32s %-6s %s\n" "$name" $style "skipped: the C compiler failed, see $work/cc.txt"
+            kept=yes
+            continue
+        fi
+        text=$(size "$work/$name.o" | awk 'NR == 2 { print $1 }')
+        times=$("$work/bench" $DISPATCHES 1 | awk '/^ns\/dispatch:/ { print $3, $7 }')
+        printf "%-32s %-6s %10s %10s %10s\n" "$name" $style "$text" $times
+    done
+done
+if [ $kept = yes ]
+then
+    echo "The logs of the skipped charts are in $OUT"
+else
+    rm -rf "$OUT"
+fi
@@ -0,0 +1,78 @@
+/* Measures the throughput of a fleet of machines for fleetBench.sh.
+ * Each machine does some synthetic work per message and passes the message on
+ * to a pseudo-randomly chosen machine, until the message has made HOPS hops.
+ * Usage: fleetBench [workerCount] */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "worker_preamble.h"
+#include "worker_fleet.h"
+
+#define INSTANCES 4096
+#define MESSAGES ( INSTANCES / 2 )
+#define HOPS 1000
+#define WORK 200
+
+/* Per-machine data, padded so that machines run by different workers do not share cache lines. */
+typedef struct {
+    unsigned long x ;
+    long handled ;
+    long dropped ;
+    char pad[ 40 ] ;
+} bench_data_t ;
+
+static worker_instance_t instances[ INSTANCES ] ;
+static bench_data_t data[ INSTANCES ] ;
+static worker_fleet_t *fleet ;
+static atomic_long liveMessages ;
+
+static double seconds( void ) {
+    struct timespec t ;
+    clock_gettime( CLOCK_MONOTONIC, &t ) ;
+    return t.tv_sec + 1e-9 * t.tv_nsec ;
+}
+
+static TIME_T clockMs( void ) { return (TIME_T)( 1000 * seconds() ) ; }
+
+status_t forward( struct worker_ctx_s *ctx, event_t *event_p, status_t status ) {
+    bench_data_t *d = &data[ (worker_instance_t *) ctx - instances ] ;
+    for( int k = 0 ; k < WORK ; ++k ) d->x = d->x * 6364136223846793005ul + 1442695040888963407ul ;
+    d->handled += 1 ;
+    if( event_p->hops > 1 ) {
+        event_t message = { MSG, event_p->hops - 1 } ;
+        if( fleetPost_worker( fleet, &instances[ ( d->x >> 33 ) % INSTANCES ], &message ) ) return status ;
+        d->dropped += 1 ;
+    }
+    atomic_fetch_sub( &liveMessages, 1 ) ;
+    return status ;
+}
+
+int main( int argc, char **argv ) {
+    int workerCount = argc > 1 ? atoi( argv[ 1 ] ) : 1 ;
+    long handled = 0, dropped = 0 ;
+    for( int i = 0 ; i < INSTANCES ; ++i ) {
+        initInstance_worker( &instances[ i ], 0 ) ;
+        data[ i ].x = i ;
+    }
+    fleet = startFleet_worker( INSTANCES, workerCount, clockMs ) ;
+    if( fleet == 0 ) { fprintf( stderr, "Could not start the fleet\n" ) ; return 1 ; }
+    double start = seconds() ;
+    atomic_store( &liveMessages, MESSAGES ) ;
+    for( int i = 0 ; i < MESSAGES ; ++i ) {
+        event_t message = { MSG, HOPS } ;
+        fleetPost_worker( fleet, &instances[ 2 * i ], &message ) ;
+    }
+    while( atomic_load( &liveMessages ) > 0 ) {
+        struct timespec pause = { 0, 100000 } ;
+        nanosleep( &pause, 0 ) ;
+    }
+    double elapsed = seconds() - start ;
+    stopFleet_worker( fleet ) ;
+    for( int i = 0 ; i < INSTANCES ; ++i ) {
+        handled += data[ i ].handled ;
+        dropped += data[ i ].dropped ;
+    }
+    printf( "%2d workers: %ld events in %.3f s, %.0f events/s (%ld dropped on full mailboxes)\n",
+            workerCount, handled, elapsed, handled / elapsed, dropped ) ;
+    return 0 ;
+}
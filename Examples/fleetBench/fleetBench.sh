@@ -0,0 +1,17 @@
+#!/bin/sh
+# Measures the throughput of a fleet of machines against the number of worker threads.
+# Usage: ./fleetBench.sh [path/to/cogent.jar] [thread counts...]
+JAR=${1:-cogent.jar}
+[ $# -gt 0 ] && shift
+THREADS=${*:-1 2 4 8}
+CC=${CC:-cc}
+CFLAGS=${CFLAGS:--O2}
+OUT=$(mktemp -d)
+java -cp "$JAR" cogent.Main --fatal --fleet worker worker.puml "$OUT/worker.c" || exit 1
+$CC $CFLAGS -std=c11 -pthread -I. -I"$OUT" fleetBench.c "$OUT/worker.c" "$OUT/worker_queue.c" "$OUT/worker_fleet.c" \
+    -o "$OUT/fleetBench" || exit 1
+for threads in $THREADS
+do
+    "$OUT/fleetBench" $threads
+done
+rm -rf "$OUT"
@@ -0,0 +1,27 @@
+#ifndef WORKER_PREAMBLE_H
+#define WORKER_PREAMBLE_H
+
+    #include <assert.h>
+    #include <stdbool.h>
+
+    typedef enum eventClass_e { MSG, TICK } eventClass_t ;
+    /* A message that is passed on until it has made 'hops' hops. */
+    typedef struct event_s {
+        eventClass_t tag ;
+        int hops ;
+    } event_t ;
+
+    #define eventClassOf( event_p ) ((event_p)->tag)
+
+    typedef int status_t ;
+    typedef bool bool_t ;
+
+    #define OK_STATUS 0
+
+    #define assertThat(x) (assert(x))
+    #define assertUnreachable() (assert(0))
+
+    struct worker_ctx_s ;
+    status_t forward( struct worker_ctx_s *ctx, event_t *event_p, status_t status ) ;
+
+#endif
@@ -0,0 +1,103 @@
+package cogent
+
+import java.io.{File, IOException}
+import scala.jdk.CollectionConverters._
+
+import Logger.Level._
+
+// What an annotation file says about the named guards and actions of a chart, beyond what
+// the chart says. Each line names a guard or an action and gives some of its properties, or
+// gives the cost of entering or exiting a state, e.g.
+//
+//     guard sensorReady pure cost=20
+//     guard tableHit cost=5
+//     action startMotor cost=40
+//     enter cost=2
+//
+// A pure guard has no side effects and gives the same answer each time it is evaluated during
+// one dispatch, so its answer can be remembered. A cost is a whole number, in any unit, that
+// says how expensive a guard or action is compared to the others; guards and actions that are
+// not given one cost 1, and entering and exiting states costs nothing unless it is given.
+// Blank lines and lines that start with # are ignored.
+class Annotations( val pureGuards : Set[String], val guardCosts : Map[String, Int],
+                   val actionCosts : Map[String, Int] = Map(), val enterCost : Int = 0, val exitCost : Int = 0 ) :
+
+    def isEmpty : Boolean = pureGuards.isEmpty && guardCosts.isEmpty && actionCosts.isEmpty && enterCost == 0 && exitCost == 0
+
+    def isPure( name : String ) : Boolean = pureGuards.contains( name )
+
+    def guardCost( name : String ) : Int = guardCosts.getOrElse( name, 1 )
+
+    def actionCost( name : String ) : Int = actionCosts.getOrElse( name, 1 )
+
+    // The cost of evaluating a whole guard, every operand included. 'in' and OK guards only
+    // read memory, so they cost nothing.
+    def costOf( guard : Guard ) : Int =
+        guard match
+            case Guard.OKGuard() | Guard.InGuard( _ ) => 0
+            case Guard.NamedGuard( name ) => guardCost( name )
+            case Guard.NotGuard( operand ) => costOf( operand )
+            case Guard.AndGuard( left, right ) => costOf( left ) + costOf( right )
+            case Guard.OrGuard( left, right ) => costOf( left ) + costOf( right )
+            case Guard.ImpliesGuard( left, right ) => costOf( left ) + costOf( right )
+            case _ => 1
+
+    def costOf( action : Action ) : Int =
+        action match
+            case Action.NamedAction( name ) => actionCost( name )
+            case _ => 1
+
+    // Warns about the guards and actions that are annotated but that no transition of the
+    // chart uses, since they are most likely misspelled.
+    def check( logger : Logger, stateChart : StateChart ) : Unit =
+        val used = stateChart.edges.flatMap( _.guardOpt ).flatMap( _.namedGuards ).toSet
+        for name <- ( pureGuards ++ guardCosts.keySet ).toSeq.sorted if ! used.contains( name ) do
+            logger.warning( s"The annotation file names guard $name, which no transition uses." )
+        val usedActions = stateChart.edges.flatMap( _.actions ).collect{ case Action.NamedAction( name ) => name }.toSet
+        for name <- actionCosts.keySet.toSeq.sorted if ! usedActions.contains( name ) do
+            logger.warning( s"The annotation file names action $name, which no transition uses." )
+    end check
+
+end Annotations
+
+object Annotations :
+
+    val none : Annotations = Annotations( Set(), Map() )
+
+    // Reads an annotation file. Reports a fatal error for each line it does not understand.
+    def read( logger : Logger, file : File ) : Annotations =
+        val lines =
+            try java.nio.file.Files.readAllLines( file.toPath() ).asScala.toSeq
+            catch case e : IOException =>
+                logger.log( Fatal, s"Can not read the annotation file ${file}: ${e.getMessage()}" )
+                return none
+        var pure = Set[String]()
+        var guardCosts = Map[String, Int]()
+        var actionCosts = Map[String, Int]()
+        var enterCost = 0
+        var exitCost = 0
+        for (line, number) <- lines.map( _.trim ).zipWithIndex if line.nonEmpty && ! line.startsWith( "#" ) do
+            def bad( what : String ) : Unit = logger.log( Fatal, s"${file}:${number + 1}: $what in '$line'" )
+            def cost( property : String )( store : Int => Unit ) : Unit =
+                property.drop( 5 ).toIntOption.filter( _ >= 0 ) match
+                    case Some( cost ) => store( cost )
+                    case None => bad( "Bad cost" )
+            line.split( "\\s+" ).toSeq match
+                case Seq( "guard", name, properties* ) =>
+                    for property <- properties do
+                        if property == "pure" then pure += name
+                        else if property.startsWith( "cost=" ) then cost( property ){ c => guardCosts += name -> c }
+                        else bad( s"Unknown property $property" )
+                case Seq( "action", name, property ) if property.startsWith( "cost=" ) =>
+                    cost( property ){ c => actionCosts += name -> c }
+                case Seq( "enter", property ) if property.startsWith( "cost=" ) =>
+                    cost( property ){ c => enterCost = c }
+                case Seq( "exit", property ) if property.startsWith( "cost=" ) =>
+                    cost( property ){ c => exitCost = c }
+                case Seq( "guard" ) => bad( "No guard name" )
+                case _ => bad( "Unknown annotation" )
+        end for
+        Annotations( pure, guardCosts, actionCosts, enterCost, exitCost )
+    end read
+
+end Annotations
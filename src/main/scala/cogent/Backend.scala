@@ -1,36 +1,60 @@
 package cogent
-class Backend( val logger : Logger, val out : COutputter, val generationOptions : GenerationOptions ) :
-
-    private val boolType = "bool_t"
-    private val trueConst = "true"
-    private val falseConst = "false"
-    private val isInArrayName = "isIn_a"
-    private val currentChildArrayName = "currentChild_a"
-    private val handledArrayName = "handled_a"
-    private val timeEnteredArrayName = "timeEntered_a"
-    private val eventPointerName = "event_p"
-    private val statusType = "status_t"
-    private val statusVarName = "status"
-    private val okStatusConstant = "OK_STATUS"
-    private val okMacro = "OK"
-    private val localIndexType = "LOCAL_INDEX_T"
-    private val eventType = "event_t"
-    private val eventClassOf = "eventClassOf"
-    private val timeType = "TIME_T"
-    private val toDuration = "TO_DURATION"
-    private val isAfter = "IS_AFTER"
-    private val now = "now"
-    private val eventMacro = "EVENT"
-    private val guardMacro = "GUARD"
-    private val actionMacro = "ACTION"
-    private val logActionStartMacro = "LOG_ACTION_START"
-    private val logActionDoneMacro = "LOG_ACTION_DONE"
-    private val logGuardStartMacro = "LOG_GUARD_START"
-    private val logGuardTrueMacro = "LOG_GUARD_TRUE"
-    private val logEnterStateMacro = "LOG_ENTER_STATE"
-    private val logExitStateMacro = "LOG_EXIT_STATE"
+class Backend( val logger : Logger, val out : COutputter, val generationOptions : GenerationOptions,
+               val sharingOpt : Option[SharedSubmachines] = None ) :
+
+    protected val boolType = "bool_t"
+    protected val trueConst = "true"
+    protected val falseConst = "false"
+    protected val isInArrayName = "isIn_a"
+    protected val currentChildArrayName = "currentChild_a"
+    protected val handledVarName = "handled"
+    protected val timeEnteredArrayName = "timeEntered_a"
+    protected val changedAtArrayName = "changedAt_a"
+    protected val currentStepName = "currentStep"
+    protected val stepType = "unsigned char"
+    protected val changedOnlyVarName = "changedOnly"
+    protected val timerNextArrayName = "timerNext_a"
+    protected val timerHeadName = "timerHead"
+    protected val dueAtArrayName = "dueAt_a"
+    protected val tickStampName = "tickStamp"
+    protected val guardKnownArrayName = "guardKnown_a"
+    protected val guardValueArrayName = "guardValue_a"
+    protected val eventPointerName = "event_p"
+    protected val statusType = "status_t"
+    protected val statusVarName = "status"
+    protected val okStatusConstant = "OK_STATUS"
+    protected val okMacro = "OK"
+    protected val localIndexType = "LOCAL_INDEX_T"
+    protected val eventType = "event_t"
+    protected val eventClassOf = "eventClassOf"
+    protected val eventClassType = "EVENT_CLASS_T"
+    protected val eventClassVarName = "eventClass"
+    protected val tickEventPointer = "TICK_EVENT_P"
+    protected val afterDeadline = "AFTER_DEADLINE"
+    protected val timeType = "TIME_T"
+    protected val toDuration = "TO_DURATION"
+    protected val isAfter = "IS_AFTER"
+    protected val now = "now"
+    protected val eventMacro = "EVENT"
+    protected val guardMacro = "GUARD"
+    protected val actionMacro = "ACTION"
+    protected val logActionStartMacro = "LOG_ACTION_START"
+    protected val logActionDoneMacro = "LOG_ACTION_DONE"
+    protected val logGuardStartMacro = "LOG_GUARD_START"
+    protected val logGuardTrueMacro = "LOG_GUARD_TRUE"
+    protected val logEnterStateMacro = "LOG_ENTER_STATE"
+    protected val logExitStateMacro = "LOG_EXIT_STATE"
+    protected val contextPointerName = "ctx"
+    protected val traceRecordMacro = "TRACE_RECORD"
+
+    // The name of the chart being generated. Set by the public entry points.
+    protected var chartName = ""
+
+    // One piece of per-machine state. An empty sizeMacro means a scalar.
+    protected case class StateVariable( comment : String, cType : String, name : String, sizeMacro : String, size : Int )
 
     def generateCCode( stateChart : StateChart, chartName : String, cogentVersion : String ) : Unit = {
+        this.chartName = chartName
 
         generateComment( cogentVersion )
 
@@ -38,36 +62,690 @@ class Backend( val logger : Logger, val out : COutputter, val generationOptions
 
         generateMacroDeclarations()
 
+        generateTraceSupport( stateChart )
+
+        generateProfileSupport( stateChart )
+
         generateDefines( stateChart )
 
-        generateEnterAndExitDecls( stateChart )
+        if usesTimerList( stateChart ) || generationOptions.compact then
+            generateTimerDefines( stateChart )
+
+        if generationOptions.compact then
+            generateCompactDefines( stateChart )
+
+        if generationOptions.contextStruct then
+            out.putLine( "// All per-machine state lives in the context struct" )
+            out.putLine( s"#include \"${contextHeaderName}\"" )
+            out.blankLine
+        end if
+
+        if ! generationOptions.inlineTransitions then
+            generateEnterAndExitDecls( stateChart )
         
         out.blankLine
-        out.putLine( "// This array maps the global index of each OR state to the local index of its currently active state" )
-        out.putLine( s"static $localIndexType ${currentChildArrayName}[ OR_STATE_COUNT ] ;" )
-        out.putLine( "// This array maps keeps track of which states are active" ) 
-        out.putLine( s"static ${boolType} $isInArrayName[ STATE_COUNT ] ;" )
-        out.putLine( "// This array maps keeps track the time at which each active state was entered" ) 
-        out.putLine( s"static $timeType $timeEnteredArrayName[ STATE_COUNT ] ;" )
-        out.blankLine
+        if ! generationOptions.contextStruct then
+            for v <- stateVariables( stateChart ) do
+                out.putLine( s"// ${v.comment}" )
+                out.putLine( s"static ${v.cType} ${declarator( v, true )} ;" )
+            end for
+            out.blankLine
+        end if
+
+        generatePureGuardSupport( stateChart )
+
+        if usesTimerList( stateChart ) then
+            generateTimerFunctions( stateChart )
         
-        out.put( s"void initStateMachine_${chartName}( $timeType $now) " )
+        out.put( s"void initStateMachine_${chartName}( ${contextParam}$timeType $now) " )
         out.block {
-            out.putLine( s"${enterFunctionName(stateChart.root)}( -1, $now ) ;" )
+            if usesTimerList( stateChart ) then
+                out.putLine( s"${stateData(timerHeadName)} = -1 ;" )
+            generateEnterCall( stateChart.root, None, stateChart )
         }
 
+        for shared <- sharedSubmachines do
+            generateSharedExits( shared, stateChart )
+            generateSharedDispatch( shared, stateChart )
+        end for
+
         out.blankLine 
-        out.put( s"${boolType} dispatchEvent_${chartName}( ${eventType} *${eventPointerName}, $timeType $now ) " )
+        if settlesChangedOnly then
+            out.comment( s"When $changedOnlyVarName is true, only states that changed in the previous micro-step are visited." )
+            out.endLine
+        out.put( s"static ${boolType} ${dispatchCoreName}( ${contextParam}${eventType} *${eventPointerName}, $eventClassType $eventClassVarName, $timeType $now${changedOnlyParam} ) " )
+        out.block{
+            out.putLine( s"${boolType} ${handledVarName} = ${falseConst} ;" )
+            generatePureGuardReset( stateChart )
+            if usesTimerList( stateChart ) then
+                out.putLine( s"if( $eventClassVarName == TICK ) markDueTimers( ${contextArg}$now ) ;" )
+            val rootClasses = eventClassesOf( stateChart.root, stateChart )
+            if rootClasses.isEmpty then
+                out.comment( "No state can handle any event." )
+                out.endLine
+            else
+                out.ifComm( eventClassTest( rootClasses ) ) {
+                    generateCodeForState( stateChart.root, stateChart, handledVarName ) 
+                }
+                out.endLine
+            end if
+            out.put( s"return ${handledVarName} ;" )
+        }
+
+        out.blankLine 
+        out.put( s"${boolType} dispatchEvent_${chartName}( ${contextParam}${eventType} *${eventPointerName}, $timeType $now ) " )
+        out.block{
+            out.put( s"return ${dispatchCoreName}( ${contextArg}${eventPointerName}, ${eventClassOf}(${eventPointerName}), $now${changedOnlyArg( falseConst )} ) ;" )
+        }
+
+        generateTimeoutFunctions( stateChart )
+
+        generateSettleFunction( stateChart )
+
+        if generationOptions.snapshot then
+            generateSnapshotFunctions( stateChart )
+
+        if ! generationOptions.inlineTransitions then
+            generateEnterAndExitDefs( stateChart )
+    }
+
+    // Drivers that do not want to poll with TICK events can ask when the
+    // next 'after' transition is due, sleep until then, and then dispatch
+    // the timeouts directly.
+    def generateTimeoutFunctions( stateChart : StateChart ) : Unit = {
+        out.blankLine
+        out.comment( "Sets *deadline_p to the earliest time at which an 'after' transition of an active state is due and returns true." )
+        out.endLine
+        out.comment( "Returns false if no 'after' transition is pending. A deadline that is not after 'now' means a TICK is due now." )
+        out.endLine
+        out.put( s"${boolType} nextDeadline_${chartName}( ${contextParam}$timeType $now, $timeType *deadline_p ) " )
+        out.block{
+            out.putLine( s"${boolType} found = ${falseConst} ;" )
+            out.putLine( s"$timeType remaining = 0 ;" )
+            generateDeadlineCode( stateChart )
+            out.putLine( s"if( found ) *deadline_p = ($timeType)( $now + remaining ) ;" )
+            out.put( "return found ;" )
+        }
+
+        out.blankLine
+        out.comment( "Fires the 'after' transitions that are due; equivalent to dispatching a TICK event." )
+        out.endLine
+        out.put( s"${boolType} dispatchTimeouts_${chartName}( ${contextParam}$timeType $now ) " )
+        out.block{
+            out.put( s"return ${dispatchCoreName}( ${contextArg}$tickEventPointer, TICK, $now${changedOnlyArg( falseConst )} ) ;" )
+        }
+    }
+
+    // Dispatches an event and then TICKs until no transition fires or the bound is reached.
+    // The event and the first TICK look at the whole configuration. With --settle-changed,
+    // each later TICK only revisits the states whose configuration changed in the previous
+    // micro-step; otherwise it looks at the whole configuration too.
+    def generateSettleFunction( stateChart : StateChart ) : Unit = {
+        val step = stateData( currentStepName )
+        out.blankLine
+        out.comment( "Dispatches the event, then TICKs until no transition fires, at most maxSteps times." )
+        out.endLine
+        out.comment( "Stores the number of micro-steps that fired transitions in *steps_p, if steps_p is not null." )
+        out.endLine
+        out.comment( "Returns false if the machine was still changing when the bound was reached." )
+        out.endLine
+        out.put( s"${boolType} dispatchAndSettle_${chartName}( ${contextParam}${eventType} *${eventPointerName}, $timeType $now, int maxSteps, int *steps_p ) " )
         out.block{
-            out.putLine( s"${boolType} ${handledArrayName}[ STATE_COUNT ] = {${falseConst}};" )
-            generateCodeForState( stateChart.root, stateChart ) 
-            val rootStateName = stateChart.root.getCName
-            out.put( s"return ${handledArrayName}[ ${globalMacro(stateChart.root)} ];" )
+            out.putLine( s"int steps = 0 ;" )
+            out.putLine( s"int ticks = 0 ;" )
+            if settlesChangedOnly then out.putLine( s"$step += 1 ;" )
+            out.putLine( s"${boolType} handled = ${dispatchCoreName}( ${contextArg}${eventPointerName}, ${eventClassOf}(${eventPointerName}), $now${changedOnlyArg( falseConst )} ) ;" )
+            out.put( s"while( handled && ticks < maxSteps ) " )
+            out.block{
+                out.putLine( "steps += 1 ;" )
+                if settlesChangedOnly then out.putLine( s"$step += 1 ;" )
+                out.putLine( s"handled = ${dispatchCoreName}( ${contextArg}$tickEventPointer, TICK, $now${changedOnlyArg( "ticks > 0" )} ) ;" )
+                out.putLine( "ticks += 1 ;" )
+            }
+            out.putLine( "if( handled ) steps += 1 ;" )
+            out.putLine( "if( steps_p ) *steps_p = steps ;" )
+            out.put( "return ! handled ;" )
         }
+    }
+
+    // Snapshots.
+    // A snapshot records the configuration compactly: walking down from the root, the local
+    // index of the active child of each active OR state, in one byte, and for each active
+    // state with after transitions, the time since it was entered, in four bytes. The time
+    // is capped at the longest after duration, as a longer time has the same effect. A
+    // header holds a magic number, a version and the hash of the chart's symbol map, so
+    // that a snapshot from a different chart is refused. Restoring runs no entry actions.
+
+    protected val snapshotVersion = 1
+
+    def snapshotSize( stateChart : StateChart ) : Int =
+        val orStates = stateChart.nodes.count( _.isOrState )
+        9 + orStates + 4 * timedStates( stateChart ).size
+
+    def snapshotPrototypes : Seq[String] =
+        Seq( s"int snapshot_${chartName}( ${contextParam}$timeType $now, unsigned char *buf, int size )",
+             s"${boolType} restore_${chartName}( ${contextParam}const unsigned char *buf, int size, $timeType $now )" )
+
+    def generateSnapshotFunctions( stateChart : StateChart ) : Unit = {
+        val hash = symbols( stateChart ).hash
+        for state <- stateChart.nodes if state.isOrState && state.childStates.size > 256 do
+            logger.fatal( s"State ${state.getFullName} has more than 256 children, so it can not be snapshot." )
+
+        def longestAfter( state : Node ) : Int =
+            afterEdgesOf( state, stateChart ).map( e => roundedDuration( e.triggerOpt.head.asAfterTrigger.head.durationInMilliseconds ) ).max
+
+        def snapshotWalk( state : Node ) : Unit =
+            if afterEdgesOf( state, stateChart ).nonEmpty then
+                out.putLine( s"elapsed = ($timeType)( $now - ${timeEnteredRef( state, stateChart )} ) ;" )
+                out.putLine( s"if( elapsed > ${toDuration}(${longestAfter( state )}) ) elapsed = ${toDuration}(${longestAfter( state )}) ;" )
+                out.putLine( "SNAPSHOT_PUT32( elapsed ) ;" )
+            if state.isOrState then
+                for child <- state.childStates do
+                    out.ifComm( childActiveTest( state, child ) ) {
+                        out.putLine( s"buf[ n++ ] = (unsigned char) ${localMacro(child)} ;" )
+                        snapshotWalk( child )
+                    }
+                    out.put( " else " )
+                out.putLine( "{ return 0 ; }" )
+            else
+                state.childStates.foreach( snapshotWalk )
 
-        generateEnterAndExitDefs( stateChart )
+        def restoreWalk( state : Node ) : Unit =
+            if afterEdgesOf( state, stateChart ).nonEmpty then
+                out.putLine( "RESTORE_GET32( elapsed ) ;" )
+                generateRestoreStores( state, s"($timeType)( $now - elapsed )", stateChart )
+            else
+                generateRestoreStores( state, now, stateChart )
+            if state.isOrState then
+                out.putLine( s"if( n >= size ) return $falseConst ;" )
+                out.put( "switch( buf[ n++ ] ) " )
+                out.block{
+                    for child <- state.childStates do
+                        out.put( s"case ${localMacro(child)} : " )
+                        out.block( restoreWalk( child ), false )
+                        out.put( " break ;" )
+                        out.endLine
+                    out.put( s"default : return $falseConst ;" )
+                }
+            else
+                state.childStates.foreach( restoreWalk )
+
+        out.blankLine
+        out.putLines( s"""|#define SNAPSHOT_VERSION $snapshotVersion
+                          |#define SNAPSHOT_CHART_HASH 0x${hash.toHexString}u
+                          |#define SNAPSHOT_SIZE ${snapshotSize( stateChart )}
+                          |#define SNAPSHOT_PUT32( x ) do { unsigned long v_ = (unsigned long)(x) ; int i_ ; for( i_ = 0 ; i_ < 4 ; ++i_ ) { buf[ n++ ] = (unsigned char)( v_ >> ( 8 * i_ ) ) ; } } while( 0 )
+                          |#define RESTORE_GET32( x ) do { int i_ ; if( n + 4 > size ) return $falseConst ; x = 0 ; for( i_ = 0 ; i_ < 4 ; ++i_ ) { x |= (unsigned long)buf[ n++ ] << ( 8 * i_ ) ; } } while( 0 )""".stripMargin )
+        out.blankLine
+        out.comment( "Writes the configuration to buf, which must hold SNAPSHOT_SIZE bytes, and returns the number of bytes written." )
+        out.endLine
+        out.comment( "Returns 0 if size is less than SNAPSHOT_SIZE." )
+        out.endLine
+        out.put( s"${snapshotPrototypes(0)} " )
+        out.block{
+            out.putLine( "int n = 0 ;" )
+            out.putLine( "unsigned long elapsed ;" )
+            out.putLine( "if( size < SNAPSHOT_SIZE ) return 0 ;" )
+            out.putLine( "buf[ n++ ] = 'C' ; buf[ n++ ] = 'G' ; buf[ n++ ] = 'S' ; buf[ n++ ] = 'N' ;" )
+            out.putLine( "buf[ n++ ] = SNAPSHOT_VERSION ;" )
+            out.putLine( "SNAPSHOT_PUT32( SNAPSHOT_CHART_HASH ) ;" )
+            out.putLine( "(void) elapsed ;" )
+            snapshotWalk( stateChart.root )
+            out.put( "return n ;" )
+        }
+
+        out.blankLine
+        out.comment( "Sets the configuration from a snapshot taken with snapshot_ of the same chart, without running entry actions." )
+        out.endLine
+        out.comment( "size may be more than snapshot_ returned, e.g. SNAPSHOT_SIZE for a fixed-size record." )
+        out.endLine
+        out.comment( "Time spent in states is measured from now. Returns false, and leaves the machine" )
+        out.endLine
+        out.comment( "unusable until it is initialized or restored, if the snapshot is not valid for this chart." )
+        out.endLine
+        out.put( s"${snapshotPrototypes(1)} " )
+        out.block{
+            out.putLine( "int n = 9 ;" )
+            out.putLine( "unsigned long elapsed ;" )
+            out.putLine( "if( size < 9 || buf[ 0 ] != 'C' || buf[ 1 ] != 'G' || buf[ 2 ] != 'S' || buf[ 3 ] != 'N' || buf[ 4 ] != SNAPSHOT_VERSION ) return " + falseConst + " ;" )
+            out.putLine( "if( ( buf[ 5 ] | (unsigned long)buf[ 6 ] << 8 | (unsigned long)buf[ 7 ] << 16 | (unsigned long)buf[ 8 ] << 24 ) != SNAPSHOT_CHART_HASH ) return " + falseConst + " ;" )
+            out.putLine( "(void) elapsed ;" )
+            for v <- stateVariables( stateChart ) do
+                if v.sizeMacro.isEmpty then
+                    out.putLine( s"${stateData( v.name )} = ${if v.name == timerHeadName then "-1" else "0"} ;" )
+                else
+                    out.putLine( s"{ int i ; for( i = 0 ; i < ${v.sizeMacro} ; ++i ) ${stateData( v.name )}[ i ] = 0 ; }" )
+            end for
+            restoreWalk( stateChart.root )
+            out.put( "return n <= size ;" )
+        }
+        out.blankLine
+        out.putLines( s"""|#undef SNAPSHOT_PUT32
+                          |#undef RESTORE_GET32""".stripMargin )
+    }
+
+    // Whether the child of an active OR state is its active child.
+    protected def childActiveTest( orState : Node, child : Node ) : String =
+        s"${stateData(currentChildArrayName)}[ ${globalMacro(orState)} ] == ${localMacro(child)}"
+
+    // What restoring a state from a snapshot stores, given the time it was entered.
+    def generateRestoreStores( state : Node, entered : String, stateChart : StateChart ) : Unit = {
+        if tracksIsIn( state, stateChart ) then
+            out.putLine( isInStore( state, true, stateChart ) )
+        if tracksTimeEntered( state, stateChart ) then
+            out.putLine( s"${timeEnteredRef( state, stateChart )} = $entered ;" )
+        if state != stateChart.root && stateVariables( stateChart ).exists( _.name == currentChildArrayName ) then
+            val parent = stateChart.parentOf( state )
+            if parent.isOrState then
+                out.putLine( s"${stateData(currentChildArrayName)}[ ${globalMacro(parent)} ] = ${localMacro(state)} ;" )
+        if usesTimerList( stateChart ) && afterEdgesOf( state, stateChart ).nonEmpty then
+            out.putLine( s"startTimer( ${contextArg}${timerMacro(state)}, $now ) ;" )
     }
 
+    // Updates found and remaining for the active states with after transitions.
+    // With the timer list, the earliest deadline is at the head of the list.
+    def generateDeadlineCode( stateChart : StateChart ) : Unit =
+        if usesTimerList( stateChart ) then
+            out.ifComm( s"${stateData(timerHeadName)} >= 0" ) {
+                out.putLine( s"remaining = timerRemaining( ${contextArg}${stateData(timerHeadName)}, $now ) ;" )
+                out.put( s"found = ${trueConst} ;" )
+            }
+            out.endLine
+        else if hasAfterEdgesWithin( stateChart.root, stateChart ) then
+            generateDeadlineCodeForState( stateChart.root, stateChart )
+
+    def generateDeadlineCodeForState( state : Node, stateChart : StateChart ) : Unit = {
+        out.comment( s"Deadlines for state '${state.getCName}'")
+        out.blockNoNewLine{
+            generateOwnDeadlineCode( state, stateChart )
+            val timedChildren = state.childStates.filter( hasAfterEdgesWithin( _, stateChart ) )
+            state match
+                case Node.OrState( _, _ ) if timedChildren.nonEmpty =>
+                    out.switchComm( false, s"${stateData(currentChildArrayName)}[ ${globalMacro(state)} ]" ) {
+                        for child <- timedChildren do
+                            out.caseComm( localMacro(child) ) {
+                                generateDeadlineCodeForState( child, stateChart )
+                            }
+                        end for
+                    }
+                case Node.AndState( _, _ ) =>
+                    for child <- timedChildren do
+                        generateDeadlineCodeForState( child, stateChart )
+                    end for
+                case _ =>
+        }
+        out.endLine
+    }
+
+    // The deadline of the state's own after transitions, if it has any.
+    def generateOwnDeadlineCode( state : Node, stateChart : StateChart ) : Unit = {
+        val afterDurations = afterEdgesOf( state, stateChart ).map( e => roundedDuration( e.triggerOpt.head.asAfterTrigger.head.durationInMilliseconds ) )
+        if afterDurations.nonEmpty then
+            // Once the shortest duration has passed, the state is polled on every TICK.
+            val duration = afterDurations.min
+            val entered = timeEnteredRef( state, stateChart )
+            if duration == 0 then
+                out.putLine( s"$timeType left = 0 ;" )
+            else
+                out.putLine( s"$timeType left = $isAfter( ${toDuration}(${duration}), $entered, $now ) ? 0" )
+                out.indented{
+                    out.putLine( s": ($timeType)( $afterDeadline( ${toDuration}(${duration}), $entered ) - $now ) ;" )
+                }
+            end if
+            out.putLine( s"if( ! found || left < remaining ) { remaining = left ; found = ${trueConst} ; }" )
+        end if
+    }
+
+    // The shortest duration of the state's after transitions, if it has any.
+    def shortestAfterDuration( state : Node, stateChart : StateChart ) : Option[Int] =
+        afterEdgesOf( state, stateChart ).map( e => roundedDuration( e.triggerOpt.head.asAfterTrigger.head.durationInMilliseconds ) ).minOption
+
+    def afterEdgesOf( state : Node, stateChart : StateChart ) : Seq[Edge] =
+        stateChart.edgesFrom( state ).filter( _.triggerOpt.exists( _.asAfterTrigger.nonEmpty ) )
+
+    def hasAfterEdgesWithin( state : Node, stateChart : StateChart ) : Boolean =
+        afterEdgesOf( state, stateChart ).nonEmpty || stateChart.childStatesOf( state ).exists( hasAfterEdgesWithin( _, stateChart ) )
+
+    // Durations as they are used in the generated code: whole, non-negative milliseconds.
+    def roundedDuration( durationInMilliseconds : Double ) : Int =
+        Math.max( durationInMilliseconds.asInstanceOf[Int], 0 )
+
+    // In context mode, the generated C file includes a header that declares
+    // the context struct and the public functions. Callers include the same
+    // header so they can allocate contexts statically, in arrays, or in pools.
+    def generateContextHeader( stateChart : StateChart, chartName : String, cogentVersion : String ) : Unit = {
+        this.chartName = chartName
+        val guardMacroName = s"${chartName.toUpperCase}_CONTEXT_H"
+        generateComment( cogentVersion )
+        out.comment( s"Include this file after the declarations of $boolType, $eventType and $timeType (if not the default)." )
+        out.blankLine
+        out.putLine( s"#ifndef $guardMacroName" )
+        out.putLine( s"#define $guardMacroName" )
+        out.blankLine
+        out.putLine( s"#ifndef $timeType" )
+        out.indented{ out.putLine( s"#define $timeType unsigned int" ) }
+        out.putLine( "#endif")
+        out.blankLine
+        out.putLine( s"#define $localIndexType ${localIndexCType( stateChart )}" )
+        out.blankLine
+        out.comment( s"One instance of this struct holds the complete state of one $chartName machine." )
+        out.endLine
+        out.put( s"typedef struct ${chartName}_ctx_s " )
+        out.blockNoNewLine {
+            for v <- stateVariables( stateChart ) do
+                out.putLine( s"/* ${v.comment} */" )
+                out.putLine( s"${v.cType} ${declarator( v, false )} ;" )
+            end for
+        }
+        out.putLine( s" ${contextTypeName} ;" )
+        out.blankLine
+        out.putLine( s"void initStateMachine_${chartName}( ${contextParam}$timeType $now ) ;" )
+        out.putLine( s"${boolType} dispatchEvent_${chartName}( ${contextParam}${eventType} *${eventPointerName}, $timeType $now ) ;" )
+        out.putLine( s"${boolType} nextDeadline_${chartName}( ${contextParam}$timeType $now, $timeType *deadline_p ) ;" )
+        out.putLine( s"${boolType} dispatchTimeouts_${chartName}( ${contextParam}$timeType $now ) ;" )
+        out.putLine( s"${boolType} dispatchAndSettle_${chartName}( ${contextParam}${eventType} *${eventPointerName}, $timeType $now, int maxSteps, int *steps_p ) ;" )
+        if generationOptions.binaryTrace then
+            out.putLine( s"$traceDumpPrototype ;" )
+        if generationOptions.profile then
+            out.putLine( s"$profileDumpPrototype ;" )
+            out.putLine( s"void profileReset_${chartName}( void ) ;" )
+        if generationOptions.snapshot then
+            out.blankLine
+            out.comment( "The most bytes that a snapshot takes." )
+            out.endLine
+            out.putLine( s"#define ${chartName.toUpperCase}_SNAPSHOT_SIZE ${snapshotSize( stateChart )}" )
+            snapshotPrototypes.foreach( p => out.putLine( s"$p ;" ) )
+        out.blankLine
+        out.putLine( s"#endif" )
+    }
+
+    def contextHeaderName : String = s"${chartName}_context.h"
+
+    protected def dispatchCoreName : String = s"dispatch_${chartName}"
+
+    // Whether dispatchAndSettle_ revisits only the states that changed in the previous micro-step.
+    // This needs a change stamp for each state, which every entry and transition writes, and a
+    // test in every descent, so plain dispatches only pay for it when it is asked for.
+    protected def settlesChangedOnly : Boolean = generationOptions.settleChanged
+
+    // The dispatch core's last parameter, and an argument for it, when settlesChangedOnly.
+    protected def changedOnlyParam : String = if settlesChangedOnly then s", $boolType $changedOnlyVarName" else ""
+
+    protected def changedOnlyArg( value : String ) : String = if settlesChangedOnly then s", $value" else ""
+
+    protected def stateVariables( stateChart : StateChart ) : Seq[StateVariable] =
+        stateVariables( stateChart, generationOptions.compact )
+
+    protected def stateVariables( stateChart : StateChart, compact : Boolean ) : Seq[StateVariable] = {
+        val stateCount = stateChart.nodes.count( _.isState )
+        val orStateCount = stateChart.nodes.count( _.isOrState )
+        val queriedCount = queriedStates( stateChart ).size
+        val timerCount = timedStates( stateChart ).size
+        Seq(
+            StateVariable( "This array maps the global index of each OR state to the local index of its currently active state",
+                            localIndexType, currentChildArrayName, "OR_STATE_COUNT", orStateCount ) ) ++
+        ( if ! compact then
+            Seq( StateVariable( "This array maps keeps track of which states are active",
+                                boolType, isInArrayName, "STATE_COUNT", stateCount ),
+                 StateVariable( "This array maps keeps track the time at which each active state was entered",
+                                timeType, timeEnteredArrayName, "STATE_COUNT", stateCount ) )
+          else
+            ( if queriedCount == 0 then Seq() else
+                Seq( StateVariable( "This bit set keeps track of which states that 'in' guards ask about are active",
+                                    "unsigned char", isInArrayName, "IS_IN_BYTES", ( queriedCount + 7 ) / 8 ) ) ) ++
+            ( if timerCount == 0 then Seq() else
+                Seq( StateVariable( "This array keeps track of the time at which each active state with after transitions was entered",
+                                    timeType, timeEnteredArrayName, "TIMER_COUNT", timerCount ) ) ) ) ++
+        ( if ! settlesChangedOnly then Seq()
+          else
+            Seq(
+                StateVariable( "This array records the micro-step in which each state was entered or had a transition below it",
+                                stepType, changedAtArrayName, "STATE_COUNT", stateCount ),
+                StateVariable( "The number of the current micro-step, modulo 256",
+                                stepType, currentStepName, "", 0 ) ) ) ++
+        ( if ! usesTimerList( stateChart ) then Seq()
+          else
+            Seq(
+                StateVariable( "This array links the running timers in order of their deadlines. -1 ends the list",
+                                timerIndexType( stateChart ), timerNextArrayName, "TIMER_COUNT", timerCount ),
+                StateVariable( "The running timer with the earliest deadline, or -1 if none is running",
+                                timerIndexType( stateChart ), timerHeadName, "", 0 ),
+                StateVariable( "This array records the TICK in which each state last had an expired timer in its subtree",
+                                stepType, dueAtArrayName, "STATE_COUNT", stateCount ),
+                StateVariable( "The number of the current TICK, modulo 256",
+                                stepType, tickStampName, "", 0 ) ) ) ++
+        ( if memoisedGuards( stateChart ).isEmpty then Seq()
+          else
+            Seq(
+                StateVariable( "This bit set records which pure guards have been evaluated in the current dispatch",
+                                "unsigned char", guardKnownArrayName, "PURE_GUARD_BYTES", ( memoisedGuards( stateChart ).size + 7 ) / 8 ),
+                StateVariable( "This bit set holds the values of the pure guards that have been evaluated",
+                                "unsigned char", guardValueArrayName, "PURE_GUARD_BYTES", ( memoisedGuards( stateChart ).size + 7 ) / 8 ) ) )
+    }
+
+    // Compact storage.
+    // With --compact, local indices have the smallest type that holds them, and a state's
+    // isIn is kept only if an 'in' guard asks about it, as a bit. Entry times are kept only
+    // for the states with after transitions, indexed by their timer numbers.
+
+    def localIndexCType( stateChart : StateChart ) : String =
+        if ! generationOptions.compact then "int"
+        else
+            // Local indices go down to -1, which means no particular child. Choice pseudostates
+            // are numbered after the states, and their indices are passed around too.
+            val largest = stateChart.nodes.filter( _.isState ).flatMap( _.childNodes ).map( _.getLocalIndex ).maxOption.getOrElse( 0 )
+            if largest < 128 then "signed char" else "short"
+
+    // The states that 'in' guards ask about. It is asked for each state entered, so it is worked out once.
+    protected var queriedStatesOpt : Option[Seq[Node]] = None
+
+    def queriedStates( stateChart : StateChart ) : Seq[Node] = synchronized {
+        queriedStatesOpt match
+            case Some( states ) => states
+            case None =>
+                val queried = stateChart.edges.flatMap( _.guardOpt ).flatMap( _.queriedStates ).toSet
+                val states = stateChart.nodes.filter( n => n.isState && queried.contains( n.getCName ) ).toSeq.sortBy( _.getGlobalIndex )
+                queriedStatesOpt = Some( states )
+                states
+    }
+
+    def inMacro( state : Node ) : String = s"IN_INDEX_${state.getCName}"
+
+    def tracksIsIn( state : Node, stateChart : StateChart ) : Boolean =
+        ! generationOptions.compact || queriedStates( stateChart ).contains( state )
+
+    def tracksTimeEntered( state : Node, stateChart : StateChart ) : Boolean =
+        ! generationOptions.compact || afterEdgesOf( state, stateChart ).nonEmpty
+
+    def isInRead( state : Node, stateChart : StateChart ) : String =
+        if ! generationOptions.compact then s"${stateData(isInArrayName)}[ ${globalMacro(state)} ]"
+        else bitRead( isInArrayName, inMacro( state ) )
+
+    def isInStore( state : Node, value : Boolean, stateChart : StateChart ) : String =
+        if ! generationOptions.compact then
+            s"${stateData(isInArrayName)}[ ${globalMacro(state)} ] = ${if value then trueConst else falseConst} ;"
+        else bitStore( isInArrayName, inMacro( state ), value )
+
+    // Reading and writing bit i of a bit set that is kept in an array of unsigned chars.
+    protected def bitRead( arrayName : String, i : String ) : String =
+        s"( ( ${stateData(arrayName)}[ $i >> 3 ] >> ( $i & 7 ) ) & 1 )"
+
+    protected def bitStore( arrayName : String, i : String, value : Boolean ) : String =
+        if value then s"${stateData(arrayName)}[ $i >> 3 ] |= (unsigned char)( 1u << ( $i & 7 ) ) ;"
+        else s"${stateData(arrayName)}[ $i >> 3 ] &= (unsigned char) ~( 1u << ( $i & 7 ) ) ;"
+
+    def timeEnteredRef( state : Node, stateChart : StateChart ) : String =
+        val index = if generationOptions.compact then timerMacro( state ) else globalMacro( state )
+        s"${stateData(timeEnteredArrayName)}[ $index ]"
+
+    // Whether a state is active, for code outside the machine. Without isIn,
+    // each ancestor OR state must have the state's branch as its current child.
+    def activeTest( state : Node, stateChart : StateChart ) : String =
+        if tracksIsIn( state, stateChart ) then isInRead( state, stateChart )
+        else
+            val tests = FlatChart.pathOf( state, stateChart ).filter( _ != stateChart.root ).flatMap{ s =>
+                val parent = stateChart.parentOf( s )
+                if parent.isOrState then Some( s"${stateData(currentChildArrayName)}[ ${globalMacro(parent)} ] == ${localMacro(s)}" ) else None }
+            if tests.isEmpty then trueConst else tests.mkString( "( ", " && ", " )" )
+
+    def generateCompactDefines( stateChart : StateChart ) : Unit = {
+        val queried = queriedStates( stateChart )
+        if queried.nonEmpty then
+            out.comment( "Each state that 'in' guards ask about has a bit in the isIn bit set." )
+            out.endLine
+            out.putLine( s"#define IS_IN_BYTES ${( queried.size + 7 ) / 8}" )
+            for (state, i) <- queried.zipWithIndex do
+                out.putLine( s"#define ${inMacro(state)} $i" )
+            out.blankLine
+        end if
+        out.comment( "Memory use:" )
+        out.endLine
+        for line <- memoryReport( stateChart ) do
+            out.comment( line )
+            out.endLine
+        out.blankLine
+    }
+
+    // The RAM that one machine needs, in bytes, followed by the constant tables and the code.
+    // The sizes of TIME_T and bool_t are not known here, so they are taken to be 4 and 1.
+    def memoryReport( stateChart : StateChart ) : Seq[String] =
+        def bytesOf( cType : String ) : Int =
+            cType match
+                case `localIndexType` => bytesOf( localIndexCType( stateChart ) )
+                case `timeType` | "int" | "unsigned int" => 4
+                case "short" => 2
+                case _ => 1
+        def ram( compact : Boolean ) : Seq[(String, Int)] =
+            for v <- stateVariables( stateChart, compact ) yield
+                val count = if v.sizeMacro.isEmpty then 1 else v.size
+                ( v.name, count * ( if compact || v.cType != localIndexType then bytesOf( v.cType ) else 4 ) )
+        val compactRam = ram( true )
+        Seq( s"RAM per machine: ${compactRam.map( _._2 ).sum} bytes (${ram( false ).map( _._2 ).sum} bytes without --compact)," +
+             " taking TIME_T as 4 bytes" ) ++
+        compactRam.map( (name, bytes) => s"    $name: $bytes bytes" ) ++
+        constantReport( stateChart )
+
+    // The part of the memory report about what is not RAM. Only the const tables are
+    // counted; the code and the string literals of the trace macros are not.
+    protected def constantReport( stateChart : StateChart ) : Seq[String] =
+        val timerCount = timedStates( stateChart ).size
+        // The tables that generateTimerFunctions emits.
+        def tables( compact : Boolean ) : Seq[(String, Int)] =
+            if ! usesTimerList( stateChart ) then Seq()
+            else ( if compact then Seq() else Seq( ( "timerState_a", 4 * timerCount ) ) ) ++
+                 Seq( ( "timerDuration_a", 4 * timerCount ) )
+        val compactTables = tables( true )
+        val functions = if generationOptions.inlineTransitions then 0
+                        else stateChart.nodes.count( _.isState ) * 2 - 1
+        Seq( s"Constant tables: ${compactTables.map( _._2 ).sum} bytes (${tables( false ).map( _._2 ).sum} bytes without --compact)" ) ++
+        compactTables.map( (name, bytes) => s"    $name: $bytes bytes" ) ++
+        Seq( s"Enter and exit functions: $functions; the code is not counted here, so measure it with the size command" )
+
+    // Timer list.
+    // Each state with after transitions owns a timer, which runs while the state is active
+    // and expires when the shortest of its durations has passed. Running timers are kept
+    // in a list sorted by deadline, so expired timers are at the front. A TICK marks the
+    // states with expired timers, and their ancestors, and descends only into marked states.
+    // A state whose timer has expired, but whose after transitions are blocked by guards,
+    // stays at the front and is polled on every TICK.
+
+    def usesTimerList( stateChart : StateChart ) : Boolean =
+        generationOptions.timerList && timedStates( stateChart ).nonEmpty
+
+    def timedStates( stateChart : StateChart ) : Seq[Node] =
+        stateChart.nodes.filter( s => s.isState && afterEdgesOf( s, stateChart ).nonEmpty ).toSeq.sortBy( _.getGlobalIndex )
+
+    // The list links hold timer numbers or -1.
+    def timerIndexType( stateChart : StateChart ) : String =
+        if timedStates( stateChart ).size < 128 then "signed char" else "short"
+
+    def timerMacro( state : Node ) : String = s"T_INDEX_${state.getCName}"
+
+    def generateTimerDefines( stateChart : StateChart ) : Unit = {
+        val timed = timedStates( stateChart )
+        out.comment( "Each state with after transitions owns a timer." )
+        out.endLine
+        out.putLine( s"#define TIMER_COUNT ${timed.size}" )
+        for (state, i) <- timed.zipWithIndex do
+            out.putLine( s"#define ${timerMacro(state)} $i" )
+        end for
+        out.blankLine
+    }
+
+    def generateTimerFunctions( stateChart : StateChart ) : Unit = {
+        val timed = timedStates( stateChart )
+        val indexType = timerIndexType( stateChart )
+        val head = stateData( timerHeadName )
+        val next = stateData( timerNextArrayName )
+        out.comment( "The state that owns each timer, and the shortest duration of its after transitions." )
+        out.endLine
+        if ! generationOptions.compact then
+            out.putLine( s"static const int timerState_a[ TIMER_COUNT ] = { ${timed.map( globalMacro( _ ) ).mkString( ", " )} } ;" )
+        out.putLine( s"static const $timeType timerDuration_a[ TIMER_COUNT ] = { ${timed.map( s => s"${toDuration}(${shortestAfterDuration( s, stateChart ).head})" ).mkString( ", " )} } ;" )
+
+        out.blankLine
+        out.comment( "The time left until the timer expires; 0 once it has expired." )
+        out.endLine
+        out.put( s"static $timeType timerRemaining( ${contextParam}int t, $timeType $now ) " )
+        out.block{
+            // Compact storage keeps entry times by timer.
+            val index = if generationOptions.compact then "t" else "timerState_a[ t ]"
+            out.putLine( s"$timeType entered = ${stateData(timeEnteredArrayName)}[ $index ] ;" )
+            out.put( s"return $isAfter( timerDuration_a[ t ], entered, $now ) ? 0 : ($timeType)( $afterDeadline( timerDuration_a[ t ], entered ) - $now ) ;" )
+        }
+
+        out.blankLine
+        out.comment( "Called on entry to the owning state. The timer goes after those that expire no later." )
+        out.endLine
+        out.put( s"static void startTimer( ${contextParam}int t, $timeType $now ) " )
+        out.block{
+            out.putLine( s"$indexType *link_p = &$head ;" )
+            out.putLine( s"while( *link_p >= 0 && timerRemaining( ${contextArg}*link_p, $now ) <= timerDuration_a[ t ] ) link_p = &$next[ *link_p ] ;" )
+            out.putLine( s"$next[ t ] = *link_p ;" )
+            out.put( s"*link_p = ($indexType) t ;" )
+        }
+
+        out.blankLine
+        out.comment( "Called on exit from the owning state, so the timer is in the list." )
+        out.endLine
+        out.put( s"static void stopTimer( ${contextParam}int t ) " )
+        out.block{
+            out.putLine( s"$indexType *link_p = &$head ;" )
+            out.putLine( s"while( *link_p != t ) link_p = &$next[ *link_p ] ;" )
+            out.put( s"*link_p = $next[ t ] ;" )
+        }
+
+        out.blankLine
+        out.comment( "Starts a new TICK and marks the states with expired timers, and their ancestors." )
+        out.endLine
+        out.put( s"static void markDueTimers( ${contextParam}$timeType $now ) " )
+        out.block{
+            val stamp = stateData( tickStampName )
+            out.putLine( s"int t ;" )
+            out.putLine( s"$stamp += 1 ;" )
+            out.put( s"for( t = $head ; t >= 0 && timerRemaining( ${contextArg}t, $now ) == 0 ; t = $next[ t ] ) " )
+            out.block{
+                out.switchComm( true, "t" ) {
+                    for state <- timed do
+                        out.caseComm( timerMacro( state ) ) {
+                            var s = state
+                            while s != stateChart.root do
+                                out.putLine( s"${stateData(dueAtArrayName)}[ ${globalMacro(s)} ] = $stamp ;" )
+                                s = stateChart.parentOf( s )
+                            end while
+                        }
+                    end for
+                }
+            }
+        }
+        out.blankLine
+    }
+
+    protected def declarator( v : StateVariable, useMacro : Boolean ) : String =
+        if v.sizeMacro.isEmpty then v.name
+        else if useMacro then s"${v.name}[ ${v.sizeMacro} ]"
+        else s"${v.name}[ ${v.size} ]"
+
     def generateComment( cogentVersion : String ) : Unit = {
         if generationOptions.outputGenerationDate then 
             val dateStr = java.time.ZonedDateTime.now.toString() 
@@ -94,6 +772,9 @@ class Backend( val logger : Logger, val out : COutputter, val generationOptions
         declMacro( timeType, "", "unsigned int")
         declMacro( isAfter, "(d, t0, t1)", "((TIME_T)(d) <= (TIME_T)((t1)-(t0)))")
         declMacro( toDuration, "(x)", "x##u")
+        declMacro( afterDeadline, "(d, t0)", "((TIME_T)((t0) + (TIME_T)(d)))")
+        declMacro( eventClassType, "", "int" )
+        declMacro( tickEventPointer, "", s"((${eventType} *)0)" )
         declMacro( eventMacro, "(name)", "name" )
         declMacro( guardMacro, "(name)", "name" )
         declMacro( actionMacro, "(name)", "name" )
@@ -120,7 +801,7 @@ class Backend( val logger : Logger, val out : COutputter, val generationOptions
         out.endLine
         out.comment( "Initial states have a local index of 0." )
         out.endLine
-        out.putLine( s"#define LOCAL_INDEX_T int")
+        out.putLine( s"#define LOCAL_INDEX_T ${localIndexCType( stateChart )}")
         var index = 0
         for state <- stateList do
             logger.debug( s"State ${state.getFullName} has global index of ${state.getGlobalIndex}.")
@@ -142,129 +823,235 @@ class Backend( val logger : Logger, val out : COutputter, val generationOptions
             out.blankLine
             index += 1
         end for
+        for shared <- sharedSubmachines do
+            out.comment( s"The ${shared.tops.size} instances of submachine ${shared.name} share code, which finds the states of an instance from its number." )
+            out.endLine
+            if shared.orSize > 0 then
+                out.putLine( s"#define ${sharedOrMacro(shared)}( instance, offset ) ( ${shared.orFirst} + (instance) * ${shared.orSize} + (offset) )" )
+            if shared.size > 0 then
+                out.putLine( s"#define ${sharedMacro(shared)}( instance, offset ) ( ${shared.first} + (instance) * ${shared.size} + (offset) )" )
+            out.blankLine
+        end for
+        val pure = memoisedGuards( stateChart )
+        if pure.nonEmpty then
+            out.comment( "Each pure guard has a bit in the guardKnown and guardValue bit sets." )
+            out.endLine
+            out.putLine( s"#define PURE_GUARD_BYTES ${( pure.size + 7 ) / 8}" )
+            for (name, i) <- pure.zipWithIndex do
+                out.putLine( s"#define ${pureMacro(name)} $i" )
+            out.blankLine
+        end if
     }
 
     def generateEnterAndExitDecls( stateChart : StateChart ) : Unit = {
-        val states = stateChart.nodes.filter( _.isState ).toSeq.sortBy( _.getGlobalIndex )
+        // The instances of a shared submachine share instance 0's functions.
+        val states = stateChart.nodes.filter( s => s.isState && sharedPlace( s ).forall( _._2 == 0 ) ).toSeq.sortBy( _.getGlobalIndex )
         for state <- states do
-            out.put( s"static void ${enterFunctionName(state)} ( $localIndexType, $timeType ) ; "  )
+            out.put( s"static void ${enterFunctionName(state)} ( ${contextParam}${instanceParam(state)}$localIndexType, $timeType ) ; "  )
             if state != stateChart.root  then 
-                out.put( s"static void ${exitFunctionName(state)} ( $localIndexType ) ;" )
+                out.put( s"static void ${exitFunctionName(state)} ( ${contextParam}${instanceParam(state)}$localIndexType ) ;" )
             out.endLine
     } 
 
     def generateEnterAndExitDefs( stateChart : StateChart ) : Unit = {
-        val states = stateChart.nodes.filter( _.isState ).toSeq.sortBy( _.getGlobalIndex )
-        for state <- states do
-            val nameString = out.stringify(state.getFullName)
-            out.blankLine
-            // Generate the enter routine for the the state.
-            out.put( s"static void ${enterFunctionName(state)} ( $localIndexType childIndex, $timeType $now ) "  )
+        val states = stateChart.nodes.filter( s => s.isState && sharedPlace( s ).isEmpty ).toSeq.sortBy( _.getGlobalIndex )
+        inParallel( states ){ state => generateEnterAndExitDef( state, stateChart ) }
+        for shared <- sharedSubmachines do
+            inSharingScope( shared ) {
+                inParallel( shared.members.tail.filter( _.isState ) ){ state => generateEnterAndExitDef( state, stateChart ) }
+            }
+        end for
+    }
+
+    def generateEnterAndExitDef( state : Node, stateChart : StateChart ) : Unit = {
+        out.blankLine
+        // Generate the enter routine for the the state.
+        out.put( s"static void ${enterFunctionName(state)} ( ${contextParam}${instanceParam(state)}$localIndexType childIndex, $timeType $now ) "  )
+        out.block{
+            out.endLine
+            generateEnterStores( state, stateChart )
+
+            state match 
+                case x @ Node.BasicState( _ ) =>
+                    // There should be nothing more to do
+                case x @ Node.OrState( _, _ ) =>
+                    // When an Or state is entered. If the transition is to a descendent,
+                    // There will be an enter call for it soon, so there is no need to
+                    // do anything special. Otherwise, we need to  enter the default child.
+                    // The default child should be first in the list of children
+                    val defaultChild = startChild(x)
+                    out.ifComm( " childIndex == -1 "){
+                        out.put( s"${enterFunctionName( defaultChild )}( ${contextArg}${instanceArg(defaultChild)}-1, $now ) ;")
+                    }
+                    out.endLine
+                case x @ Node.AndState( _, _ ) =>
+                    // When an AND state is entered, all of its children will also be entered.
+                    // There will be another call to enter for the child, if any that is also
+                    // being entered so we don't need to enter that child.
+                    for child <- x.children.filter( _.isState ) do
+                        out.ifComm( s"childIndex != ${localMacro(child)} ") {
+                                out.put( s"${enterFunctionName(child)}( ${contextArg}${instanceArg(child)}-1, $now ) ; ")
+                        }
+                        out.endLine ;
+
+                case _ => assert( false )
+        }
+        out.endLine
+
+        // Generate the exit routine for the the state.
+        if state != stateChart.root  then 
+            out.putLine( s"static void ${exitFunctionName(state)} ( ${contextParam}${instanceParam(state)}$localIndexType childIndex )" )
             out.block{
                 out.endLine
-                out.putLine( s"$isInArrayName[ ${globalMacro(state)} ] = ${trueConst} ;" ) 
-                out.putLine( s"$timeEnteredArrayName[ ${globalMacro(state)} ] = $now ;" )
-                if( state != stateChart.root )
-                    val parent = stateChart.parentOf( state ) 
-                    if( parent.isOrState )
-                        out.putLine( s"$currentChildArrayName[ ${globalMacro(parent)} ] = ${localMacro(state)} ;" ) 
-
-                // Entry actions go here.
-                out.putLine( s"$logEnterStateMacro( $nameString )" )
 
                 state match 
                     case x @ Node.BasicState( _ ) =>
                         // There should be nothing more to do
                     case x @ Node.OrState( _, _ ) =>
-                        // When an Or state is entered. If the transition is to a descendent,
-                        // There will be an enter call for it soon, so there is no need to
-                        // do anything special. Otherwise, we need to  enter the default child.
-                        // The default child should be first in the list of children
-                        val defaultChild = startChild(x)
-                        out.ifComm( " childIndex == -1 "){
-                            out.put( s"${enterFunctionName( defaultChild )}( -1, $now ) ;")
+                        // When an Or state is exited: If the transition is from an descendent,
+                        // it will already have been exited.
+                        // But if the transition is from this node or any node above it
+                        // then we must exit the current child.
+                        out.ifComm( "childIndex == -1") {
+                            out.putLine(s"$localIndexType current = ${stateData(currentChildArrayName)}[ ${globalMacro(x)} ] ;" )
+                            val defaultChild = startChild( x ) 
+                            out.switchComm(true, "current") {
+                                for child <- x.children.filter( _.isState ) do
+                                    out.caseComm( localMacro(child)) {
+                                            out.put( s"${exitFunctionName(child)}( ${contextArg}${instanceArg(child)}-1 ) ; ")
+                                    }
+                                    out.endLine
+                            }
                         }
                         out.endLine
                     case x @ Node.AndState( _, _ ) =>
-                        // When an AND state is entered, all of its children will also be entered.
-                        // There will be another call to enter for the child, if any that is also
-                        // being entered so we don't need to enter that child.
+                        // When an AND state is exited, all of its children will should first
+                        // be exited. If the transition's source is a strict descendant, then
+                        // the region that that source is in should already have been exited.
+                        // So here we exit all the others
                         for child <- x.children.filter( _.isState ) do
                             out.ifComm( s"childIndex != ${localMacro(child)} ") {
-                                    out.put( s"${enterFunctionName(child)}( -1, $now ) ; ")
+                                out.put( s"${exitFunctionName(child)}( ${contextArg}${instanceArg(child)}-1 ) ; ")
                             }
                             out.endLine ;
 
-                    case _ => assert( false )
+                    case _ => assert( false )  
+
+                generateExitStores( state, stateChart )
             }
-            out.endLine
+        end if
+    } 
 
-            // Generate the exit routine for the the state.
-            if state != stateChart.root  then 
-                out.putLine( s"static void ${exitFunctionName(state)} ( $localIndexType childIndex )" )
-                out.block{
-                    out.endLine
+    // What entering a state does, apart from entering its children.
+    def generateEnterStores( state : Node, stateChart : StateChart ) : Unit = {
+        if tracksIsIn( state, stateChart ) then
+            out.putLine( isInStore( state, true, stateChart ) )
+        if tracksTimeEntered( state, stateChart ) then
+            out.putLine( s"${timeEnteredRef( state, stateChart )} = $now ;" )
+        if( state != stateChart.root )
+            val parent = stateChart.parentOf( state ) 
+            if( parent.isOrState )
+                out.putLine( s"${stateData(currentChildArrayName)}[ ${globalMacro(parent)} ] = ${localMacro(state)} ;" ) 
+        if settlesChangedOnly then
+            out.putLine( s"${stateData(changedAtArrayName)}[ ${globalMacro(state)} ] = ${stateData(currentStepName)} ;" )
+        if usesTimerList( stateChart ) && afterEdgesOf( state, stateChart ).nonEmpty then
+            out.putLine( s"startTimer( ${contextArg}${timerMacro(state)}, $now ) ;" )
 
-                    state match 
-                        case x @ Node.BasicState( _ ) =>
-                            // There should be nothing more to do
-                        case x @ Node.OrState( _, _ ) =>
-                            // When an Or state is exited: If the transition is from an descendent,
-                            // it will already have been exited.
-                            // But if the transition is from this node or any node above it
-                            // then we must exit the current child.
-                            out.ifComm( "childIndex == -1") {
-                                out.putLine(s"$localIndexType current = currentChild_a[ ${globalMacro(x)} ] ;" )
-                                val defaultChild = startChild( x ) 
-                                out.switchComm(true, "current") {
-                                    for child <- x.children.filter( _.isState ) do
-                                        out.caseComm( localMacro(child)) {
-                                                out.put( s"${exitFunctionName(child)}( -1 ) ; ")
-                                        }
-                                        out.endLine
-                                }
-                            }
-                            out.endLine
-                        case x @ Node.AndState( _, _ ) =>
-                            // When an AND state is exited, all of its children will should first
-                            // be exited. If the transition's source is a strict descendant, then
-                            // the region that that source is in should already have been exited.
-                            // So here we exit all the others
-                            for child <- x.children.filter( _.isState ) do
-                                out.ifComm( s"childIndex != ${localMacro(child)} ") {
-                                    out.put( s"${exitFunctionName(child)}( -1 ) ; ")
-                                }
-                                out.endLine ;
+        // Entry actions go here.
+        out.putLine( traceStatement( s"$logEnterStateMacro( ${out.stringify(traceName(state))} )",
+                                     "TRACE_ENTER_STATE", symbols( stateChart ).stateId( state ) ) )
+    }
 
-                        case _ => assert( false )  
+    // What exiting a state does, apart from exiting its children.
+    def generateExitStores( state : Node, stateChart : StateChart ) : Unit = {
+        // Exit actions go here
+        out.putLine( traceStatement( s"$logExitStateMacro( ${out.stringify(traceName(state))} )",
+                                     "TRACE_EXIT_STATE", symbols( stateChart ).stateId( state ) ) )
 
-                    // Exit actions go here
-                    out.putLine( s"$logExitStateMacro( $nameString )" )
+        if tracksIsIn( state, stateChart ) then
+            out.putLine( isInStore( state, false, stateChart ) )
+        if usesTimerList( stateChart ) && afterEdgesOf( state, stateChart ).nonEmpty then
+            out.putLine( s"stopTimer( ${contextArg}${timerMacro(state)} ) ;" )
+    }
 
-                    out.putLine( s"$isInArrayName[ ${globalMacro(state)} ] = ${falseConst} ;" )
-                }
-            end if
-        end for
-    } 
+    // Enters a state. If childOpt is a child, that child will be entered next by the
+    // caller; otherwise the state's default child, or all its regions, are entered too.
+    // With inlineTransitions, the enter functions are expanded in place. Since the
+    // child is known here, the tests on childIndex are made by the generator.
+    def generateEnterCall( state : Node, childOpt : Option[Node], stateChart : StateChart ) : Unit =
+        if ! generationOptions.inlineTransitions then
+            val childIndex = childOpt.map( localMacro( _ ) ).getOrElse( "-1" )
+            out.putLine( s"${enterFunctionName(state)}( ${contextArg}${instanceArg(state)}${childIndex}, $now ) ;" ) 
+        else
+            generateEnterStores( state, stateChart )
+            state match
+                case x @ Node.OrState( _, _ ) =>
+                    if childOpt.isEmpty then generateEnterCall( startChild( x ), None, stateChart )
+                case x @ Node.AndState( _, _ ) =>
+                    for child <- x.childStates if ! childOpt.contains( child ) do
+                        generateEnterCall( child, None, stateChart )
+                case _ =>
+        end if
+
+    // Exits a state. If childOpt is a child, that child has already been exited;
+    // otherwise the state's active descendants are exited first.
+    // With inlineTransitions, the exit functions are expanded in place. Only the
+    // choice of the active child of an OR state, which is known only at run time,
+    // is left to a switch.
+    def generateExitCall( state : Node, childOpt : Option[Node], stateChart : StateChart ) : Unit =
+        if ! generationOptions.inlineTransitions then
+            val childIndex = childOpt.map( localMacro( _ ) ).getOrElse( "-1" )
+            out.putLine( s"${exitFunctionName(state)}( ${contextArg}${instanceArg(state)}${childIndex} ) ;" ) 
+        else
+            state match
+                case x @ Node.OrState( _, _ ) if childOpt.isEmpty =>
+                    out.switchComm( true, s"${stateData(currentChildArrayName)}[ ${globalMacro(x)} ]" ) {
+                        for child <- x.childStates do
+                            out.caseComm( localMacro(child) ) {
+                                generateExitCall( child, None, stateChart )
+                            }
+                        end for
+                    }
+                case x @ Node.AndState( _, _ ) =>
+                    for child <- x.childStates if ! childOpt.contains( child ) do
+                        generateExitCall( child, None, stateChart )
+                case _ =>
+            generateExitStores( state, stateChart )
+        end if
 
 
-    def generateCodeForState( state : Node, stateChart : StateChart ) : Unit = {
+    // Each state's block has a local flag saying whether a transition was taken
+    // from the state or one of its descendants. At the end of the block, the flag
+    // is passed up to the parent's flag, which is in scope since the parent's block
+    // encloses the child's. So only the flags along the active path are ever touched.
+    def generateCodeForState( state : Node, stateChart : StateChart, parentHandled : String ) : Unit = {
         state match 
             case x @ Node.BasicState( _ ) =>
-                generateCodeForBasicState( x, stateChart )
+                generateCodeForBasicState( x, stateChart, parentHandled )
             case x @ Node.OrState( _, _ ) =>
-                generateCodeForOrState( x, stateChart )
+                generateCodeForOrState( x, stateChart, parentHandled )
             case x @ Node.AndState( _, _ ) =>
-                generateCodeForAndState( x, stateChart )
+                generateCodeForAndState( x, stateChart, parentHandled )
             case _ => assert( false ) 
     }
 
-    def generateCodeForBasicState( state : Node.BasicState, stateChart : StateChart ) : Unit = {
+    def handledFlag( state : Node ) : String = s"${handledVarName}_${state.getCName}"
+
+    def declareHandledFlag( state : Node ) : Unit =
+        out.putLine( s"${boolType} ${handledFlag(state)} = ${falseConst} ;" )
+
+    def passUpHandledFlag( state : Node, parentHandled : String ) : Unit =
+        out.putLine( s"if( ${handledFlag(state)} ) ${parentHandled} = ${trueConst} ;" )
+
+    def generateCodeForBasicState( state : Node.BasicState, stateChart : StateChart, parentHandled : String ) : Unit = {
         out.comment( s"Code for basic state '${state.getCName}'")
         out.blockNoNewLine{
         
             if needCodeForEvents( state, stateChart ) then
+                declareHandledFlag( state )
                 generateEventCodeForState( state, stateChart )
+                out.endLine
+                passUpHandledFlag( state, parentHandled )
             else
                 out.comment( s"State ${state.getCName} has no outgoing transitions." )
                 out.endLine
@@ -275,37 +1062,59 @@ class Backend( val logger : Logger, val out : COutputter, val generationOptions
         out.endLine
     }
 
-    def generateCodeForOrState( state : Node.OrState, stateChart : StateChart ) : Unit = {
+    // Descend from a state into one of its children.
+    // The child is skipped when no state in its subtree has a transition on the
+    // current event class. The test is omitted when it would not narrow the test
+    // already made for the parent, so every state's code runs only for events
+    // that its subtree can handle.
+    // With --settle-changed, a settling TICK descends only into states that changed in the previous micro-step.
+    // With the timer list, a TICK descends only into states that have an expired timer below them.
+    def generateDescent( parent : Node, child : Node, stateChart : StateChart )( contents : => Unit ) : Unit = {
+        val classes = eventClassesOf( child, stateChart )
+        if classes.isEmpty then
+            out.comment( s"State ${child.getCName} can not handle any event." )
+            out.endLine
+        else
+            val previousStep = s"($stepType)( ${stateData(currentStepName)} - 1 )"
+            val classTest = if classes == eventClassesOf( parent, stateChart ) then Seq() else Seq( eventClassTest( classes ) )
+            val changedTest = if ! settlesChangedOnly then Seq() else
+                                  Seq( s"( ! $changedOnlyVarName || ${stateData(changedAtArrayName)}[ ${globalMacro(child)} ] == $previousStep )" )
+            val dueTest = if usesTimerList( stateChart ) && classes.contains( "TICK" ) then
+                              Seq( s"( $eventClassVarName != TICK || ${stateData(dueAtArrayName)}[ ${globalMacro(child)} ] == ${stateData(tickStampName)} )" )
+                          else Seq()
+            val tests = classTest ++ changedTest ++ dueTest
+            if tests.isEmpty then contents
+            else out.ifComm( tests.mkString( " && " ) ) {
+                contents
+            }
+            out.endLine
+        end if
+    }
+
+    // The set of event classes, as C expressions, on which some state in the
+    // subtree rooted at the given state has a transition. After triggers are
+    // handled on TICK.
+    protected val eventClassesCache = scala.collection.concurrent.TrieMap[String, Set[String]]()
+
+    def eventClassesOf( state : Node, stateChart : StateChart ) : Set[String] =
+        eventClassesCache.getOrElseUpdate( state.getFullName, {
+            val own : Set[String] = stateChart.edgesFrom( state ).flatMap( _.triggerOpt ).toSet[Trigger].map{
+                    case Trigger.NamedTrigger( name ) => s"$eventMacro($name)"
+                    case Trigger.AfterTrigger( _ ) => "TICK" }
+            stateChart.childStatesOf( state ).foldLeft( own )( (acc, child) => acc union eventClassesOf( child, stateChart ) ) } )
+
+    def eventClassTest( classes : Set[String] ) : String =
+        classes.toSeq.sorted.map( c => s"$eventClassVarName == $c" ).mkString( "( ", " || ", " )" )
+
+    def generateCodeForOrState( state : Node.OrState, stateChart : StateChart, parentHandled : String ) : Unit = {
         
         out.comment( s"Code for OR state '${state.getCName}'")
         out.blockNoNewLine{
 
-            val globalIndexMacro = globalMacro(state) 
-
-            if state.childStates.size == 0 then
-                // No children.  Not possible. All Or nodes should have a start state
-                // and this requirement should already have been checked.
-                assert( false ) ;
-            else if state.childStates.size == 1 then
-                // An Or with one child does not need a switch command
-                val child = state.childStates.head
-                generateCodeForState( child, stateChart )
-                out.put( s"${handledArrayName}[ $globalIndexMacro ] = ${handledArrayName}[ ${globalMacro(child)} ] ;")
-                out.endLine
-            else /* state.childStates.size > 1 */
-                // Generate a switch command.
-                out.switchComm(true, s"${currentChildArrayName}[ $globalIndexMacro]"  ) {
-                    for child <- state.childStates do
-                        out.caseComm( localMacro(child)  ) {
-                            generateCodeForState( child, stateChart )
-                            out.putLine( s"${handledArrayName}[ $globalIndexMacro ] = ${handledArrayName}[ ${globalMacro(child)} ] ;")
-                        }
-                        out.endLine
-                    end for
-                }
-            end if
+            declareHandledFlag( state )
+            generateCodeForChildren( state, stateChart )
             if needCodeForEvents( state, stateChart ) then
-                out.ifComm( s"! ${handledArrayName}[ ${globalMacro(state)} ]" ){
+                out.ifComm( s"! ${handledFlag(state)}" ){
                     generateEventCodeForState( state, stateChart )
                 }
                 out.endLine
@@ -313,32 +1122,64 @@ class Backend( val logger : Logger, val out : COutputter, val generationOptions
                 out.comment( s"State ${state.getCName} has no outgoing transitions." )
                 out.endLine
             end if
+            passUpHandledFlag( state, parentHandled )
         }
         out.comment( s"End of OR state '${state.getCName}'")
         out.endLine
     }
 
-    def generateCodeForAndState( state : Node.AndState, stateChart : StateChart ) : Unit = {
+    // Passes the event to the active children of an OR or AND state. The state's handled
+    // flag is set if one of them takes a transition. The top state of an instance of a
+    // shared submachine passes it to the submachine's shared code instead.
+    def generateCodeForChildren( state : Node, stateChart : StateChart ) : Unit =
+        sharedTopOf( state ) match
+            case Some( (shared, instance) ) if ! sharingScope.exists( _ eq shared ) =>
+                generateSharedDispatchCall( state, shared, instance, stateChart )
+            case _ =>
+                state match
+                    case x @ Node.OrState( _, _ ) =>
+                        if x.childStates.size == 0 then
+                            // No children.  Not possible. All Or nodes should have a start state
+                            // and this requirement should already have been checked.
+                            assert( false ) ;
+                        else if x.childStates.size == 1 then
+                            // An Or with one child does not need a switch command
+                            val child = x.childStates.head
+                            generateDescent( x, child, stateChart ) { generateCodeForState( child, stateChart, handledFlag(x) ) }
+                        else /* x.childStates.size > 1 */
+                            // Generate a switch command.
+                            out.switchComm(true, s"${stateData(currentChildArrayName)}[ ${globalMacro(x)}]"  ) {
+                                inParallel( x.childStates ){ child =>
+                                    out.caseComm( localMacro(child)  ) {
+                                        generateDescent( x, child, stateChart ) { generateCodeForState( child, stateChart, handledFlag(x) ) }
+                                    }
+                                    out.endLine
+                                }
+                            }
+                        end if
+                    case x @ Node.AndState( _, _ ) =>
+                        inParallel( x.childStates ){ child =>
+                            generateDescent( x, child, stateChart ) { generateCodeForState( child, stateChart, handledFlag(x) ) }
+                        }
+                    case _ => assert( false )
+    end generateCodeForChildren
+
+    def generateCodeForAndState( state : Node.AndState, stateChart : StateChart, parentHandled : String ) : Unit = {
         out.comment( s"Code for AND state '${state.getCName}'")
         out.blockNoNewLine {
-            val globalIndexMacro = globalMacro(state) 
-            var first = true
-            for child <- state.childStates do
-                generateCodeForState( child, stateChart )
-                val str = if first then "" else s" ${handledArrayName}[ $globalIndexMacro ] ||"
-                out.putLine( s"${handledArrayName}[ $globalIndexMacro ] =$str ${handledArrayName}[ ${globalMacro(child)} ] ;")
-                first = false 
-            end for
-            
+            declareHandledFlag( state )
+            generateCodeForChildren( state, stateChart )
             
             if needCodeForEvents( state, stateChart ) then
-                out.ifComm( s"! ${handledArrayName}[ ${globalMacro(state)} ]" ){
+                out.ifComm( s"! ${handledFlag(state)}" ){
                     generateEventCodeForState( state, stateChart )
                 }
+                out.endLine
             else
                 out.comment( s"State ${state.getCName} has no outgoing transitions." )
                 out.endLine
             end if
+            passUpHandledFlag( state, parentHandled )
         }
         out.comment( s"End of AND state '${state.getCName}'")
         out.endLine
@@ -348,7 +1189,7 @@ class Backend( val logger : Logger, val out : COutputter, val generationOptions
         out.comment( s"Event handling code for state ${state.getCName}")
         out.endLine
         // First collect all the edges out of this state.
-        val edges = stateChart.edgeSet.filter( e => e.source == state )
+        val edges = stateChart.edgesFrom( state ).toSet
         // Now all named triggers
         val namedTriggers : Set[Trigger.NamedTrigger] =
             edges.map(e => e.triggerOpt.flatMap( _.asNamedTrigger )).flatten
@@ -358,7 +1199,7 @@ class Backend( val logger : Logger, val out : COutputter, val generationOptions
         //println( s"namedTriggers is $namedTriggers")
         //println( s"afterTriggers is $afterTriggers")
         if namedTriggers.size > 0 || afterTriggers.size > 0 then
-            out.switchComm( false, s"${eventClassOf}(${eventPointerName})" ) {
+            out.switchComm( false, eventClassVarName ) {
                 for Trigger.NamedTrigger( name ) <- namedTriggers do
                     generateCaseForEvent( name, state, stateChart )
                 end for
@@ -376,12 +1217,7 @@ class Backend( val logger : Logger, val out : COutputter, val generationOptions
     def generateCaseForEvent( name : String, state : Node, stateChart : StateChart ) : Unit = {
         // Gather all edges that exit the state and have NamedTrigger( name )
         // as the trigger
-        val edges = stateChart.edges.filter(
-                        e =>   e.source == state
-                            && e.triggerOpt.map( t => t match {
-                                case Trigger.NamedTrigger(n) => n==name
-                                case _ => false
-                            }).getOrElse( false ) ) ;
+        val edges = stateChart.edgesFromOn( state, Trigger.NamedTrigger( name ) )
         
         out.caseComm( s"$eventMacro($name)" ){
             generateIfsForEdges( Some(name), state, edges, stateChart ) ;
@@ -398,30 +1234,16 @@ class Backend( val logger : Logger, val out : COutputter, val generationOptions
 
     def generateIfForDuration( durationInMilliseconds : Double, state : Node, stateChart : StateChart ) : Unit = {
         // Collect all edges with this duration.
-        val edges = stateChart.edges.filter(
-                        e =>   e.source == state
-                            && e.triggerOpt.map( t => t match {
-                                case Trigger.AfterTrigger(d) =>
-                                    d == durationInMilliseconds
-                                case _ =>
-                                    false
-                                }).getOrElse( false ) ) ;
-        var intDuration : Int = durationInMilliseconds.asInstanceOf[Int]
-        
-        if intDuration.asInstanceOf[Double] != durationInMilliseconds then
-            logger.warning( s"Duration $durationInMilliseconds ms rounded to $intDuration ms" )
-        
-        if intDuration < 0 then
-            logger.warning( s"Duration $intDuration ms is negative" )
-            intDuration = 0 
+        val edges = stateChart.edgesFromOn( state, Trigger.AfterTrigger( durationInMilliseconds ) )
+        val intDuration = checkedDuration( durationInMilliseconds )
 
         out.comment( s"Code for after( $durationInMilliseconds ms )" )
         out.endLine
         out.ifComm { 
-            out.put(s"   ! ${handledArrayName}[${globalMacro(state)}]")
+            out.put(s"   ! ${handledFlag(state)}")
             if( intDuration > 0 )
                 out.endLine
-                out.put(s"    && $isAfter( ${toDuration}(${intDuration}), $timeEnteredArrayName[ ${globalMacro(state)} ], $now )")
+                out.put(s"    && $isAfter( ${toDuration}(${intDuration}), ${timeEnteredRef( state, stateChart )}, $now )")
         }{
             val triggerNameForMessages = Some(s"after $intDuration ms")
             generateIfsForEdges( triggerNameForMessages, state, edges, stateChart ) ;
@@ -429,7 +1251,61 @@ class Backend( val logger : Logger, val out : COutputter, val generationOptions
         out.endLine
     }
 
+    // The duration of an after trigger in whole, non-negative milliseconds.
+    def checkedDuration( durationInMilliseconds : Double ) : Int = {
+        var intDuration : Int = durationInMilliseconds.asInstanceOf[Int]
+        
+        if intDuration.asInstanceOf[Double] != durationInMilliseconds then
+            logger.warning( s"Duration $durationInMilliseconds ms rounded to $intDuration ms" )
+        
+        if intDuration < 0 then
+            logger.warning( s"Duration $intDuration ms is negative" )
+            intDuration = 0 
+        intDuration
+    }
+
     def generateIfsForEdges( triggerDescriptionOpt : Option[String], node : Node, edges : Seq[Edge], stateChart : StateChart) : Unit = {
+        if( node.isState )
+            out.putLine( s"${statusType} ${statusVarName} = ${okStatusConstant} ;") 
+        classifyEdges( triggerDescriptionOpt, node, edges ) match
+            case None => ()
+            case Some( Backend.EdgeGroup( Some( edge ), _, _ ) ) =>
+                if node.isState then
+                    out.putLine( s"${handledFlag(node)} = ${trueConst} ; " ) 
+                end if
+                generateTransition( edge, stateChart )
+            case Some( Backend.EdgeGroup( None, conditionalEdges, elseEdgeOpt ) ) =>
+                // For each edge that is not guarded by an else, output "if(...) {...} else "
+                for edge <- conditionalEdges do
+                    val guard = edge.guardOpt.head
+                    out.ifComm{ generateGuardExpression( guard, stateChart, node ) }{
+                        out.putLine( traceStatement( s"${logGuardTrueMacro}( \"${guard.toString()}\")",
+                                                     "TRACE_GUARD_TRUE", symbols( stateChart ).guardId( guard ) ) )
+                        if node.isState then
+                            out.putLine( s"${handledFlag(node)} = ${trueConst} ; " ) 
+                        end if
+                        generateTransition( edge, stateChart )
+                    }
+                    out.put( " else " )
+                end for
+                if elseEdgeOpt.nonEmpty then
+                    out.block{ generateTransition( elseEdgeOpt.get, stateChart ) }
+                else if node.isState then
+                    out.block{
+                        out.comment( "No transition." ) ; out.endLine
+                    }
+                else
+                    out.block{
+                        // No longer needed? logger.warning( s"$locationForMessages has no else guarded transition. If none of the guards are true, the code will crash." )
+                        out.putLine( "assertUnreachable() ;" )
+                     }
+                end if
+    }
+
+    // Splits the edges leaving a vertex on one trigger into the unguarded edge,
+    // the guarded edges in the order their guards should be tried, and the else edge.
+    // Reports the combinations that can not be translated and returns None for those.
+    def classifyEdges( triggerDescriptionOpt : Option[String], node : Node, edges : Seq[Edge] ) : Option[Backend.EdgeGroup] = {
         // Note that this function is used for the collection of all edges
         // out of a choice node, but also for the collection of all edges
         // out of a state that have the same trigger.  This leads to
@@ -466,8 +1342,6 @@ class Backend( val logger : Logger, val out : COutputter, val generationOptions
 
         val locationForMessages = ( s"Vertex ${node.getFullName}" + (if( triggerDescriptionOpt.isEmpty ) "" else s" on trigger '${triggerDescriptionOpt.get}'" ))
         assert( node.isState || node.isChoicePseudostate )
-        if( node.isState )
-            out.putLine( s"${statusType} ${statusVarName} = ${okStatusConstant} ;") 
         val elseGuardedEdges = edges.filter( e => e.guardOpt.map( g => g match{
                                                     case Guard.ElseGuard() => true
                                                     case _ => false } ).getOrElse( false ) ) ;
@@ -482,22 +1356,21 @@ class Backend( val logger : Logger, val out : COutputter, val generationOptions
         if unguardedEdges.size > 1 then 
             // Case: More than one unguarded edges.
             logger.fatal( s"$locationForMessages has more than one transition with no guard." )
+            None
         else if unguardedEdges.size == 1 then
             // Case: There is one unguarded edge ...
             if edges.size > 1 then
                 // ... but there are also other edges
                 logger.fatal( s"$locationForMessages has both unguarded and guarded transitions." )
+                None
             else
                 // ... and it's the only edge
                 assert( edges.size == 1 )
-                val edge = unguardedEdges.head
-                if node.isState then
-                    out.putLine( s"${handledArrayName}[${globalMacro(node)}] = ${trueConst} ; " ) 
-                end if
-                generateTransition( edge, stateChart )
+                Some( Backend.EdgeGroup( Some( unguardedEdges.head ), Seq(), None ) )
         else if elseGuardedEdges.size > 1 then
             // Case: There are no unguarded edges, but there are multiple else-guarded edges.
             logger.fatal( s"$locationForMessages multiple transitions guarded by 'else'." )
+            None
         else
             // Case there are no unguarded edges and at most 1 else-guarded edges
             assert( unguardedEdges.size == 0 )
@@ -527,30 +1400,7 @@ class Backend( val logger : Logger, val out : COutputter, val generationOptions
                 if Satisfaction.definitely_at_least_one(logger, guards) then
                     logger.warning( s"$locationForMessages: else branch can not be taken.")
 
-            // For each edge that is not guarded by an else, output "if(...) {...} else "
-            for edge <- conditionalEdges do
-                val guard = edge.guardOpt.head
-                out.ifComm{ generateGuardExpression( guard, stateChart, node ) }{
-                    out.putLine( s"${logGuardTrueMacro}( \"${guard.toString()}\")" )
-                    if node.isState then
-                        out.putLine( s"${handledArrayName}[${globalMacro(node)}] = ${trueConst} ; " ) 
-                    end if
-                    generateTransition( edge, stateChart )
-                }
-                out.put( " else " )
-            end for
-            if elseGuardedEdges.size == 1 then
-                out.block{ generateTransition( elseGuardedEdges.head, stateChart ) }
-            else if node.isState then
-                out.block{
-                    out.comment( "No transition." ) ; out.endLine
-                }
-            else
-                out.block{
-                    // No longer needed? logger.warning( s"$locationForMessages has no else guarded transition. If none of the guards are true, the code will crash." )
-                    out.putLine( "assertUnreachable() ;" )
-                 }
-            end if
+            Some( Backend.EdgeGroup( None, conditionalEdges, elseGuardedEdges.headOption ) )
         end if
     }
 
@@ -561,13 +1411,14 @@ class Backend( val logger : Logger, val out : COutputter, val generationOptions
         assert( target.isState || target.isChoicePseudostate )
         val actions = edge.actions
         out.comment( s"Transition from ${source.getCName} to ${target.getCName}." ) ; out.endLine
+        generateTransitionStart( edge, stateChart )
 
 
         val leastCommonOr = stateChart.leastCommonOrOf( source, target )
 
         if( source.isState ) {
             // Exit the source. The -1 means exit all active children as well.
-            out.putLine( s"${exitFunctionName(source)}( -1 ) ;" ) 
+            generateExitCall( source, None, stateChart )
         } else {
             assert( source.isChoicePseudostate )
             // If the source is a choice node, then we don't need to exit it.
@@ -577,11 +1428,21 @@ class Backend( val logger : Logger, val out : COutputter, val generationOptions
         var p = stateChart.parentOf( source )
         while( p != leastCommonOr )
             // Exit the ancestor. The parameter means don't also exit this child.
-            out.putLine( s"${exitFunctionName(p)}( ${localMacro(child)} ) ;" ) 
+            generateExitCall( p, Some( child ), stateChart )
             child = p
             p = stateChart.parentOf( p )
+        // Record that the configuration below the least common OR state changed in this micro-step.
+        // Shared code stops at the top state of the instance; the caller marks the states above.
+        if settlesChangedOnly then
+            val lastChanged = sharingScope.map( _.top ).getOrElse( stateChart.root )
+            var changed = leastCommonOr
+            while changed != lastChanged do
+                out.putLine( s"${stateData(changedAtArrayName)}[ ${globalMacro(changed)} ] = ${stateData(currentStepName)} ;" )
+                changed = stateChart.parentOf( changed )
+            end while
+            out.putLine( s"${stateData(changedAtArrayName)}[ ${globalMacro(lastChanged)} ] = ${stateData(currentStepName)} ;" )
         // Generate code for the actions
-        actions.foreach( generateActionCode( _ ) )
+        actions.foreach( generateActionCode( _, stateChart ) )
         // Now we need to enter the states down to and including the parent.
         // But first we find the path
         //println( s"lcoa is ${leastCommonOr.getCName} target is ${target.getCName}") 
@@ -598,12 +1459,12 @@ class Backend( val logger : Logger, val out : COutputter, val generationOptions
             child = path.tail.head
             // Enter an ancestor of the target.
             // The parameter here means don't also enter this child.
-            out.putLine( s"${enterFunctionName(p)}( ${localMacro(child)}, $now ) ;" ) 
+            generateEnterCall( p, Some( child ), stateChart )
             path = path.tail
         if target.isState then
             // Enter the target.
             // The parameter of -1 means enter the child(ren) also.
-            out.putLine( s"${enterFunctionName(target)}( -1, $now ) ;" ) 
+            generateEnterCall( target, None, stateChart )
         else
             assert( target.isChoicePseudostate )
             // For choice pseudostate's there is no enter function.
@@ -611,16 +1472,125 @@ class Backend( val logger : Logger, val out : COutputter, val generationOptions
             // code for the exiting edges.  The graph should already have
             // been checked for loops that do not go through a state
             // and so this recursive call should terminate.
-            val edges = stateChart.edges.filter( e => e.source == target )
-            generateIfsForEdges( None, target, edges, stateChart )
+            // In shared code, the transitions from a choice that leave the instance are
+            // taken by code for each instance.
+            val edges = stateChart.edgesFrom( target )
+            sharingScope.filter( shared => shared.wired.contains( shared.positionOf( target ) ) ) match
+                case Some( shared ) =>
+                    out.putLine( s"${sharedExitsName(shared)}( ${contextArg}instance, ${shared.positionOf( target )}, $eventPointerName, $statusVarName, $now ) ;" )
+                case None =>
+                    generateIfsForEdges( None, target, edges, stateChart )
+        generateTransitionDone( edge, stateChart )
     }
 
+    // Pure guards and guard costs.
+    // The annotation file can declare named guards pure: they have no side effects, and they
+    // give the same answer throughout a dispatch. Each is then evaluated at most once per call
+    // of the dispatch core, that is, per micro-step, and its answer is kept in a bit set that
+    // is cleared at the start of the call. The file can also give guards costs, and the operands
+    // of a chain of ands, or of ors, are then tried cheapest first, where that can not change
+    // what the guard does.
+
+    // Whether this style of code remembers pure guards.
+    protected def memoisesGuards : Boolean = true
+
+    // The named guards whose answers are remembered, in the order of their bits. It is asked
+    // for each named guard generated, so it is worked out once.
+    protected var memoisedGuardsOpt : Option[Seq[String]] = None
+
+    def memoisedGuards( stateChart : StateChart ) : Seq[String] = synchronized {
+        memoisedGuardsOpt match
+            case Some( names ) => names
+            case None =>
+                val names = if ! memoisesGuards then Seq()
+                            else stateChart.edges.flatMap( _.guardOpt ).flatMap( _.namedGuards ).filter( generationOptions.annotations.isPure )
+                                           .toSeq.distinct.sorted
+                memoisedGuardsOpt = Some( names )
+                names
+    }
+
+    def pureMacro( name : String ) : String = s"PURE_INDEX_${name}"
+
+    // Defines the function that records the answer of a pure guard. It must follow the
+    // declarations of the state variables.
+    def generatePureGuardSupport( stateChart : StateChart ) : Unit = {
+        if memoisedGuards( stateChart ).nonEmpty then
+            out.comment( "Records the answer of pure guard i for the rest of the dispatch, and returns it." )
+            out.endLine
+            out.put( s"static $boolType rememberGuard( ${contextParam}int i, $boolType value ) " )
+            out.block{
+                out.putLine( bitStore( guardKnownArrayName, "i", true ) )
+                out.putLine( s"if( value ) ${bitStore( guardValueArrayName, "i", true )}" )
+                out.putLine( s"else ${bitStore( guardValueArrayName, "i", false )}" )
+                out.put( "return value ;" )
+            }
+            out.blankLine
+        end if
+    }
+
+    // Forgets the answers of the pure guards, at the start of the dispatch core.
+    def generatePureGuardReset( stateChart : StateChart ) : Unit = {
+        if memoisedGuards( stateChart ).nonEmpty then
+            out.putLine( s"{ int i ; for( i = 0 ; i < PURE_GUARD_BYTES ; ++i ) ${stateData(guardKnownArrayName)}[ i ] = 0 ; }" )
+    }
+
+    def guardCost( guard : Guard ) : Int = generationOptions.annotations.costOf( guard )
+
+    // Whether evaluating a guard more or less often, or earlier or later, can make no difference.
+    // Raw guards may, e.g. p != 0 && p->ready, and so may named guards that are not declared pure.
+    private def isMovable( guard : Guard ) : Boolean =
+        guard match
+            case Guard.OKGuard() | Guard.InGuard( _ ) => true
+            case Guard.NamedGuard( name ) => generationOptions.annotations.isPure( name )
+            case Guard.NotGuard( operand ) => isMovable( operand )
+            case Guard.AndGuard( left, right ) => isMovable( left ) && isMovable( right )
+            case Guard.OrGuard( left, right ) => isMovable( left ) && isMovable( right )
+            case Guard.ImpliesGuard( left, right ) => isMovable( left ) && isMovable( right )
+            case _ => false
+
+    // The guard with the operands of each chain of ands, and of ors, in order of cost. Only
+    // operands that are next to each other and movable change places, so an operand that
+    // is not movable is evaluated exactly when it was before. The sort is stable, so without
+    // costs nothing moves.
+    def costOrdered( guard : Guard ) : Guard =
+        def chain( g : Guard, isAnd : Boolean ) : Seq[Guard] =
+            g match
+                case Guard.AndGuard( left, right ) if isAnd => chain( left, isAnd ) ++ chain( right, isAnd )
+                case Guard.OrGuard( left, right ) if ! isAnd => chain( left, isAnd ) ++ chain( right, isAnd )
+                case _ => Seq( costOrdered( g ) )
+        def ordered( g : Guard, isAnd : Boolean ) : Guard =
+            val runs = chain( g, isAnd ).foldLeft( List[List[Guard]]() ){ (runs, operand) =>
+                runs match
+                    case run :: rest if isMovable( operand ) && isMovable( run.head ) => ( operand :: run ) :: rest
+                    case _ => List( operand ) :: runs }
+            runs.reverse.flatMap( run => run.reverse.sortBy( guardCost ) )
+                .reduceLeft( (left, right) => if isAnd then Guard.AndGuard( left, right ) else Guard.OrGuard( left, right ) )
+        guard match
+            case Guard.AndGuard( _, _ ) => ordered( guard, true )
+            case Guard.OrGuard( _, _ ) => ordered( guard, false )
+            case Guard.NotGuard( operand ) => Guard.NotGuard( costOrdered( operand ) )
+            case Guard.ImpliesGuard( left, right ) => Guard.ImpliesGuard( costOrdered( left ), costOrdered( right ) )
+            case _ => guard
+
     def generateGuardExpression( guard : Guard, stateChart : StateChart, sourceNode : Node ) : Unit = {
         out.endLine
         out.indent
-        out.putLine( s"(${logGuardStartMacro}( \"${guard.toString()}\")," )
-        gge( guard )
-        out.put(")")
+        if generationOptions.binaryTrace then
+            out.putLine( s"(${traceRecordMacro}( TRACE_GUARD_START, ${symbols( stateChart ).guardId( guard )} )," )
+        else
+            out.putLine( s"(${logGuardStartMacro}( \"${guard.toString()}\")," )
+        lazy val counter = s"&${profileGuardTable}[ ${symbols( stateChart ).guardId( guard )} ]"
+        if generationOptions.profile then
+            out.putLine( s"profileStart( $counter ), profileGuardDone( $counter," )
+        // Reordering the operands of ands and ors keeps the guard's meaning; the check is a safeguard.
+        val reordered = costOrdered( guard )
+        if reordered == guard || Satisfaction.entails( logger, guard, reordered ) && Satisfaction.entails( logger, reordered, guard ) then
+            if reordered != guard then logger.debug( s"Guard $guard is evaluated as $reordered" )
+            gge( reordered )
+        else
+            logger.never( s"Internal error: reordering guard $guard changed its meaning" )
+            gge( guard )
+        out.put( if generationOptions.profile then "))" else ")" )
         out.dedent
         out.endLine
 
@@ -635,9 +1605,16 @@ class Backend( val logger : Logger, val out : COutputter, val generationOptions
                         out.put( s"${okMacro}( $statusVarName )" )
                 case Guard.InGuard( name : String ) => 
                     // TODO. Bug! What if the name was changed!
-                    out.put( s"${isInArrayName}[ ${globalMacro(name, stateChart)} ]" )
+                    val stateOpt = stateChart.stateNamed( name )
+                    assert( stateOpt.nonEmpty )
+                    out.put( isInRead( stateOpt.get, stateChart ) )
                 case Guard.NamedGuard( name : String ) =>
-                    out.put( s"$guardMacro($name)( ${eventPointerName}, ${statusVarName} )" ) 
+                    val call = s"$guardMacro($name)( ${contextArg}${eventPointerName}, ${statusVarName} )"
+                    if memoisedGuards( stateChart ).contains( name ) then
+                        val i = pureMacro( name )
+                        out.put( s"( ${bitRead( guardKnownArrayName, i )} ? ${bitRead( guardValueArrayName, i )} : rememberGuard( ${contextArg}$i, $call ) )" )
+                    else
+                        out.put( call )
                 case Guard.RawGuard( rawCCode : String ) =>
                     out.put(s"( $rawCCode )")
                 case Guard.NotGuard( operand : Guard ) =>
@@ -694,23 +1671,397 @@ class Backend( val logger : Logger, val out : COutputter, val generationOptions
         }
     }
 
-    def generateActionCode( action : Action ) : Unit = {
+    def generateActionCode( action : Action, stateChart : StateChart ) : Unit = {
         out.comment( s"Code for action $action." ) ; out.endLine
+        lazy val id = symbols( stateChart ).actionId( action )
+        def profileCall( function : String ) : Unit =
+            if generationOptions.profile then out.putLine( s"$function( &${profileActionTable}[ $id ] ) ;" )
         action match 
             case Action.NamedAction( name : String ) =>
-                out.putLine( s"${logActionStartMacro}( \"${name}\")" )
-                out.putLine( s"${statusVarName} = $actionMacro($name)( ${eventPointerName}, $statusVarName ) ;" )
-                out.putLine( s"${logActionDoneMacro}( \"${name}\")" )
+                out.putLine( traceStatement( s"${logActionStartMacro}( \"${name}\")", "TRACE_ACTION_START", id ) )
+                profileCall( "profileStart" )
+                out.putLine( s"${statusVarName} = $actionMacro($name)( ${contextArg}${eventPointerName}, $statusVarName ) ;" )
+                profileCall( "profileDone" )
+                out.putLine( traceStatement( s"${logActionDoneMacro}( \"${name}\")", "TRACE_ACTION_DONE", id ) )
             case Action.RawAction( rawCCode : String ) =>
                 val cString = out.stringify( s"{ ${rawCCode} ; }" )
-                out.putLine( s"${logActionStartMacro}({ $cString })" ) 
+                out.putLine( traceStatement( s"${logActionStartMacro}({ $cString })", "TRACE_ACTION_START", id ) )
+                profileCall( "profileStart" )
                 out.putLine( s"{ ${rawCCode} ; }" )
-                out.putLine( s"${logActionDoneMacro}({ $cString })" ) 
+                profileCall( "profileDone" )
+                out.putLine( traceStatement( s"${logActionDoneMacro}({ $cString })", "TRACE_ACTION_DONE", id ) )
     }
 
+    // Shared submachines.
+    // With --shared-submachines, the instances of a submachine that is used more than once
+    // share the enter and exit functions of the states below their top states, and the code
+    // that dispatches events to those states. The shared code is generated from instance 0 and
+    // is given the number of an instance, from which it finds the global indices of that
+    // instance's states. See SharedSubmachines.
+
+    protected def sharedSubmachines : Seq[SharedSubmachines.Shared] = sharingOpt.map( _.shared ).getOrElse( Seq() )
+
+    // While the shared code of a submachine is being generated, this is the submachine.
+    // Instance 0's nodes then stand for those of the instance given by the instance parameter.
+    // Each thread has its own, and inParallel passes it on to the threads it renders on.
+    private val sharingScopeOfThread = ThreadLocal.withInitial[Option[SharedSubmachines.Shared]]( () => None )
+
+    protected def sharingScope : Option[SharedSubmachines.Shared] = sharingScopeOfThread.get
+
+    protected def inSharingScope( shared : SharedSubmachines.Shared )( body : => Unit ) : Unit =
+        withSharingScope( Some( shared ) )( body )
+
+    protected def withSharingScope( scope : Option[SharedSubmachines.Shared] )( body : => Unit ) : Unit =
+        val outer = sharingScopeOfThread.get
+        sharingScopeOfThread.set( scope )
+        try body
+        finally sharingScopeOfThread.set( outer )
+
+    // For a state whose code is shared: the submachine, the instance, and instance 0's state.
+    protected def sharedPlace( state : Node ) : Option[(SharedSubmachines.Shared, Int, Node)] =
+        sharingOpt.filter( _.isShared( state ) ).flatMap( _.placeOf( state ) )
+
+    // For the top state of a shared instance: the submachine and the instance.
+    protected def sharedTopOf( state : Node ) : Option[(SharedSubmachines.Shared, Int)] =
+        sharingOpt.flatMap( _.placeOf( state ) ).collect{ case (shared, instance, member) if member eq shared.top => (shared, instance) }
+
+    // A call to a shared enter or exit function names its instance: the instance parameter
+    // in shared code, and a constant elsewhere.
+    protected def instanceArg( state : Node ) : String =
+        sharedPlace( state ) match
+            case Some( (shared, instance, _) ) =>
+                if sharingScope.exists( _ eq shared ) then "instance, " else s"$instance, "
+            case None => ""
+
+    protected def instanceParam( state : Node ) : String =
+        if sharedPlace( state ).nonEmpty then "int instance, " else ""
+
+    // The states of a shared submachine are traced with their names in the submachine.
+    protected def traceName( state : Node ) : String =
+        sharedPlace( state ).map( (shared, _, member) => shared.localName( member ) ).getOrElse( state.getFullName )
+
+    protected def sharedOrMacro( shared : SharedSubmachines.Shared ) : String = s"SHARED_OR_G_INDEX_${shared.cName}"
+
+    protected def sharedMacro( shared : SharedSubmachines.Shared ) : String = s"SHARED_G_INDEX_${shared.cName}"
+
+    protected def sharedDispatchName( shared : SharedSubmachines.Shared ) : String = s"dispatchShared_${shared.cName}"
+
+    protected def sharedExitsName( shared : SharedSubmachines.Shared ) : String = s"leaveShared_${shared.cName}"
+
+    // Passes the event to the children of the top state of an instance, through the shared
+    // code. The shared code marks the states that changed up to the top state; the states
+    // above it are marked here.
+    def generateSharedDispatchCall( state : Node, shared : SharedSubmachines.Shared, instance : Int, stateChart : StateChart ) : Unit =
+        out.ifComm( s"${sharedDispatchName(shared)}( ${contextArg}$instance, $eventPointerName, $eventClassVarName, $now${changedOnlyArg( changedOnlyVarName )} )" ) {
+            out.putLine( s"${handledFlag(state)} = ${trueConst} ;" )
+            var changed = state
+            while settlesChangedOnly && changed != stateChart.root do
+                changed = stateChart.parentOf( changed )
+                out.putLine( s"${stateData(changedAtArrayName)}[ ${globalMacro(changed)} ] = ${stateData(currentStepName)} ;" )
+            end while
+        }
+        out.endLine
+
+    def generateSharedDispatch( shared : SharedSubmachines.Shared, stateChart : StateChart ) : Unit =
+        inSharingScope( shared ) {
+            out.blankLine
+            out.comment( s"Passes an event to the states of an instance of submachine ${shared.name}. Returns whether a transition was taken." )
+            out.endLine
+            out.comment( s"The code is written in terms of instance 0, ${shared.top.getCName}, and works on the given instance." )
+            out.endLine
+            out.put( s"static ${boolType} ${sharedDispatchName(shared)}( ${contextParam}int instance, ${eventType} *${eventPointerName}, $eventClassType $eventClassVarName, $timeType $now${changedOnlyParam} ) " )
+            out.block{
+                declareHandledFlag( shared.top )
+                generateCodeForChildren( shared.top, stateChart )
+                out.endLine
+                out.put( s"return ${handledFlag(shared.top)} ;" )
+            }
+        }
+
+    // The transitions that leave the instances of a submachine from its choices, which differ
+    // from one instance to the next. The choice is given by its position in the submachine.
+    def generateSharedExits( shared : SharedSubmachines.Shared, stateChart : StateChart ) : Unit =
+        if shared.wired.nonEmpty then
+            out.blankLine
+            out.comment( s"Takes the transitions that leave an instance of submachine ${shared.name} from one of its choices." )
+            out.endLine
+            out.put( s"static void ${sharedExitsName(shared)}( ${contextParam}int instance, int choice, ${eventType} *${eventPointerName}, $statusType $statusVarName, $timeType $now ) " )
+            out.block{
+                out.switchComm( true, "instance" ) {
+                    for (instance, k) <- shared.instances.zipWithIndex do
+                        out.caseComm( k.toString ) {
+                            out.switchComm( true, "choice" ) {
+                                for position <- shared.wired do
+                                    val choice = instance( position )
+                                    out.caseComm( position.toString ) {
+                                        generateIfsForEdges( None, choice, stateChart.edgesFrom( choice ), stateChart )
+                                    }
+                                end for
+                            }
+                        }
+                    end for
+                }
+            }
+        end if
+
+    // What sharing the code of submachines saves, found by generating the code both ways.
+    // The sizes are of the C source; measure the code itself with the size command.
+    def sharingReport( stateChart : StateChart, cogentVersion : String ) : Seq[String] =
+        def render( sharing : Option[SharedSubmachines] ) : String =
+            val text = java.io.StringWriter()
+            val cout = COutputter( java.io.PrintWriter( text ) )
+            Backend( BufferedLogger( Logger.Level.Fatal ), cout, generationOptions, None, sharing )
+                .generateCCode( stateChart, chartName, cogentVersion )
+            cout.close
+            text.toString
+        val shared = render( sharingOpt )
+        val unshared = render( None )
+        def functions( code : String ) : Int = "(?m)^static void (enter|exit)".r.findAllIn( code ).size
+        Seq( s"Generated code: ${shared.linesIterator.size} lines and ${shared.length} characters" +
+             s" (${unshared.linesIterator.size} lines and ${unshared.length} characters without sharing)",
+             s"Enter and exit functions: ${functions( shared )} (${functions( unshared )} without sharing)" ) ++
+        sharedSubmachines.map( shared =>
+            s"    ${shared.name}: ${shared.tops.size} instances share ${shared.members.count( _.isState ) - 1} states" ) ++
+        Seq( "Measure the object code with the size command" )
+
+    // Tracing.
+    // By default the generated code calls the LOG_ macros with strings. With --trace=binary,
+    // each of those calls is instead a TRACE_RECORD of a kind and a number from the symbol
+    // map, and taking a transition is recorded too.
+
+    protected var symbolMapOpt : Option[SymbolMap] = None
+
+    def symbols( stateChart : StateChart ) : SymbolMap = synchronized {
+        symbolMapOpt match
+            case Some( map ) => map
+            case None =>
+                val map = SymbolMap( chartName, stateChart )
+                symbolMapOpt = Some( map )
+                map
+    }
+
+    def traceStatement( logStatement : String, kind : String, id : => Int ) : String =
+        if generationOptions.binaryTrace then s"${traceRecordMacro}( $kind, $id ) ;"
+        else logStatement
+
+    def generateTransitionStart( edge : Edge, stateChart : StateChart ) : Unit =
+        if generationOptions.binaryTrace then
+            out.putLine( s"${traceRecordMacro}( TRACE_EDGE, ${symbols( stateChart ).edgeId( edge )} ) ;" )
+        if generationOptions.profile then
+            out.putLine( s"profileStart( &${profileEdgeTable}[ ${symbols( stateChart ).edgeId( edge )} ] ) ;" )
+
+    def generateTransitionDone( edge : Edge, stateChart : StateChart ) : Unit =
+        if generationOptions.profile then
+            out.endLine
+            out.putLine( s"profileDone( &${profileEdgeTable}[ ${symbols( stateChart ).edgeId( edge )} ] ) ;" )
+
+    def traceDumpPrototype : String =
+        s"void traceDump_${chartName}( void (*write_p)( const unsigned char *bytes, int count, void *arg ), void *arg )"
+
+    // The ring buffer that records go to, and a function that writes it out for the decoder.
+    def generateTraceSupport( stateChart : StateChart ) : Unit =
+        if generationOptions.binaryTrace then
+            val ring = s"traceRing_${chartName}"
+            out.comment( "Binary tracing. Each traced event is an 8 byte record in a ring buffer." )
+            out.endLine
+            out.putLines( s"""|#include <stdint.h>
+                              |
+                              |/* The number of records kept. It must be a power of 2. */
+                              |#ifndef TRACE_CAPACITY
+                              |    #define TRACE_CAPACITY 256
+                              |#endif
+                              |#if ( TRACE_CAPACITY & ( TRACE_CAPACITY - 1 ) ) != 0
+                              |    #error "TRACE_CAPACITY must be a power of 2"
+                              |#endif
+                              |
+                              |/* The time stamp of a record, e.g. a cycle counter. */
+                              |#ifndef TRACE_TIME
+                              |    #define TRACE_TIME() 0
+                              |#endif
+                              |
+                              |/* A number for the machine that makes a record, e.g. one computed from ctx. */
+                              |#ifndef TRACE_MACHINE
+                              |    #define TRACE_MACHINE() 0
+                              |#endif
+                              |
+                              |/* Claiming a slot. Without C11 atomics, or with one thread, define these in the preamble. */
+                              |#ifndef TRACE_COUNTER_T
+                              |    #include <stdatomic.h>
+                              |    #define TRACE_COUNTER_T atomic_uint
+                              |    #define TRACE_CLAIM(p) atomic_fetch_add_explicit( (p), 1u, memory_order_relaxed )
+                              |    #define TRACE_LOAD(p) atomic_load_explicit( (p), memory_order_relaxed )
+                              |#endif
+                              |
+                              |#define TRACE_ENTER_STATE 1
+                              |#define TRACE_EXIT_STATE 2
+                              |#define TRACE_GUARD_START 3
+                              |#define TRACE_GUARD_TRUE 4
+                              |#define TRACE_ACTION_START 5
+                              |#define TRACE_ACTION_DONE 6
+                              |#define TRACE_EDGE 7
+                              |
+                              |/* Identifies the symbol map written with this file. */
+                              |#define TRACE_SYMBOLS_HASH 0x${symbols( stateChart ).hash.toHexString}u
+                              |
+                              |typedef struct {
+                              |    uint32_t time ;
+                              |    uint8_t kind ;
+                              |    uint8_t machine ;
+                              |    uint16_t id ;
+                              |} trace_record_t ;
+                              |
+                              |/* Not static, so that a debugger can find it. */
+                              |struct {
+                              |    TRACE_COUNTER_T next ;
+                              |    trace_record_t records_a[ TRACE_CAPACITY ] ;
+                              |} $ring ;
+                              |
+                              |/* A preamble that defines $traceRecordMacro itself does not need traceRecord. */
+                              |#ifndef $traceRecordMacro
+                              |    static void traceRecord( unsigned kind, unsigned id, unsigned machine ) {
+                              |        trace_record_t *record_p = &$ring.records_a[ TRACE_CLAIM( &$ring.next ) & ( TRACE_CAPACITY - 1u ) ] ;
+                              |        record_p->time = (uint32_t) TRACE_TIME() ;
+                              |        record_p->kind = (uint8_t) kind ;
+                              |        record_p->machine = (uint8_t) machine ;
+                              |        record_p->id = (uint16_t) id ;
+                              |    }
+                              |
+                              |    #define $traceRecordMacro(kind, id) traceRecord( (kind), (id), TRACE_MACHINE() )
+                              |#endif
+                              |
+                              |static void traceLittleEndian( unsigned char *bytes, uint32_t value, int count ) {
+                              |    int i ;
+                              |    for( i = 0 ; i < count ; ++i ) bytes[ i ] = (unsigned char)( value >> ( 8 * i ) ) ;
+                              |}
+                              |
+                              |/* Writes the records, oldest first, in the format that cogent --decode-trace reads:
+                              | * "CGTR", the symbol map hash and the number of records, then 8 bytes per record:
+                              | * time, kind, machine and id. Numbers are little-endian. */
+                              |$traceDumpPrototype {
+                              |    unsigned next = TRACE_LOAD( &$ring.next ) ;
+                              |    unsigned count = next < TRACE_CAPACITY ? next : TRACE_CAPACITY ;
+                              |    unsigned i ;
+                              |    unsigned char header[ 12 ] = { 'C', 'G', 'T', 'R' } ;
+                              |    traceLittleEndian( header + 4, TRACE_SYMBOLS_HASH, 4 ) ;
+                              |    traceLittleEndian( header + 8, count, 4 ) ;
+                              |    write_p( header, 12, arg ) ;
+                              |    for( i = next - count ; i != next ; ++i ) {
+                              |        const trace_record_t *record_p = &$ring.records_a[ i & ( TRACE_CAPACITY - 1u ) ] ;
+                              |        unsigned char bytes[ 8 ] ;
+                              |        traceLittleEndian( bytes, record_p->time, 4 ) ;
+                              |        bytes[ 4 ] = record_p->kind ;
+                              |        bytes[ 5 ] = record_p->machine ;
+                              |        traceLittleEndian( bytes + 6, record_p->id, 2 ) ;
+                              |        write_p( bytes, 8, arg ) ;
+                              |    }
+                              |}""".stripMargin )
+            out.blankLine
+        end if
+
+    // Profiling.
+    // With --profile, each transition, guard and action has a counter in a table indexed
+    // by its number in the symbol map. The counter counts how often it ran (and, for guards,
+    // how often they were true) and adds up the time it took, measured with PROFILE_CLOCK().
+    // Transitions are timed from exiting the source to entering the target, so their
+    // time includes that of their actions and of any transitions out of choice pseudostates.
+
+    protected val profileEdgeTable = "profileEdges_a"
+    protected val profileGuardTable = "profileGuards_a"
+    protected val profileActionTable = "profileActions_a"
+
+    def profileDumpPrototype : String =
+        s"void profileDump_${chartName}( void (*write_p)( const unsigned char *bytes, int count, void *arg ), void *arg )"
+
+    def generateProfileSupport( stateChart : StateChart ) : Unit =
+        if generationOptions.profile then
+            val map = symbols( stateChart )
+            // C does not allow empty arrays.
+            def size( n : Int ) = Math.max( n, 1 )
+            out.comment( "Profiling counters, one per transition, guard and action in the symbol map." )
+            out.endLine
+            out.putLines( s"""|#include <stdint.h>
+                              |
+                              |/* A clock for timing, e.g. a cycle counter. With the default, only counts are kept. */
+                              |#ifndef PROFILE_CLOCK
+                              |    #define PROFILE_CLOCK() 0
+                              |#endif
+                              |#ifndef PROFILE_TIME_T
+                              |    #define PROFILE_TIME_T unsigned long
+                              |#endif
+                              |
+                              |/* Identifies the symbol map written with this file. */
+                              |#define PROFILE_SYMBOLS_HASH 0x${map.hash.toHexString}u
+                              |#define PROFILE_EDGE_COUNT ${map.edges.size}
+                              |#define PROFILE_GUARD_COUNT ${map.guards.size}
+                              |#define PROFILE_ACTION_COUNT ${map.actions.size}
+                              |
+                              |typedef struct {
+                              |    PROFILE_TIME_T started ;
+                              |    uint64_t count ;
+                              |    uint64_t trues ;    /* Only for guards */
+                              |    uint64_t time ;
+                              |} profile_counter_t ;
+                              |
+                              |/* The counters are not atomic, so with several threads the results are approximate. */
+                              |static profile_counter_t $profileEdgeTable[ ${size( map.edges.size )} ] ;
+                              |static profile_counter_t $profileGuardTable[ ${size( map.guards.size )} ] ;
+                              |static profile_counter_t $profileActionTable[ ${size( map.actions.size )} ] ;
+                              |
+                              |static void profileStart( profile_counter_t *counter_p ) {
+                              |    counter_p->started = PROFILE_CLOCK() ;
+                              |}
+                              |
+                              |static void profileDone( profile_counter_t *counter_p ) {
+                              |    counter_p->count += 1 ;
+                              |    counter_p->time += (PROFILE_TIME_T)( PROFILE_CLOCK() - counter_p->started ) ;
+                              |}
+                              |
+                              |static $boolType profileGuardDone( profile_counter_t *counter_p, $boolType result ) {
+                              |    profileDone( counter_p ) ;
+                              |    if( result ) counter_p->trues += 1 ;
+                              |    return result ;
+                              |}
+                              |
+                              |static void profileWriteTable( void (*write_p)( const unsigned char *bytes, int count, void *arg ), void *arg,
+                              |                               const profile_counter_t *table, int count ) {
+                              |    int i, j ;
+                              |    for( i = 0 ; i < count ; ++i ) {
+                              |        uint64_t values[ 3 ] ;
+                              |        unsigned char bytes[ 24 ] ;
+                              |        values[ 0 ] = table[ i ].count ;
+                              |        values[ 1 ] = table[ i ].trues ;
+                              |        values[ 2 ] = table[ i ].time ;
+                              |        for( j = 0 ; j < 24 ; ++j ) bytes[ j ] = (unsigned char)( values[ j / 8 ] >> ( 8 * ( j % 8 ) ) ) ;
+                              |        write_p( bytes, 24, arg ) ;
+                              |    }
+                              |}
+                              |
+                              |/* Writes the counters in the format that cogent --profile-report reads: "CGPF", the
+                              | * symbol map hash and the numbers of transitions, guards and actions as 32-bit numbers,
+                              | * then count, trues and time as 64-bit numbers for each. Numbers are little-endian. */
+                              |$profileDumpPrototype {
+                              |    uint32_t header[ 4 ] = { PROFILE_SYMBOLS_HASH, PROFILE_EDGE_COUNT, PROFILE_GUARD_COUNT, PROFILE_ACTION_COUNT } ;
+                              |    unsigned char bytes[ 20 ] = { 'C', 'G', 'P', 'F' } ;
+                              |    int j ;
+                              |    for( j = 4 ; j < 20 ; ++j ) bytes[ j ] = (unsigned char)( header[ ( j - 4 ) / 4 ] >> ( 8 * ( j % 4 ) ) ) ;
+                              |    write_p( bytes, 20, arg ) ;
+                              |    profileWriteTable( write_p, arg, $profileEdgeTable, PROFILE_EDGE_COUNT ) ;
+                              |    profileWriteTable( write_p, arg, $profileGuardTable, PROFILE_GUARD_COUNT ) ;
+                              |    profileWriteTable( write_p, arg, $profileActionTable, PROFILE_ACTION_COUNT ) ;
+                              |}
+                              |
+                              |/* Sets all the counters to zero. */
+                              |void profileReset_${chartName}( void ) {
+                              |    int i ;
+                              |    for( i = 0 ; i < ${size( map.edges.size )} ; ++i ) { $profileEdgeTable[ i ].count = $profileEdgeTable[ i ].trues = $profileEdgeTable[ i ].time = 0 ; }
+                              |    for( i = 0 ; i < ${size( map.guards.size )} ; ++i ) { $profileGuardTable[ i ].count = $profileGuardTable[ i ].trues = $profileGuardTable[ i ].time = 0 ; }
+                              |    for( i = 0 ; i < ${size( map.actions.size )} ; ++i ) { $profileActionTable[ i ].count = $profileActionTable[ i ].trues = $profileActionTable[ i ].time = 0 ; }
+                              |}""".stripMargin )
+            out.blankLine
+        end if
+
     def needCodeForEvents( state : Node, stateChart : StateChart ) : Boolean = { 
-        val edges = stateChart.edges.filter( e => e.source == state )
-        return !(edges.isEmpty)
+        return stateChart.edgesFrom( state ).nonEmpty
     }
 
     def startChild( state : Node.OrState ) : Node = {
@@ -719,13 +2070,31 @@ class Backend( val logger : Logger, val out : COutputter, val generationOptions
         opt.get
     }
 
+    // Renders independent pieces of code, one per item, in the order of the items. When the
+    // logger can hold back messages, the pieces are rendered on several threads, in the
+    // sharing scope of this one, and their messages are logged in the order of the items
+    // once all are done.
+    protected def inParallel[A]( items : Seq[A] )( render : A => Unit ) : Unit =
+        logger match
+            case holder : HoldingLogger =>
+                val scope = sharingScope
+                val messages = Array.fill( items.size )( Seq[(Logger.Level, String)]() )
+                out.inParts( items.indices ){ i =>
+                    messages( i ) = holder.holding( withSharingScope( scope )( render( items( i ) ) ) ) }
+                messages.foreach( holder.release )
+            case _ =>
+                items.foreach( render )
+
     def globalMacro( node : Node ) : String = {
         assert( node.isState )
-        ("G_INDEX_" + node.getCName )
+        sharingScope.filter( shared => sharingOpt.get.placeOf( node ).exists( (s, k, _) => ( s eq shared ) && k == 0 ) ) match
+            case Some( shared ) =>
+                s"${if node.isOrState then sharedOrMacro( shared ) else sharedMacro( shared )}( instance, ${shared.offsetOf( node )} )"
+            case None => ("G_INDEX_" + node.getCName )
     }
 
     def globalMacro( name : String, stateChart : StateChart ) : String = {
-        assert( stateChart.nodes.exists( n => n.getCName == name && n.isState ) )
+        assert( stateChart.stateNamed( name ).nonEmpty )
         ("G_INDEX_" + name )
     }
 
@@ -735,12 +2104,51 @@ class Backend( val logger : Logger, val out : COutputter, val generationOptions
 
     def exitFunctionName( node : Node ) : String = {
         assert( node.isState )
-        ("exit_" + node.getCName )
+        sharedPlace( node ) match
+            case Some( (shared, _, member) ) => "exitShared_" + shared.localName( member )
+            case None => ("exit_" + node.getCName )
     }
 
     def enterFunctionName( node : Node ) : String = {
         assert( node.isState )
-        ("enter_" + node.getCName )
+        sharedPlace( node ) match
+            case Some( (shared, _, member) ) => "enterShared_" + shared.localName( member )
+            case None => ("enter_" + node.getCName )
     }
 
-end Backend
\ No newline at end of file
+    // In context mode all per-machine state is reached through the context pointer.
+    protected def stateData( arrayName : String ) : String =
+        if generationOptions.contextStruct then s"$contextPointerName->$arrayName" else arrayName
+
+    protected def contextTypeName : String = s"${chartName}_ctx_t"
+
+    // Declares the context pointer as a leading parameter, in context mode.
+    protected def contextParam : String =
+        if generationOptions.contextStruct then s"$contextTypeName *$contextPointerName, " else ""
+
+    // Passes the context pointer as a leading argument, in context mode.
+    protected def contextArg : String =
+        if generationOptions.contextStruct then s"$contextPointerName, " else ""
+
+end Backend
+
+object Backend :
+    // The edges leaving a vertex on one trigger, as classified by classifyEdges.
+    // Either there is exactly one unguarded edge, or there are guarded edges and
+    // perhaps an else edge.
+    case class EdgeGroup( unguarded : Option[Edge], conditional : Seq[Edge], elseEdge : Option[Edge] )
+
+    // Makes the back end for the style of code chosen in the options.
+    // A flattened chart, if there is one, is compiled to a flat state machine.
+    // Its messages go through a HoldingLogger, so that parts of the code can be rendered in parallel.
+    // The instances of the submachines in sharingOpt share code.
+    def apply( logger0 : Logger, out : COutputter, generationOptions : GenerationOptions,
+               flatChartOpt : Option[FlatChart] = None, sharingOpt : Option[SharedSubmachines] = None ) : Backend =
+        val logger = logger0 match
+            case holder : HoldingLogger => holder
+            case _ => HoldingLogger( logger0 )
+        if generationOptions.tableStyle then new TableBackend( logger, out, generationOptions )
+        else flatChartOpt match
+            case Some( flatChart ) => new FlatBackend( logger, out, generationOptions, flatChart )
+            case None => new Backend( logger, out, generationOptions, sharingOpt )
+end Backend
@@ -0,0 +1,101 @@
+package cogent
+
+import scala.collection.mutable
+
+// A reduced ordered binary decision diagram package. Nodes are hash-consed, so two
+// guards are equivalent exactly when they translate to the same node, and the
+// results of operations are cached, so a guard that is asked about again, or that
+// shares parts with earlier guards, costs little more than a table lookup.
+//
+// A node is an Int: 0 is false, 1 is true and any other number is an index into the
+// node tables. Variables are numbered in the order their atoms are first seen, and
+// smaller numbers are nearer the root.
+class Bdd :
+    import Bdd.{FALSE, TRUE}
+
+    private val variable = mutable.ArrayBuffer[Int]( Int.MaxValue, Int.MaxValue )
+    private val low = mutable.ArrayBuffer[Int]( FALSE, TRUE )
+    private val high = mutable.ArrayBuffer[Int]( FALSE, TRUE )
+
+    private val unique = mutable.HashMap[(Int, Int, Int), Int]()
+    private val andCache = mutable.HashMap[(Int, Int), Int]()
+    private val orCache = mutable.HashMap[(Int, Int), Int]()
+    private val notCache = mutable.HashMap[Int, Int]()
+
+    private val atomVariables = mutable.HashMap[Guard, Int]()
+    private val guardCache = mutable.HashMap[Guard, Int]()
+
+    def size : Int = variable.size
+
+    private def make( v : Int, lo : Int, hi : Int ) : Int =
+        if lo == hi then lo
+        else unique.getOrElseUpdate( (v, lo, hi), {
+            variable += v ; low += lo ; high += hi
+            variable.size - 1 } )
+
+    def atom( guard : Guard ) : Int =
+        make( atomVariables.getOrElseUpdate( guard, atomVariables.size ), FALSE, TRUE )
+
+    def not( u : Int ) : Int =
+        if u == FALSE then TRUE
+        else if u == TRUE then FALSE
+        else notCache.getOrElseUpdate( u, make( variable(u), not( low(u) ), not( high(u) ) ) )
+
+    def and( u : Int, w : Int ) : Int =
+        if u == FALSE || w == FALSE then FALSE
+        else if u == TRUE then w
+        else if w == TRUE || u == w then u
+        else
+            // And is commutative, so one entry serves both orders.
+            val key = if u < w then (u, w) else (w, u)
+            andCache.getOrElseUpdate( key, expand( u, w, and ) )
+
+    def or( u : Int, w : Int ) : Int =
+        if u == TRUE || w == TRUE then TRUE
+        else if u == FALSE then w
+        else if w == FALSE || u == w then u
+        else
+            val key = if u < w then (u, w) else (w, u)
+            orCache.getOrElseUpdate( key, expand( u, w, or ) )
+
+    // Shannon expansion on whichever of the two top variables comes first.
+    private def expand( u : Int, w : Int, op : (Int, Int) => Int ) : Int =
+        val vu = variable(u)
+        val vw = variable(w)
+        if vu == vw then make( vu, op( low(u), low(w) ), op( high(u), high(w) ) )
+        else if vu < vw then make( vu, op( low(u), w ), op( high(u), w ) )
+        else make( vw, op( u, low(w) ), op( u, high(w) ) )
+
+    // The node for a guard. An else guard has no meaning on its own; it is reported
+    // each time it is met and taken as false, so guards that contain one are not cached.
+    def of( logger : Logger, guard : Guard ) : Int =
+        var sawElse = false
+        def build( g : Guard ) : Int =
+            g match
+                case Guard.ElseGuard() =>
+                    logger.never( "Internal error: else guard in tautology checking")
+                    sawElse = true
+                    FALSE
+                case _ =>
+                    guardCache.get( g ) match
+                        case Some( u ) => u
+                        case None =>
+                            val before = sawElse
+                            sawElse = false
+                            val u = g match
+                                case Guard.NotGuard( operand ) => not( build( operand ) )
+                                case Guard.AndGuard( left, right ) => and( build( left ), build( right ) )
+                                case Guard.OrGuard( left, right ) => or( build( left ), build( right ) )
+                                case Guard.ImpliesGuard( left, right ) => or( not( build( left ) ), build( right ) )
+                                case _ => atom( g )
+                            if ! sawElse then guardCache( g ) = u
+                            sawElse = sawElse || before
+                            u
+        build( guard )
+
+end Bdd
+
+object Bdd :
+    val FALSE = 0
+    val TRUE = 1
+end Bdd
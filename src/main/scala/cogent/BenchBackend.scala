@@ -0,0 +1,208 @@
+package cogent
+
+// Generates the optional file chartName_bench.c, a standalone program that measures
+// how long dispatching takes in the generated code. It includes the generated C file
+// with every named guard and action replaced by a stub: guards are driven by a seeded
+// random number generator, or by a fixed pattern, and actions do nothing.
+//
+// The program takes a random walk. At each step it either dispatches an event of a
+// class that some active state has a transition on, or advances the time and
+// dispatches a TICK. It reports percentiles of the time per dispatch (including
+// settling), the number of micro-steps that fired transitions per second, and the
+// largest number of such micro-steps for one dispatch.
+class BenchBackend( override val logger : Logger, override val out : COutputter, override val generationOptions : GenerationOptions )
+    extends Backend( logger, out, generationOptions ) :
+
+    def benchFileName : String = s"${chartName}_bench.c"
+
+    def generateBench( stateChart : StateChart, chartName : String, cogentVersion : String, codeFileName : String ) : Unit = {
+        this.chartName = chartName
+        val guardNames = stateChart.edges.flatMap( _.guardOpt ).flatMap( _.namedGuards ).distinct
+        val actionNames = stateChart.edges.flatMap( _.actions ).collect{ case Action.NamedAction( name ) => name }.distinct
+        val classNames = stateChart.edges.flatMap( _.triggerOpt ).collect{ case Trigger.NamedTrigger( name ) => name }.distinct.sorted
+        val classIndex = classNames.zipWithIndex.toMap
+        val longestAfter = stateChart.edges.flatMap( _.triggerOpt ).flatMap( _.asAfterTrigger )
+                                           .map( t => roundedDuration( t.durationInMilliseconds ) ).maxOption
+        val ctxA = if generationOptions.contextStruct then "&benchCtx, " else ""
+        val stubParams = if generationOptions.contextStruct then "c, e, s" else "e, s"
+
+        generateComment( cogentVersion )
+        out.putLines( s"""|/* A microbenchmark for the $chartName machine. It includes $codeFileName, with the named
+                          | * guards and actions replaced by stubs, so compile it on its own, e.g.
+                          | *     cc -O2 -I. $benchFileName -o ${chartName}_bench
+                          | * and run it as
+                          | *     ./${chartName}_bench [dispatches [seed [maxP99Nanoseconds]]]
+                          | * It exits with status 1 if the 99th percentile is more than maxP99Nanoseconds. */
+                          |
+                          |#define _POSIX_C_SOURCE 199309L
+                          |#include <stdio.h>
+                          |#include <stdlib.h>
+                          |#include <string.h>
+                          |#include <time.h>
+                          |
+                          |/* Sets the class of the event that the benchmark dispatches. */
+                          |#ifndef BENCH_SET_CLASS
+                          |    #define BENCH_SET_CLASS( event_p, eventClass ) ((event_p)->tag = (eventClass))
+                          |#endif
+                          |/* The time in nanoseconds. */
+                          |#ifndef BENCH_NOW_NS
+                          |    #define BENCH_NOW_NS() benchNowNs()
+                          |#endif
+                          |/* How often, in percent, the walk advances the time and dispatches a TICK. */
+                          |#ifndef BENCH_TICK_PERCENT
+                          |    #define BENCH_TICK_PERCENT 25
+                          |#endif
+                          |/* How often, in percent, a guard is true. Define BENCH_GUARD_PATTERN as a string
+                          | * of '0's and '1's to script the guards instead; each guard cycles through it. */
+                          |#ifndef BENCH_GUARD_PERCENT
+                          |    #define BENCH_GUARD_PERCENT 50
+                          |#endif
+                          |#ifndef BENCH_SETTLE_STEPS
+                          |    #define BENCH_SETTLE_STEPS 16
+                          |#endif
+                          |
+                          |#define BENCH_GUARD_COUNT ${Math.max( guardNames.size, 1 )}
+                          |#define BENCH_CLASS_COUNT ${Math.max( classNames.size, 1 )}
+                          |
+                          |static unsigned long long benchRandomState = 1 ;
+                          |static unsigned long benchActionCount = 0 ;
+                          |static unsigned benchRandom( void ) ;
+                          |static int benchGuard( int id ) ;
+                          |
+                          |/* The stubs. The preamble must not define GUARD or ACTION itself. */
+                          |#define $guardMacro(name) BENCH_GUARD_##name
+                          |#define $actionMacro(name) BENCH_ACTION_##name""".stripMargin )
+        for (name, i) <- guardNames.zipWithIndex do
+            out.putLine( s"#define BENCH_GUARD_$name( $stubParams ) benchGuard( $i )" )
+        for name <- actionNames do
+            out.putLine( s"#define BENCH_ACTION_$name( $stubParams ) ( benchActionCount += 1, (s) )" )
+        out.blankLine
+        out.putLine( s"#include \"$codeFileName\"" )
+        out.blankLine
+        if generationOptions.contextStruct then
+            out.putLine( s"static $contextTypeName benchCtx ;" )
+            out.blankLine
+        end if
+        out.putLine( s"/* The longest 'after' duration, plus one. */" )
+        out.putLine( s"#define BENCH_MAX_ADVANCE ( ${longestAfter.map( d => s"$toDuration($d) + " ).getOrElse( "" )}1 )" )
+        out.blankLine
+        val classes = if classNames.isEmpty then "TICK" else classNames.map( c => s"$eventMacro($c)" ).mkString( ", " )
+        out.putLine( s"static const $eventClassType benchClasses_a[ BENCH_CLASS_COUNT ] = { $classes } ;" )
+        out.blankLine
+
+        out.comment( "Lists the classes of the events that some active state has a transition on." )
+        out.endLine
+        out.put( "static int benchEnabled( int *enabled_a ) " )
+        out.block{
+            out.putLine( "int n = 0 ;" )
+            if generationOptions.contextStruct then
+                out.putLine( s"$contextTypeName *$contextPointerName = &benchCtx ;" )
+            out.putLine( "unsigned char seen_a[ BENCH_CLASS_COUNT ] ;" )
+            out.putLine( "memset( seen_a, 0, sizeof seen_a ) ;" )
+            out.putLine( "#define BENCH_ENABLE( c ) do { if( ! seen_a[ c ] ) { seen_a[ c ] = 1 ; enabled_a[ n++ ] = c ; } } while( 0 )" )
+            val states = stateChart.nodes.filter( _.isState ).toSeq.sortBy( _.getGlobalIndex )
+            for state <- states do
+                val triggers = stateChart.edgesFrom( state ).flatMap( _.triggerOpt )
+                                               .collect{ case Trigger.NamedTrigger( name ) => classIndex( name ) }.distinct.sorted
+                if triggers.nonEmpty then
+                    out.putLine( s"if( ${activeTest( state, stateChart )} ) { ${triggers.map( c => s"BENCH_ENABLE( $c ) ;" ).mkString( " " )} }" )
+            end for
+            out.putLine( "#undef BENCH_ENABLE" )
+            out.put( "return n ;" )
+        }
+        out.blankLine
+
+        out.putLines( s"""|static unsigned benchRandom( void ) {
+                          |    /* xorshift64* */
+                          |    benchRandomState ^= benchRandomState >> 12 ;
+                          |    benchRandomState ^= benchRandomState << 25 ;
+                          |    benchRandomState ^= benchRandomState >> 27 ;
+                          |    return (unsigned)( ( benchRandomState * 2685821657736338717ull ) >> 32 ) ;
+                          |}
+                          |
+                          |static int benchGuard( int id ) {
+                          |#ifdef BENCH_GUARD_PATTERN
+                          |    static unsigned position_a[ BENCH_GUARD_COUNT ] ;
+                          |    const char *pattern = BENCH_GUARD_PATTERN ;
+                          |    char c = pattern[ position_a[ id ] ] ;
+                          |    position_a[ id ] = pattern[ position_a[ id ] + 1 ] == 0 ? 0 : position_a[ id ] + 1 ;
+                          |    return c == '1' ;
+                          |#else
+                          |    (void)id ;
+                          |    return benchRandom() % 100 < BENCH_GUARD_PERCENT ;
+                          |#endif
+                          |}
+                          |
+                          |static unsigned long long benchNowNs( void ) {
+                          |    struct timespec t ;
+                          |    clock_gettime( CLOCK_MONOTONIC, &t ) ;
+                          |    return (unsigned long long)t.tv_sec * 1000000000ull + (unsigned long long)t.tv_nsec ;
+                          |}
+                          |
+                          |static int benchCompare( const void *a, const void *b ) {
+                          |    unsigned long long x = *(const unsigned long long *)a, y = *(const unsigned long long *)b ;
+                          |    return x < y ? -1 : x > y ? 1 : 0 ;
+                          |}
+                          |
+                          |int main( int argc, char **argv ) {
+                          |    long count = argc > 1 ? atol( argv[ 1 ] ) : 1000000 ;
+                          |    unsigned long long seed = argc > 2 ? strtoull( argv[ 2 ], 0, 10 ) : 1 ;
+                          |    unsigned long long maxP99 = argc > 3 ? strtoull( argv[ 3 ], 0, 10 ) : 0 ;
+                          |    unsigned long long *samples_a ;
+                          |    unsigned long long started, elapsed, p99 ;
+                          |    int enabled_a[ BENCH_CLASS_COUNT ] ;
+                          |    long i, ticks = 0, restarts = 0, steps = 0 ;
+                          |    int depth = 0 ;
+                          |    $eventType event ;
+                          |    $timeType now = 0 ;
+                          |    $timeType deadline ;
+                          |    if( count <= 0 ) count = 1 ;
+                          |    samples_a = malloc( count * sizeof *samples_a ) ;
+                          |    if( ! samples_a ) { fprintf( stderr, "Out of memory\\n" ) ; return 2 ; }
+                          |    benchRandomState = seed ? seed : 1 ;
+                          |    memset( &event, 0, sizeof event ) ;
+                          |    initStateMachine_${chartName}( ${ctxA}now ) ;
+                          |    started = BENCH_NOW_NS() ;
+                          |    for( i = 0 ; i < count ; ++i ) {
+                          |        int n = benchEnabled( enabled_a ) ;
+                          |        int stepsNow = 0 ;
+                          |        unsigned long long t0 ;
+                          |        if( n == 0 || benchRandom() % 100 < BENCH_TICK_PERCENT ) {
+                          |            /* A machine that can never change again is started afresh. */
+                          |            if( n == 0 && ! nextDeadline_${chartName}( ${ctxA}now, &deadline ) ) {
+                          |                initStateMachine_${chartName}( ${ctxA}now ) ;
+                          |                restarts += 1 ;
+                          |            }
+                          |            now += 1 + benchRandom() % BENCH_MAX_ADVANCE ;
+                          |            BENCH_SET_CLASS( &event, TICK ) ;
+                          |            ticks += 1 ;
+                          |        } else {
+                          |            now += 1 ;
+                          |            BENCH_SET_CLASS( &event, benchClasses_a[ enabled_a[ benchRandom() % n ] ] ) ;
+                          |        }
+                          |        t0 = BENCH_NOW_NS() ;
+                          |        dispatchAndSettle_${chartName}( ${ctxA}&event, now, BENCH_SETTLE_STEPS, &stepsNow ) ;
+                          |        samples_a[ i ] = BENCH_NOW_NS() - t0 ;
+                          |        steps += stepsNow ;
+                          |        if( stepsNow > depth ) depth = stepsNow ;
+                          |    }
+                          |    elapsed = BENCH_NOW_NS() - started ;
+                          |    qsort( samples_a, count, sizeof *samples_a, benchCompare ) ;
+                          |    p99 = samples_a[ ( count - 1 ) * 990 / 1000 ] ;
+                          |    printf( "$chartName: %ld dispatches (%ld TICKs, %ld restarts), %lu actions, seed %llu\\n",
+                          |            count, ticks, restarts, benchActionCount, seed ) ;
+                          |    printf( "ns/dispatch: p50 %llu  p90 %llu  p99 %llu  p99.9 %llu  max %llu\\n",
+                          |            samples_a[ ( count - 1 ) * 500 / 1000 ], samples_a[ ( count - 1 ) * 900 / 1000 ], p99,
+                          |            samples_a[ ( count - 1 ) * 999 / 1000 ], samples_a[ count - 1 ] ) ;
+                          |    printf( "transition steps/s: %.0f\\n", elapsed ? 1e9 * steps / elapsed : 0.0 ) ;
+                          |    printf( "max dispatch depth: %d\\n", depth ) ;
+                          |    free( samples_a ) ;
+                          |    if( maxP99 && p99 > maxP99 ) {
+                          |        printf( "FAIL: p99 of %llu ns is over %llu ns\\n", p99, maxP99 ) ;
+                          |        return 1 ;
+                          |    }
+                          |    return 0 ;
+                          |}""".stripMargin )
+    }
+
+end BenchBackend
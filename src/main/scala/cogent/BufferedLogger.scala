@@ -0,0 +1,29 @@
+package cogent
+
+import scala.collection.mutable
+
+// Keeps messages until they are replayed into another logger, so that the messages about
+// one chart can be logged together while other charts are being compiled.
+class BufferedLogger( var maxLevel : Logger.Level )
+    extends Logger :
+
+    private val messages = mutable.ArrayBuffer[(Logger.Level, String)]()
+    private var fatalCount = 0
+
+    def setLogLevel( level : Logger.Level ) : Unit = synchronized {
+        maxLevel = level
+    }
+
+    def hasFatality : Boolean = synchronized { fatalCount > 0 }
+
+    def log( level : Logger.Level, message : String ) : Unit = synchronized {
+        if level.ordinal <= maxLevel.ordinal then messages += ( (level, message) )
+        if level == Logger.Level.Fatal then fatalCount += 1
+    }
+
+    // Each message is logged with the prefix in front.
+    def replay( target : Logger, prefix : String ) : Unit = synchronized {
+        for (level, message) <- messages do target.log( level, prefix + message )
+    }
+
+end BufferedLogger
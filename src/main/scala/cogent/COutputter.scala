@@ -39,6 +39,10 @@ class COutputter( override val writer : PrintWriter ) extends Outputter( writer
         endLine
     }
 
+    // Writes each line of the text as a line of its own, at the current indentation.
+    def putLines( text : String ) : Unit =
+        for line <- text.linesIterator do putLine( line )
+
     def comment( text : String ): Unit = {
         put( s"/* $text */" )
     }
@@ -100,13 +100,12 @@ class Checker( val logger : Logger ) :
             Set[Edge]()
         else 
             val edges = mutable.Set[Edge]()
-            for e <- stateChart.edges do
-                if e.source == node then
-                    edges += e
-                    if ! e.target.isState then
-                        // The edge ends on a pseudo-state. Keep going
-                        val es = edgesOnPaths( e.target, stateChart, visited + node)
-                        edges ++= es
+            for e <- stateChart.edgesFrom( node ) do
+                edges += e
+                if ! e.target.isState then
+                    // The edge ends on a pseudo-state. Keep going
+                    val es = edgesOnPaths( e.target, stateChart, visited + node)
+                    edges ++= es
             edges.toSet
     }
 
@@ -358,8 +358,11 @@ class Combiner( val logger : Logger ) :
         val newName = stateInfo.fullName ++ suffix
         val newStateInfo =
             (if node == topNode then
-                // We keep the old name, but we need to clear the <<submachine>> stereotype
-                stateInfo.copy( node.getFullName, depth, Stereotype.None )
+                // We keep the old name, but we need to clear the <<submachine>> stereotype.
+                // The copy remembers what it is a copy of, so its code can be shared.
+                val topInfo = stateInfo.copy( node.getFullName, depth, Stereotype.None )
+                topInfo.setSubmachine( node.getFullName )
+                topInfo
             else
                 // Otherwise we change the name by appending a suffix
                 stateInfo.copy( newName, depth, node.getStereotype ) )
@@ -0,0 +1,124 @@
+package cogent
+
+import java.io.File
+import java.nio.charset.StandardCharsets
+import java.nio.file.{Files, StandardCopyOption}
+import java.security.MessageDigest
+import scala.collection.mutable
+import scala.jdk.CollectionConverters._
+
+// An on-disk cache of generated files. An entry is keyed by a hash of everything the
+// output depends on: the version of Cogent, the options, the chart and file names, and
+// the content of the source file and of the files it includes. It holds the generated
+// files and the warnings that were reported when they were generated, which are reported
+// again when the entry is used.
+class CompileCache( val logger : Logger, val directory : File ) :
+
+    case class Entry( files : Seq[File], messages : Seq[(Logger.Level, String)] )
+
+    private val messagesFileName = "messages.txt"
+
+    def key( parts : Seq[String], sources : Seq[File] ) : String =
+        val digest = MessageDigest.getInstance( "SHA-256" )
+        for part <- parts do
+            digest.update( part.getBytes( StandardCharsets.UTF_8 ) )
+            digest.update( 0.toByte )
+        for source <- sources do
+            digest.update( source.getPath.getBytes( StandardCharsets.UTF_8 ) )
+            digest.update( 0.toByte )
+            digest.update( Files.readAllBytes( source.toPath ) )
+        digest.digest.map( b => f"${b & 0xff}%02x" ).mkString
+
+    def lookup( key : String ) : Option[Entry] =
+        val entryDirectory = new File( directory, key )
+        val messagesFile = new File( entryDirectory, messagesFileName )
+        if ! messagesFile.isFile then None
+        else
+            try
+                val messages = Files.readAllLines( messagesFile.toPath, StandardCharsets.UTF_8 ).asScala.toSeq.map{ line =>
+                    val (level, message) = line.span( _ != '\t' )
+                    ( Logger.Level.valueOf( level ), unescape( message.drop( 1 ) ) ) }
+                val files = entryDirectory.listFiles.toSeq.filter( _.getName != messagesFileName ).sortBy( _.getName )
+                Some( Entry( files, messages ) )
+            catch case e : Exception =>
+                logger.warning( s"Ignoring the damaged cache entry ${entryDirectory}: ${e.getMessage()}" )
+                None
+
+    // The entry is built under another name and then renamed, so that a run that is
+    // stopped part way does not leave a partial entry behind.
+    def store( key : String, files : Seq[File], messages : Seq[(Logger.Level, String)] ) : Unit =
+        try
+            directory.mkdirs()
+            val building = Files.createTempDirectory( directory.toPath, s"$key." ).toFile
+            for file <- files do
+                Files.copy( file.toPath, new File( building, file.getName ).toPath, StandardCopyOption.REPLACE_EXISTING )
+            val lines = for (level, message) <- messages yield
+                s"$level\t${escape( message )}"
+            Files.write( new File( building, messagesFileName ).toPath, lines.asJava, StandardCharsets.UTF_8 )
+            try Files.move( building.toPath, new File( directory, key ).toPath, StandardCopyOption.ATOMIC_MOVE )
+            catch case e : java.nio.file.FileSystemException =>
+                // Another run stored the same entry first.
+                building.listFiles.foreach( _.delete() )
+                building.delete()
+        catch case e : java.io.IOException =>
+            logger.warning( s"Could not store the output in the cache ${directory}: ${e.getMessage()}" )
+
+    // Messages are stored one to a line.
+    private def escape( message : String ) : String =
+        message.replace( "\\", "\\\\" ).replace( "\n", "\\n" )
+
+    private def unescape( line : String ) : String =
+        val result = StringBuilder()
+        var i = 0
+        while i < line.length do
+            if line( i ) == '\\' && i + 1 < line.length then
+                result += ( if line( i + 1 ) == 'n' then '\n' else line( i + 1 ) )
+                i += 2
+            else
+                result += line( i )
+                i += 1
+        end while
+        result.toString
+
+end CompileCache
+
+object CompileCache :
+
+    private val includeRX = """\s*!include(?:_many|_once|sub)?\s+([^<\s][^\s]*)\s*""".r
+
+    // The source file and the local files it includes, directly or not. Includes of the
+    // standard library, as in !include <C4/C4>, and of URLs are not followed.
+    def sources( file : File ) : Seq[File] =
+        val found = mutable.LinkedHashSet[File]()
+        def visit( f : File ) : Unit =
+            val canonical = f.getCanonicalFile
+            if ! found.contains( canonical ) && canonical.isFile then
+                found += canonical
+                for line <- Files.readAllLines( canonical.toPath, StandardCharsets.ISO_8859_1 ).asScala do
+                    line match
+                        case includeRX( name ) if ! name.contains( "://" ) =>
+                            // !includesub names a part of the file after a '!'.
+                            visit( new File( canonical.getParentFile, name.takeWhile( _ != '!' ) ) )
+                        case _ => ()
+        visit( file )
+        found.toSeq
+
+    // Passes every message on, and keeps the warnings and fatal errors, so they can be
+    // stored with the output. Fatal errors are counted afresh for each compilation.
+    class RecordingLogger( val underlying : Logger )
+        extends Logger :
+
+        val recorded = mutable.ArrayBuffer[(Logger.Level, String)]()
+        private var fatalCount = 0
+
+        def setLogLevel( max : Logger.Level ) : Unit = underlying.setLogLevel( max )
+
+        def hasFatality : Boolean = fatalCount > 0
+
+        def log( level : Logger.Level, message : String ) : Unit =
+            if level.ordinal <= Logger.Level.Warning.ordinal then recorded += ( (level, message) )
+            if level == Logger.Level.Fatal then fatalCount += 1
+            underlying.log( level, message )
+    end RecordingLogger
+
+end CompileCache
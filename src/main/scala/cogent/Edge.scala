@@ -68,6 +68,21 @@ enum Guard :
         }
 
     override def toString() = "[" + this.toString(0) +"]"
+
+    // The guards that this one combines with not, and, or and ==>, left to right.
+    def atoms : Seq[Guard] =
+        this match
+            case NotGuard( operand ) => operand.atoms
+            case AndGuard( left, right ) => left.atoms ++ right.atoms
+            case OrGuard( left, right ) => left.atoms ++ right.atoms
+            case ImpliesGuard( left, right ) => left.atoms ++ right.atoms
+            case _ => Seq( this )
+
+    // The names of the named guards that this one uses.
+    def namedGuards : Seq[String] = atoms.collect{ case NamedGuard( name ) => name }
+
+    // The names of the states that this one's 'in' guards ask about.
+    def queriedStates : Seq[String] = atoms.collect{ case InGuard( name ) => name }
 end Guard
 
 enum Action :
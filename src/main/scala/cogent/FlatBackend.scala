@@ -0,0 +1,243 @@
+package cogent
+
+// Generates a flat state machine for a chart that the Flattener has flattened.
+// The active configuration is kept as a single number, and dispatch is one switch
+// over it. Each case tries the transitions of the active states, innermost first,
+// and each transition is a straight-line sequence of exits, actions and entries,
+// since the states that are active are known when the code is generated.
+class FlatBackend( override val logger : Logger, override val out : COutputter, override val generationOptions : GenerationOptions,
+                   val flatChart : FlatChart )
+    extends Backend( logger, out, generationOptions ) :
+
+    private val configurationName = "configuration"
+
+    // The states that are active at the point the code is being generated for, deepest first.
+    private var activePath : List[Node] = Nil
+
+    override def generateCCode( stateChart : StateChart, chartName : String, cogentVersion : String ) : Unit = {
+        this.chartName = chartName
+
+        generateComment( cogentVersion )
+
+        generateInclude( chartName )
+
+        generateMacroDeclarations()
+
+        generateTraceSupport( stateChart )
+
+        generateProfileSupport( stateChart )
+
+        generateDefines( stateChart )
+
+        out.comment( "Each reachable configuration is numbered and named after its deepest state." )
+        out.endLine
+        for (leaf, i) <- flatChart.leaves.zipWithIndex do
+            out.putLine( s"#define ${configurationMacro(leaf)} $i" )
+        end for
+        out.blankLine
+
+        if generationOptions.contextStruct then
+            out.putLine( "// All per-machine state lives in the context struct" )
+            out.putLine( s"#include \"${contextHeaderName}\"" )
+            out.blankLine
+        else
+            for v <- stateVariables( stateChart ) do
+                out.putLine( s"// ${v.comment}" )
+                out.putLine( s"static ${v.cType} ${declarator( v, true )} ;" )
+            end for
+            out.blankLine
+        end if
+
+        generatePureGuardSupport( stateChart )
+
+        out.put( s"void initStateMachine_${chartName}( ${contextParam}$timeType $now) " )
+        out.block {
+            val entered = stateChart.root :: defaultDescent( stateChart.root )
+            entered.foreach( generateEntry( _, stateChart ) )
+            out.put( s"${stateData(configurationName)} = ${configurationMacro(entered.last)} ;" )
+        }
+
+        out.blankLine
+        out.put( s"static ${boolType} ${dispatchCoreName}( ${contextParam}${eventType} *${eventPointerName}, $eventClassType $eventClassVarName, $timeType $now ) " )
+        out.block{
+            out.putLine( s"${boolType} ${handledVarName} = ${falseConst} ;" )
+            generatePureGuardReset( stateChart )
+            out.switchComm( true, stateData( configurationName ) ) {
+                for leaf <- flatChart.leaves do
+                    out.caseComm( configurationMacro( leaf ) ) {
+                        generateCodeForConfiguration( leaf, stateChart )
+                    }
+                end for
+            }
+            out.put( s"return ${handledVarName} ;" )
+        }
+
+        out.blankLine
+        out.put( s"${boolType} dispatchEvent_${chartName}( ${contextParam}${eventType} *${eventPointerName}, $timeType $now ) " )
+        out.block{
+            out.put( s"return ${dispatchCoreName}( ${contextArg}${eventPointerName}, ${eventClassOf}(${eventPointerName}), $now ) ;" )
+        }
+
+        generateTimeoutFunctions( stateChart )
+
+        generateSettleFunction( stateChart )
+
+        if generationOptions.snapshot then
+            generateSnapshotFunctions( stateChart )
+    }
+
+    // The flat machine does not need the current child of each OR state.
+    override protected def stateVariables( stateChart : StateChart ) : Seq[StateVariable] =
+        StateVariable( "The number of the active configuration", "int", configurationName, "", 0 ) +:
+        super.stateVariables( stateChart ).filter( v => Set( isInArrayName, timeEnteredArrayName,
+                                                             guardKnownArrayName, guardValueArrayName ).contains( v.name ) )
+
+    // A TICK only visits the active configuration anyway.
+    override def usesTimerList( stateChart : StateChart ) : Boolean = false
+
+    // Each configuration is visited as a whole, so there is nothing to skip when settling.
+    override protected def settlesChangedOnly : Boolean = false
+
+    // The active states are tried from the deepest up, so inner states pre-empt outer ones.
+    // A transition that changes the configuration without being marked as handled (an else
+    // branch) also stops the outer states from being tried, as they are no longer active.
+    private def generateCodeForConfiguration( leaf : Node, stateChart : StateChart ) : Unit = {
+        val path = FlatChart.pathOf( leaf, stateChart )
+        var previous : Option[Node] = None
+        for state <- path if needCodeForEvents( state, stateChart ) do
+            activePath = path
+            previous match
+                case None =>
+                    declareHandledFlag( state )
+                    generateEventCodeForState( state, stateChart )
+                case Some( inner ) =>
+                    out.putLine( s"${boolType} ${handledFlag(state)} = ${handledFlag(inner)} ;" )
+                    out.ifComm( s"! ${handledFlag(state)} && ${stateData(configurationName)} == ${configurationMacro(leaf)}" ) {
+                        generateEventCodeForState( state, stateChart )
+                    }
+            out.endLine
+            previous = Some( state )
+        end for
+        previous match
+            case Some( outer ) => out.put( s"${handledVarName} = ${handledFlag(outer)} ;" )
+            case None => out.comment( s"No state in configuration ${leaf.getCName} has outgoing transitions." )
+    }
+
+    override def generateTransition( edge : Edge, stateChart : StateChart ) : Unit = {
+        val source = edge.source
+        val target = edge.target
+        assert( source.isState || source.isChoicePseudostate )
+        assert( target.isState || target.isChoicePseudostate )
+        out.comment( s"Transition from ${source.getCName} to ${target.getCName}." ) ; out.endLine
+        generateTransitionStart( edge, stateChart )
+
+        val leastCommonOr = stateChart.leastCommonOrOf( source, target )
+        val before = activePath
+        // Exit every active state below the least common OR state, deepest first.
+        val (exited, kept) = activePath.span( _ != leastCommonOr )
+        exited.foreach( generateExit( _, stateChart ) )
+        edge.actions.foreach( generateActionCode( _, stateChart ) )
+        // Enter the states from just below the least common OR state down to the target,
+        // and then its default descendants.
+        var entered = List[Node]()
+        var p = target
+        while p != leastCommonOr do
+            entered = p :: entered
+            p = stateChart.parentOf( p )
+        end while
+        val enteredStates = entered.filter( _.isState ) ++ ( if target.isState then defaultDescent( target ) else Nil )
+        enteredStates.foreach( generateEntry( _, stateChart ) )
+        activePath = enteredStates.reverse ++ kept
+        if target.isState then
+            out.putLine( s"${stateData(configurationName)} = ${configurationMacro(activePath.head)} ;" )
+        else
+            // Keep going through the choice pseudostate.
+            val edges = stateChart.edgesFrom( target )
+            generateIfsForEdges( None, target, edges, stateChart )
+        end if
+        generateTransitionDone( edge, stateChart )
+        activePath = before
+    }
+
+    override def generateDeadlineCode( stateChart : StateChart ) : Unit = {
+        val timedLeaves = flatChart.leaves.filter(
+            leaf => FlatChart.pathOf( leaf, stateChart ).exists( afterEdgesOf( _, stateChart ).nonEmpty ) )
+        if timedLeaves.nonEmpty then
+            out.switchComm( false, stateData( configurationName ) ) {
+                for leaf <- timedLeaves do
+                    out.caseComm( configurationMacro( leaf ) ) {
+                        for state <- FlatChart.pathOf( leaf, stateChart ) if afterEdgesOf( state, stateChart ).nonEmpty do
+                            out.comment( s"Deadlines for state '${state.getCName}'")
+                            out.block{ generateOwnDeadlineCode( state, stateChart ) }
+                        end for
+                    }
+                end for
+            }
+        end if
+    }
+
+    // Settling needs no change stamps; each TICK visits the active configuration.
+    override def generateSettleFunction( stateChart : StateChart ) : Unit = {
+        out.blankLine
+        out.comment( "Dispatches the event, then TICKs until no transition fires, at most maxSteps times." )
+        out.endLine
+        out.comment( "Stores the number of micro-steps that fired transitions in *steps_p, if steps_p is not null." )
+        out.endLine
+        out.comment( "Returns false if the machine was still changing when the bound was reached." )
+        out.endLine
+        out.put( s"${boolType} dispatchAndSettle_${chartName}( ${contextParam}${eventType} *${eventPointerName}, $timeType $now, int maxSteps, int *steps_p ) " )
+        out.block{
+            out.putLine( s"int steps = 0 ;" )
+            out.putLine( s"int ticks = 0 ;" )
+            out.putLine( s"${boolType} handled = ${dispatchCoreName}( ${contextArg}${eventPointerName}, ${eventClassOf}(${eventPointerName}), $now ) ;" )
+            out.put( s"while( handled && ticks < maxSteps ) " )
+            out.block{
+                out.putLine( "steps += 1 ;" )
+                out.putLine( s"handled = ${dispatchCoreName}( ${contextArg}$tickEventPointer, TICK, $now ) ;" )
+                out.putLine( "ticks += 1 ;" )
+            }
+            out.putLine( "if( handled ) steps += 1 ;" )
+            out.putLine( "if( steps_p ) *steps_p = steps ;" )
+            out.put( "return ! handled ;" )
+        }
+    }
+
+    private def generateEntry( state : Node, stateChart : StateChart ) : Unit = {
+        out.putLine( s"${stateData(isInArrayName)}[ ${globalMacro(state)} ] = ${trueConst} ;" )
+        out.putLine( s"${stateData(timeEnteredArrayName)}[ ${globalMacro(state)} ] = $now ;" )
+        out.putLine( traceStatement( s"$logEnterStateMacro( ${out.stringify(state.getFullName)} )",
+                                     "TRACE_ENTER_STATE", symbols( stateChart ).stateId( state ) ) )
+    }
+
+    private def generateExit( state : Node, stateChart : StateChart ) : Unit = {
+        out.putLine( traceStatement( s"$logExitStateMacro( ${out.stringify(state.getFullName)} )",
+                                     "TRACE_EXIT_STATE", symbols( stateChart ).stateId( state ) ) )
+        out.putLine( s"${stateData(isInArrayName)}[ ${globalMacro(state)} ] = ${falseConst} ;" )
+    }
+
+    // The states entered below the given one when it is entered by default, top down.
+    private def defaultDescent( state : Node ) : List[Node] =
+        state match
+            case x @ Node.OrState( _, _ ) =>
+                val child = startChild( x )
+                child :: defaultDescent( child )
+            case _ => Nil
+
+    // There is no current child array, but isIn is kept for every state.
+    override protected def childActiveTest( orState : Node, child : Node ) : String =
+        s"${stateData(isInArrayName)}[ ${globalMacro(child)} ]"
+
+    // The deepest state of a snapshot names the configuration. A configuration that can
+    // not be reached has no number, so a snapshot that ends in one is refused.
+    override def generateRestoreStores( state : Node, entered : String, stateChart : StateChart ) : Unit = {
+        super.generateRestoreStores( state, entered, stateChart )
+        if state.childStates.isEmpty then
+            if flatChart.leaves.contains( state ) then
+                out.putLine( s"${stateData(configurationName)} = ${configurationMacro(state)} ;" )
+            else
+                out.putLine( s"return $falseConst ;" )
+    }
+
+    private def configurationMacro( leaf : Node ) : String = s"CONFIG_${leaf.getCName}"
+
+end FlatBackend
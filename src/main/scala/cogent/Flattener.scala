@@ -0,0 +1,66 @@
+package cogent
+
+import scala.collection.mutable
+
+// The reachable configurations of a chart without AND states. Each configuration
+// is identified by its deepest active state, a basic state, and the configuration
+// is that state together with all its ancestors.
+case class FlatChart( leaves : Seq[Node] )
+
+object FlatChart :
+    // The active states of the configuration, deepest first.
+    def pathOf( leaf : Node, stateChart : StateChart ) : List[Node] =
+        if leaf == stateChart.root then List( leaf )
+        else leaf :: pathOf( stateChart.parentOf( leaf ), stateChart )
+end FlatChart
+
+// An optional pass between MiddleEnd.prepareForBackEnd and the Backend.
+// It enumerates the configurations that can be reached from the initial one.
+// If there are no more than the limit, the chart can be compiled to a flat state
+// machine, with one case per configuration and straight-line transitions.
+// Otherwise the hierarchical code is generated.
+class Flattener( val logger : Logger, val limit : Int ) :
+
+    def flatten( stateChart : StateChart ) : Option[FlatChart] =
+        val andStates = stateChart.nodes.filter{ case Node.AndState( _, _ ) => true ; case _ => false }
+        if andStates.nonEmpty then
+            logger.info( s"The chart has AND states, such as ${andStates.head.getFullName}, so it will not be flattened." )
+            return None
+        end if
+        val reached = mutable.LinkedHashSet[Node]()
+        val toDo = mutable.Queue[Node]( defaultLeaf( stateChart.root ) )
+        while toDo.nonEmpty && reached.size <= limit do
+            val leaf = toDo.dequeue()
+            if ! reached.contains( leaf ) then
+                reached += leaf
+                for state <- FlatChart.pathOf( leaf, stateChart )
+                    edge <- stateChart.edgesFrom( state )
+                    target <- leavesReachedBy( edge.target, stateChart, Set() )
+                do
+                    toDo.enqueue( target )
+            end if
+        end while
+        if reached.size > limit then
+            logger.info( s"The chart has more than $limit reachable configurations, so it will not be flattened." )
+            None
+        else
+            logger.info( s"The chart has ${reached.size} reachable configurations. It will be flattened." )
+            Some( FlatChart( reached.toSeq.sortBy( _.getGlobalIndex ) ) )
+        end if
+    end flatten
+
+    // The configurations in which a transition to the given vertex can end.
+    private def leavesReachedBy( vertex : Node, stateChart : StateChart, visitedChoices : Set[Node] ) : Seq[Node] =
+        if vertex.isState then Seq( defaultLeaf( vertex ) )
+        else if visitedChoices.contains( vertex ) then Seq()
+        else
+            stateChart.edgesFrom( vertex ).flatMap(
+                e => leavesReachedBy( e.target, stateChart, visitedChoices + vertex ) )
+
+    // The basic state that is entered when the given state is entered by default.
+    private def defaultLeaf( state : Node ) : Node =
+        state.childStates.find( _.getLocalIndex == 0 ) match
+            case Some( child ) => defaultLeaf( child )
+            case None => state
+
+end Flattener
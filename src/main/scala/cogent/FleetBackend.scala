@@ -0,0 +1,285 @@
+package cogent
+
+// Generates the optional companion files chartName_fleet.h and chartName_fleet.c,
+// a runtime that runs many machines of one chart on a pool of worker threads.
+// It needs the context struct and the multi-producer queue: each machine (an
+// instance) has its own mailbox, and events can be posted to it from any thread,
+// including from the actions of other instances.
+//
+// An instance with waiting events is scheduled on exactly one worker at a time,
+// so each instance still runs to completion. Each worker keeps a ready list of
+// instances. It takes from the front of its own list, so that every ready instance
+// gets its turn, and when its list is empty it steals from the back of the others'.
+// Idle workers sleep on a condition variable.
+class FleetBackend( override val logger : Logger, override val out : COutputter, override val generationOptions : GenerationOptions )
+    extends Backend( logger, out, generationOptions ) :
+
+    private def upperName : String = chartName.toUpperCase
+
+    private def instanceTypeName : String = s"${chartName}_instance_t"
+
+    private def fleetTypeName : String = s"${chartName}_fleet_t"
+
+    private def workerTypeName : String = s"${chartName}_worker_t"
+
+    def fleetHeaderName : String = s"${chartName}_fleet.h"
+
+    def generateFleetHeader( chartName : String, cogentVersion : String ) : Unit = {
+        this.chartName = chartName
+        val guardMacroName = s"${upperName}_FLEET_H"
+        generateComment( cogentVersion )
+        out.comment( s"Include this file after the declarations of $boolType, $eventType and $timeType (if not the default)." )
+        out.blankLine
+        out.putLines( s"""|#ifndef $guardMacroName
+                          |#define $guardMacroName
+                          |
+                          |#include <stdatomic.h>
+                          |#include "${contextHeaderName}"
+                          |#include "${chartName}_queue.h"
+                          |
+                          |/* One machine and its mailbox. The context is the first member, so guards and
+                          | * actions can convert their context pointer to a pointer to the instance. */
+                          |typedef struct ${chartName}_instance_s {
+                          |    $contextTypeName ctx ;
+                          |    ${chartName}_queue_t mailbox ;
+                          |    /* Nonzero while the instance is on a ready list or being run. */
+                          |    atomic_int scheduled ;
+                          |} $instanceTypeName ;
+                          |
+                          |typedef struct ${chartName}_fleet_s $fleetTypeName ;
+                          |
+                          |void initInstance_${chartName}( $instanceTypeName *instance_p, $timeType $now ) ;
+                          |$fleetTypeName *startFleet_${chartName}( int instanceCount, int workerCount, $timeType (*clock_p)( void ) ) ;
+                          |${boolType} fleetPost_${chartName}( $fleetTypeName *fleet_p, $instanceTypeName *instance_p, const ${eventType} *${eventPointerName} ) ;
+                          |void stopFleet_${chartName}( $fleetTypeName *fleet_p ) ;
+                          |
+                          |#endif""".stripMargin )
+    }
+
+    def generateFleetCode( chartName : String, cogentVersion : String ) : Unit = {
+        this.chartName = chartName
+        generateComment( cogentVersion )
+        generateInclude( chartName )
+        out.putLines( s"""|#include <stdlib.h>
+                          |#include <pthread.h>
+                          |#include "${fleetHeaderName}"
+                          |
+                          |/* The most events an instance handles before the worker moves on to the next one. */
+                          |#ifndef ${upperName}_FLEET_BUDGET
+                          |    #define ${upperName}_FLEET_BUDGET ${upperName}_QUEUE_CAPACITY
+                          |#endif
+                          |
+                          |typedef struct ${chartName}_worker_s {
+                          |    $fleetTypeName *fleet_p ;
+                          |    int number ;
+                          |    pthread_t thread ;
+                          |    /* Protects the ready list, which is a ring of instanceCount entries.
+                          |     * An instance is on at most one list, so it never overflows. */
+                          |    pthread_mutex_t lock ;
+                          |    $instanceTypeName **ready_a ;
+                          |    int first ;
+                          |    int count ;
+                          |} $workerTypeName ;
+                          |
+                          |struct ${chartName}_fleet_s {
+                          |    int instanceCount ;
+                          |    int workerCount ;
+                          |    /* The number of worker threads that were started. */
+                          |    int startedCount ;
+                          |    $timeType (*clock_p)( void ) ;
+                          |    $workerTypeName *workers_a ;
+                          |    /* The number of instances on ready lists. */
+                          |    atomic_int readyCount ;
+                          |    /* The number of workers that are, or are about to be, asleep. */
+                          |    atomic_int sleeperCount ;
+                          |    /* Spreads instances scheduled from outside the fleet over the workers. */
+                          |    atomic_uint nextWorker ;
+                          |    atomic_int stopping ;
+                          |    pthread_mutex_t idleLock ;
+                          |    pthread_cond_t idleCond ;
+                          |} ;
+                          |
+                          |/* The worker running on this thread, if any. */
+                          |static _Thread_local $workerTypeName *currentWorker_p = 0 ;
+                          |""".stripMargin )
+
+        out.blankLine
+        out.put( s"void initInstance_${chartName}( $instanceTypeName *instance_p, $timeType $now ) " )
+        out.block{
+            out.putLine( s"initStateMachine_${chartName}( &instance_p->ctx, $now ) ;" )
+            out.putLine( s"initQueue_${chartName}( &instance_p->mailbox ) ;" )
+            out.put( "atomic_init( &instance_p->scheduled, 0 ) ;" )
+        }
+
+        out.blankLine
+        out.putLines( s"""|static void pushReady( $workerTypeName *worker_p, $instanceTypeName *instance_p ) {
+                          |    pthread_mutex_lock( &worker_p->lock ) ;
+                          |    worker_p->ready_a[ ( worker_p->first + worker_p->count ) % worker_p->fleet_p->instanceCount ] = instance_p ;
+                          |    worker_p->count += 1 ;
+                          |    pthread_mutex_unlock( &worker_p->lock ) ;
+                          |}
+                          |
+                          |/* The owner takes the oldest entry. */
+                          |static $instanceTypeName *takeReady( $workerTypeName *worker_p ) {
+                          |    $instanceTypeName *instance_p = 0 ;
+                          |    pthread_mutex_lock( &worker_p->lock ) ;
+                          |    if( worker_p->count > 0 ) {
+                          |        instance_p = worker_p->ready_a[ worker_p->first ] ;
+                          |        worker_p->first = ( worker_p->first + 1 ) % worker_p->fleet_p->instanceCount ;
+                          |        worker_p->count -= 1 ;
+                          |    }
+                          |    pthread_mutex_unlock( &worker_p->lock ) ;
+                          |    return instance_p ;
+                          |}
+                          |
+                          |/* Thieves take the newest entry, which the owner would reach last. */
+                          |static $instanceTypeName *stealReady( $workerTypeName *worker_p ) {
+                          |    $instanceTypeName *instance_p = 0 ;
+                          |    pthread_mutex_lock( &worker_p->lock ) ;
+                          |    if( worker_p->count > 0 ) {
+                          |        worker_p->count -= 1 ;
+                          |        instance_p = worker_p->ready_a[ ( worker_p->first + worker_p->count ) % worker_p->fleet_p->instanceCount ] ;
+                          |    }
+                          |    pthread_mutex_unlock( &worker_p->lock ) ;
+                          |    return instance_p ;
+                          |}
+                          |
+                          |/* Puts an instance that has just become scheduled on a ready list: the current
+                          | * worker's, when called from a worker of this fleet, else the next one in turn. */
+                          |static void schedule( $fleetTypeName *fleet_p, $instanceTypeName *instance_p ) {
+                          |    $workerTypeName *worker_p = currentWorker_p ;
+                          |    if( worker_p == 0 || worker_p->fleet_p != fleet_p ) {
+                          |        worker_p = &fleet_p->workers_a[ atomic_fetch_add( &fleet_p->nextWorker, 1u ) % (unsigned) fleet_p->workerCount ] ;
+                          |    }
+                          |    pushReady( worker_p, instance_p ) ;
+                          |    atomic_fetch_add( &fleet_p->readyCount, 1 ) ;
+                          |    /* A worker going to sleep increments sleeperCount before it looks at readyCount. */
+                          |    if( atomic_load( &fleet_p->sleeperCount ) > 0 ) {
+                          |        pthread_mutex_lock( &fleet_p->idleLock ) ;
+                          |        pthread_cond_signal( &fleet_p->idleCond ) ;
+                          |        pthread_mutex_unlock( &fleet_p->idleLock ) ;
+                          |    }
+                          |}
+                          |
+                          |/* Handles a batch of the instance's events, then unschedules it. Since a poster
+                          | * only schedules an instance it finds unscheduled, the mailbox is looked at again
+                          | * after unscheduling, so that an event posted during the batch is not stranded. */
+                          |static void runInstance( $fleetTypeName *fleet_p, $instanceTypeName *instance_p ) {
+                          |    drain_${chartName}( &instance_p->ctx, &instance_p->mailbox, fleet_p->clock_p(), ${upperName}_FLEET_BUDGET ) ;
+                          |    atomic_store( &instance_p->scheduled, 0 ) ;
+                          |    atomic_thread_fence( memory_order_seq_cst ) ;
+                          |    if( pending_${chartName}( &instance_p->mailbox ) && atomic_exchange( &instance_p->scheduled, 1 ) == 0 ) {
+                          |        schedule( fleet_p, instance_p ) ;
+                          |    }
+                          |}
+                          |
+                          |static $instanceTypeName *findWork( $workerTypeName *worker_p ) {
+                          |    $fleetTypeName *fleet_p = worker_p->fleet_p ;
+                          |    $instanceTypeName *instance_p = takeReady( worker_p ) ;
+                          |    int i ;
+                          |    for( i = 1 ; instance_p == 0 && i < fleet_p->workerCount ; ++i ) {
+                          |        instance_p = stealReady( &fleet_p->workers_a[ ( worker_p->number + i ) % fleet_p->workerCount ] ) ;
+                          |    }
+                          |    if( instance_p != 0 ) atomic_fetch_sub( &fleet_p->readyCount, 1 ) ;
+                          |    return instance_p ;
+                          |}
+                          |
+                          |static void *workerMain( void *arg ) {
+                          |    $workerTypeName *worker_p = ($workerTypeName *) arg ;
+                          |    $fleetTypeName *fleet_p = worker_p->fleet_p ;
+                          |    currentWorker_p = worker_p ;
+                          |    for( ;; ) {
+                          |        int done ;
+                          |        $instanceTypeName *instance_p = findWork( worker_p ) ;
+                          |        if( instance_p != 0 ) {
+                          |            runInstance( fleet_p, instance_p ) ;
+                          |            continue ;
+                          |        }
+                          |        pthread_mutex_lock( &fleet_p->idleLock ) ;
+                          |        atomic_fetch_add( &fleet_p->sleeperCount, 1 ) ;
+                          |        while( atomic_load( &fleet_p->readyCount ) == 0 && ! atomic_load( &fleet_p->stopping ) ) {
+                          |            pthread_cond_wait( &fleet_p->idleCond, &fleet_p->idleLock ) ;
+                          |        }
+                          |        atomic_fetch_sub( &fleet_p->sleeperCount, 1 ) ;
+                          |        done = atomic_load( &fleet_p->readyCount ) == 0 && atomic_load( &fleet_p->stopping ) ;
+                          |        pthread_mutex_unlock( &fleet_p->idleLock ) ;
+                          |        if( done ) break ;
+                          |    }
+                          |    currentWorker_p = 0 ;
+                          |    return 0 ;
+                          |}
+                          |""".stripMargin )
+
+        out.comment( "Starts workerCount threads to run up to instanceCount instances, which must have been initialized." )
+        out.endLine
+        out.comment( "clock_p gives the time passed to the machines. Returns a null pointer if the threads can not be started." )
+        out.endLine
+        out.putLines( s"""|$fleetTypeName *startFleet_${chartName}( int instanceCount, int workerCount, $timeType (*clock_p)( void ) ) {
+                          |    $fleetTypeName *fleet_p = ($fleetTypeName *) calloc( 1, sizeof( $fleetTypeName ) ) ;
+                          |    int i ;
+                          |    if( fleet_p == 0 ) return 0 ;
+                          |    fleet_p->instanceCount = instanceCount ;
+                          |    fleet_p->workerCount = workerCount ;
+                          |    fleet_p->clock_p = clock_p ;
+                          |    atomic_init( &fleet_p->readyCount, 0 ) ;
+                          |    atomic_init( &fleet_p->sleeperCount, 0 ) ;
+                          |    atomic_init( &fleet_p->nextWorker, 0u ) ;
+                          |    atomic_init( &fleet_p->stopping, 0 ) ;
+                          |    pthread_mutex_init( &fleet_p->idleLock, 0 ) ;
+                          |    pthread_cond_init( &fleet_p->idleCond, 0 ) ;
+                          |    fleet_p->workers_a = ($workerTypeName *) calloc( (size_t) workerCount, sizeof( $workerTypeName ) ) ;
+                          |    if( fleet_p->workers_a == 0 ) { fleet_p->workerCount = 0 ; stopFleet_${chartName}( fleet_p ) ; return 0 ; }
+                          |    for( i = 0 ; i < workerCount ; ++i ) {
+                          |        $workerTypeName *worker_p = &fleet_p->workers_a[ i ] ;
+                          |        worker_p->fleet_p = fleet_p ;
+                          |        worker_p->number = i ;
+                          |        pthread_mutex_init( &worker_p->lock, 0 ) ;
+                          |        worker_p->ready_a = ($instanceTypeName **) calloc( (size_t) instanceCount, sizeof( $instanceTypeName * ) ) ;
+                          |    }
+                          |    for( i = 0 ; i < workerCount ; ++i ) {
+                          |        if( fleet_p->workers_a[ i ].ready_a == 0
+                          |         || pthread_create( &fleet_p->workers_a[ i ].thread, 0, workerMain, &fleet_p->workers_a[ i ] ) != 0 ) {
+                          |            stopFleet_${chartName}( fleet_p ) ;
+                          |            return 0 ;
+                          |        }
+                          |        fleet_p->startedCount += 1 ;
+                          |    }
+                          |    return fleet_p ;
+                          |}
+                          |""".stripMargin )
+
+        out.comment( "Posts an event to an instance of the fleet. May be called from any thread, including from actions." )
+        out.endLine
+        out.comment( "Returns false, and drops the event, if the instance's mailbox is full." )
+        out.endLine
+        out.putLines( s"""|${boolType} fleetPost_${chartName}( $fleetTypeName *fleet_p, $instanceTypeName *instance_p, const ${eventType} *${eventPointerName} ) {
+                          |    if( ! post_${chartName}( &instance_p->mailbox, ${eventPointerName} ) ) return $falseConst ;
+                          |    atomic_thread_fence( memory_order_seq_cst ) ;
+                          |    if( atomic_exchange( &instance_p->scheduled, 1 ) == 0 ) schedule( fleet_p, instance_p ) ;
+                          |    return $trueConst ;
+                          |}
+                          |""".stripMargin )
+
+        out.comment( "Waits until no instance has waiting events, then stops the workers and frees the fleet." )
+        out.endLine
+        out.comment( "Events must not be posted from outside the fleet once this has been called." )
+        out.endLine
+        out.putLines( s"""|void stopFleet_${chartName}( $fleetTypeName *fleet_p ) {
+                          |    int i ;
+                          |    pthread_mutex_lock( &fleet_p->idleLock ) ;
+                          |    atomic_store( &fleet_p->stopping, 1 ) ;
+                          |    pthread_cond_broadcast( &fleet_p->idleCond ) ;
+                          |    pthread_mutex_unlock( &fleet_p->idleLock ) ;
+                          |    for( i = 0 ; i < fleet_p->startedCount ; ++i ) pthread_join( fleet_p->workers_a[ i ].thread, 0 ) ;
+                          |    for( i = 0 ; i < fleet_p->workerCount ; ++i ) {
+                          |        pthread_mutex_destroy( &fleet_p->workers_a[ i ].lock ) ;
+                          |        free( fleet_p->workers_a[ i ].ready_a ) ;
+                          |    }
+                          |    free( fleet_p->workers_a ) ;
+                          |    pthread_mutex_destroy( &fleet_p->idleLock ) ;
+                          |    pthread_cond_destroy( &fleet_p->idleCond ) ;
+                          |    free( fleet_p ) ;
+                          |}""".stripMargin )
+    }
+
+end FleetBackend
@@ -3,4 +3,68 @@ package cogent
 sealed class GenerationOptions( ) 
 {
     var outputGenerationDate : Boolean = false
+    var contextStruct : Boolean = false
+    var tableStyle : Boolean = false
+    var inlineTransitions : Boolean = false
+    var timerList : Boolean = false
+    // "spsc" or "mpsc" to generate an event queue. "" means no queue.
+    var queueKind : String = ""
+    var fleet : Boolean = false
+    // Trace with fixed-size binary records instead of the LOG_ macros' strings.
+    var binaryTrace : Boolean = false
+    // Count and time each transition, guard and action.
+    var profile : Boolean = false
+    // Write a standalone benchmark program next to the generated code.
+    var bench : Boolean = false
+    // Generate snapshot_ and restore_ functions.
+    var snapshot : Boolean = false
+    // Keep isIn and entry times only where they are used, in the smallest types.
+    var compact : Boolean = false
+    // dispatchAndSettle_ revisits only the states that changed in the previous micro-step.
+    var settleChanged : Boolean = false
+    // Charts with at most this many reachable configurations are flattened. 0 means never.
+    var flatLimit : Int = 0
+    // What reads the source: "plantuml", "native", or "check" to read it with both and
+    // compare the statecharts they find.
+    var frontEnd : String = "plantuml"
+    // The instances of a submachine that is used more than once share code.
+    var sharedSubmachines : Boolean = false
+    // Write chartName_latency.json, the worst-case work of a dispatch for each event class.
+    var latencyReport : Boolean = false
+    // The file that declares guards pure and gives the costs of guards and actions. "" means none.
+    var annotationsFile : String = ""
+    // What that file says. It is read when the chart is compiled, and is keyed in the compile
+    // cache by the file's content rather than by the fingerprint.
+    var annotations : Annotations = Annotations.none
+
+    // Charts compiled at the same time each get their own copy, since compiling may
+    // change an option that has no effect. A new option must be added here too.
+    def copy : GenerationOptions =
+        val c = new GenerationOptions()
+        c.outputGenerationDate = outputGenerationDate
+        c.contextStruct = contextStruct
+        c.tableStyle = tableStyle
+        c.inlineTransitions = inlineTransitions
+        c.timerList = timerList
+        c.queueKind = queueKind
+        c.fleet = fleet
+        c.binaryTrace = binaryTrace
+        c.profile = profile
+        c.bench = bench
+        c.snapshot = snapshot
+        c.compact = compact
+        c.settleChanged = settleChanged
+        c.flatLimit = flatLimit
+        c.frontEnd = frontEnd
+        c.sharedSubmachines = sharedSubmachines
+        c.latencyReport = latencyReport
+        c.annotationsFile = annotationsFile
+        c.annotations = annotations
+        c
+
+    // Everything above, for the compile cache's key. A new option must be added here too.
+    def fingerprint : String =
+        Seq( outputGenerationDate, contextStruct, tableStyle, inlineTransitions, timerList, queueKind, fleet,
+             binaryTrace, profile, bench, snapshot, compact, settleChanged, flatLimit, frontEnd,
+             sharedSubmachines, latencyReport, annotationsFile ).mkString( "," )
 }
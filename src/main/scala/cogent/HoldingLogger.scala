@@ -0,0 +1,35 @@
+package cogent
+
+import scala.collection.mutable
+
+// Passes messages on to another logger, except that the messages a thread logs inside
+// holding are kept back and returned. Work that is spread over several threads can then
+// release its messages in a fixed order.
+class HoldingLogger( val underlying : Logger )
+    extends Logger :
+
+    private val held = ThreadLocal[mutable.ArrayBuffer[(Logger.Level, String)]]()
+
+    def setLogLevel( max : Logger.Level ) : Unit = underlying.setLogLevel( max )
+
+    def hasFatality : Boolean = underlying.hasFatality
+
+    def log( level : Logger.Level, message : String ) : Unit =
+        val buffer = held.get
+        if buffer == null then underlying.log( level, message )
+        else buffer += ( (level, message) )
+
+    def holding( body : => Unit ) : Seq[(Logger.Level, String)] =
+        val outer = held.get
+        val buffer = mutable.ArrayBuffer[(Logger.Level, String)]()
+        held.set( buffer )
+        try body
+        finally held.set( outer )
+        buffer.toSeq
+
+    // Logs the messages as if they had just been logged, so messages released inside
+    // holding are kept back again.
+    def release( messages : Seq[(Logger.Level, String)] ) : Unit =
+        for (level, message) <- messages do log( level, message )
+
+end HoldingLogger
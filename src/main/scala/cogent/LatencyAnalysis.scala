@@ -0,0 +1,278 @@
+package cogent
+
+import scala.collection.mutable
+
+// Bounds the work that dispatching an event can do, from the prepared statechart alone.
+//
+// For each event class, the bound counts the guards evaluated, the actions called and the
+// states entered and exited by one call of the dispatch core, in the worst configuration,
+// and a weight: the sum of the costs that the annotation file gives them. It follows the
+// generated code. The event goes to the active child of each OR state and to every region
+// of an AND state, and a state's own transitions are tried only if none below it took one.
+// All the guards of a state's transitions on the event may be evaluated before one is
+// taken. A transition exits its source and its ancestors up to the least common OR state,
+// calls its actions, enters the states down to its target, and goes on through choices.
+// Each count is a maximum of its own, so the bounds need not all be reached at once.
+//
+// dispatchAndSettle_ then TICKs while transitions fire. The first TICK can fire any after
+// transition that is due, but since no time passes, the later ones can only fire after( 0 ms )
+// transitions, either of the states just entered or of the states above them that the
+// change makes the TICK look at again. The longest chain of those bounds the number of TICKs.
+// A cycle of them has no bound, and is a fatal error.
+class LatencyAnalysis( val logger : Logger, val stateChart : StateChart, val annotations : Annotations ) :
+    import LatencyAnalysis.Work
+
+    // What a state's code can do for an event: the most work if no transition is taken, and
+    // if one is. None means that that can not happen.
+    private case class Outcome( notTaken : Option[Work], taken : Option[Work] ) :
+        def worst : Work = ( notTaken ++ taken ).reduceOption( _ max _ ).getOrElse( Work.zero )
+
+    private def maxOf( a : Option[Work], b : Option[Work] ) : Option[Work] = ( a ++ b ).reduceOption( _ max _ )
+
+    private def plus( a : Option[Work], b : Option[Work] ) : Option[Work] = for x <- a ; y <- b yield x + y
+
+    private def sum( works : Iterable[Work] ) : Work = works.foldLeft( Work.zero )( _ + _ )
+
+    private def memo[K, V]( cache : mutable.Map[K, V], key : K )( compute : => V ) : V =
+        cache.get( key ) match
+            case Some( value ) => value
+            case None =>
+                val value = compute
+                cache( key ) = value
+                value
+
+    private def isElse( edge : Edge ) : Boolean =
+        edge.guardOpt.exists{ case Guard.ElseGuard() => true ; case _ => false }
+
+    private def startChild( state : Node ) : Node = state.childNodes.find( _.getLocalIndex == 0 ).get
+
+    // Entering and exiting.
+    // As in the enter_ and exit_ functions, a state entered with no child given enters its
+    // default child or all its regions, and a state exited with no child given exits its
+    // active child, whichever it is, or all its regions.
+
+    private val enterCache = mutable.HashMap[Node, Work]()
+    private val exitCache = mutable.HashMap[Node, Work]()
+    private val enteredCache = mutable.HashMap[Node, Set[Node]]()
+
+    private def enterWork( state : Node, childOpt : Option[Node] = None ) : Work =
+        def compute : Work =
+            Work( 0, 0, 1, 0, annotations.enterCost ) + ( state match
+                case x @ Node.OrState( _, _ ) => if childOpt.isEmpty then enterWork( startChild( x ) ) else Work.zero
+                case x @ Node.AndState( _, _ ) => sum( x.childStates.filterNot( childOpt.contains ).map( enterWork( _ ) ) )
+                case _ => Work.zero )
+        if childOpt.isEmpty then memo( enterCache, state )( compute ) else compute
+
+    private def exitWork( state : Node, childOpt : Option[Node] = None ) : Work =
+        def compute : Work =
+            Work( 0, 0, 0, 1, annotations.exitCost ) + ( state match
+                case x @ Node.OrState( _, _ ) =>
+                    if childOpt.isEmpty then x.childStates.map( exitWork( _ ) ).reduceOption( _ max _ ).getOrElse( Work.zero )
+                    else Work.zero
+                case x @ Node.AndState( _, _ ) => sum( x.childStates.filterNot( childOpt.contains ).map( exitWork( _ ) ) )
+                case _ => Work.zero )
+        if childOpt.isEmpty then memo( exitCache, state )( compute ) else compute
+
+    // The states that entering a state enters.
+    private def entered( state : Node, childOpt : Option[Node] = None ) : Set[Node] =
+        def compute : Set[Node] =
+            Set( state ) ++ ( state match
+                case x @ Node.OrState( _, _ ) => if childOpt.isEmpty then entered( startChild( x ) ) else Set()
+                case x @ Node.AndState( _, _ ) => x.childStates.filterNot( childOpt.contains ).flatMap( entered( _ ) )
+                case _ => Set() )
+        if childOpt.isEmpty then memo( enteredCache, state )( compute ) else compute
+
+    // The states from just below the least common OR state down to the target, paired with
+    // the next one down.
+    private def pathDown( edge : Edge ) : Seq[(Node, Node)] =
+        val leastCommonOr = stateChart.leastCommonOrOf( edge.source, edge.target )
+        val path = Iterator.iterate( edge.target )( stateChart.parentOf ).takeWhile( _ != leastCommonOr ).toSeq.reverse
+        path.zip( path.tail )
+
+    // Transitions.
+    // choices holds the choices that the transition has come through, which the checker has
+    // already made sure do not loop.
+
+    private def transitionWork( edge : Edge, choices : Set[Node] ) : Work =
+        val leastCommonOr = stateChart.leastCommonOrOf( edge.source, edge.target )
+        val up = Iterator.iterate( edge.source )( stateChart.parentOf ).takeWhile( _ != leastCommonOr ).toSeq
+        val exits = ( if edge.source.isState then exitWork( edge.source ) else Work.zero ) +
+                    sum( up.zip( up.tail ).map( (child, parent) => exitWork( parent, Some( child ) ) ) )
+        val actions = sum( edge.actions.map( action => Work( 0, 1, 0, 0, annotations.costOf( action ) ) ) )
+        val entries = sum( pathDown( edge ).map( (parent, child) => enterWork( parent, Some( child ) ) ) ) +
+                      ( if edge.target.isState then enterWork( edge.target ) else choiceOutcome( edge.target, choices ).worst )
+        exits + actions + entries
+
+    private def choiceOutcome( choice : Node, choices : Set[Node] ) : Outcome =
+        if choices.contains( choice ) then Outcome( Some( Work.zero ), None )
+        else groupOutcome( stateChart.edgesFrom( choice ), choices + choice )
+
+    // The transitions that are tried together: those of a state on one trigger, or those of a choice.
+    private def groupOutcome( edges : Seq[Edge], choices : Set[Node] ) : Outcome =
+        val guards = edges.filter( e => e.guardOpt.nonEmpty && ! isElse( e ) ).map( _.guardOpt.get )
+        val tried = sum( guards.map( guard => Work( 1, 0, 0, 0, annotations.costOf( guard ) ) ) )
+        val canFail = edges.forall( e => e.guardOpt.nonEmpty && ! isElse( e ) )
+        Outcome( if canFail then Some( tried ) else None,
+                 edges.map( transitionWork( _, choices ) ).reduceOption( _ max _ ).map( tried + _ ) )
+
+    // The states entered by a transition, through choices.
+    private def enteredBy( edge : Edge, choices : Set[Node] ) : Set[Node] =
+        pathDown( edge ).flatMap( (parent, child) => entered( parent, Some( child ) ) ).toSet ++
+        ( if edge.target.isState then entered( edge.target )
+          else if choices.contains( edge.target ) then Set()
+          else stateChart.edgesFrom( edge.target ).flatMap( enteredBy( _, choices + edge.target ) ) )
+
+    // Dispatching.
+    // An event class is the name of a named trigger, or None for TICK.
+
+    private def ownOutcome( state : Node, eventClass : Option[String] ) : Outcome =
+        eventClass match
+            case Some( name ) =>
+                groupOutcome( stateChart.edgesFromOn( state, Trigger.NamedTrigger( name ) ), Set() )
+            case None =>
+                // The after transitions are tried in order of duration, while none has been taken.
+                val durations = stateChart.edgesFrom( state ).flatMap( _.triggerOpt ).flatMap( _.asAfterTrigger )
+                                          .map( _.durationInMilliseconds ).distinct.sorted
+                durations.map( d => groupOutcome( stateChart.edgesFromOn( state, Trigger.AfterTrigger( d ) ), Set() ) )
+                         .foldLeft( Outcome( Some( Work.zero ), None ) )( (sofar, next) =>
+                             Outcome( plus( sofar.notTaken, next.notTaken ), maxOf( sofar.taken, plus( sofar.notTaken, next.taken ) ) ) )
+
+    private def outcome( state : Node, eventClass : Option[String] ) : Outcome =
+        val below = state match
+            case x @ Node.OrState( _, _ ) =>
+                // One child is active.
+                val children = x.childStates.map( outcome( _, eventClass ) )
+                Outcome( children.flatMap( _.notTaken ).reduceOption( _ max _ ), children.flatMap( _.taken ).reduceOption( _ max _ ) )
+            case x @ Node.AndState( _, _ ) =>
+                // Each region is visited, and any of them may take a transition.
+                val regions = x.childStates.map( outcome( _, eventClass ) )
+                Outcome( regions.foldLeft( Option( Work.zero ) )( (total, region) => plus( total, region.notTaken ) ),
+                         if regions.exists( _.taken.nonEmpty ) then Some( sum( regions.map( _.worst ) ) ) else None )
+            case _ => Outcome( Some( Work.zero ), None )
+        val own = ownOutcome( state, eventClass )
+        Outcome( plus( below.notTaken, own.notTaken ), maxOf( below.taken, plus( below.notTaken, own.taken ) ) )
+
+    val namedEventClasses : Seq[String] =
+        stateChart.edges.flatMap( _.triggerOpt ).flatMap( _.asNamedTrigger ).map( _.name ).distinct.sorted
+
+    val hasAfterTransitions : Boolean = stateChart.edges.exists( _.triggerOpt.exists( _.asAfterTrigger.nonEmpty ) )
+
+    // The most work of one call of the dispatch core for each event class, and for TICK.
+    lazy val dispatchWork : Map[Option[String], Work] =
+        ( namedEventClasses.map( Some( _ ) ) :+ None ).map( c => c -> outcome( stateChart.root, c ).worst ).toMap
+
+    // Settling.
+
+    private def isZeroDelay( edge : Edge ) : Boolean =
+        edge.triggerOpt.exists( _.asAfterTrigger.exists( _.durationInMilliseconds.toInt <= 0 ) )
+
+    private val zeroDelayStates : Set[Node] = stateChart.edges.filter( isZeroDelay ).map( _.source ).toSet
+
+    // The states whose after( 0 ms ) transitions can fire in the TICK after the transition: the
+    // states it enters, and the least common OR state and the states above it.
+    private def nextZeroDelayStates( edge : Edge ) : Set[Node] =
+        val leastCommonOr = stateChart.leastCommonOrOf( edge.source, edge.target )
+        val above = Iterator.iterate( leastCommonOr )( stateChart.parentOf ).takeWhile( _ != stateChart.root ).toSet + stateChart.root
+        ( enteredBy( edge, Set() ) ++ above ).intersect( zeroDelayStates )
+
+    // For each state with after( 0 ms ) transitions, the most TICKs in a row, starting with one
+    // of its own, that fire them; and the cycles.
+    private lazy val zeroDelayChains : ( Map[Node, Int], Seq[Seq[Node]] ) =
+        val lengths = mutable.HashMap[Node, Int]()
+        val stack = mutable.ArrayBuffer[Node]()
+        val found = mutable.ArrayBuffer[Seq[Node]]()
+        def visit( state : Node ) : Int =
+            lengths.get( state ) match
+                case Some( length ) => length
+                case None if stack.contains( state ) =>
+                    found += stack.drop( stack.indexOf( state ) ).toSeq
+                    0
+                case None =>
+                    stack += state
+                    val next = stateChart.edgesFrom( state ).filter( isZeroDelay ).flatMap( nextZeroDelayStates ).distinct
+                    val length = 1 + next.map( visit ).maxOption.getOrElse( 0 )
+                    stack.remove( stack.size - 1 )
+                    lengths( state ) = length
+                    length
+        zeroDelayStates.toSeq.sortBy( _.getFullName ).foreach( visit )
+        ( lengths.toMap, found.toSeq )
+
+    private def chainLengths : Map[Node, Int] = zeroDelayChains._1
+
+    private def cycles : Seq[Seq[Node]] = zeroDelayChains._2
+
+    // The cycles of after( 0 ms ) transitions, as the full names of their states.
+    def zeroDelayCycles : Seq[Seq[String]] = cycles.map( _.map( _.getFullName ) )
+
+    // The most TICKs that dispatchAndSettle_ can make, the last of which fires nothing, if there
+    // is no cycle. The first can fire any after transition that is due.
+    lazy val settleTicks : Option[Int] =
+        if cycles.nonEmpty then None
+        else
+            val firing = stateChart.edges.filter( _.triggerOpt.exists( _.asAfterTrigger.nonEmpty ) )
+                                   .map( edge => 1 + nextZeroDelayStates( edge ).map( chainLengths ).maxOption.getOrElse( 0 ) )
+                                   .maxOption.getOrElse( 0 )
+            Some( firing + 1 )
+
+    // The most work of dispatchAndSettle_ for each event class, if there is a bound.
+    def settleWork( eventClass : Option[String] ) : Option[Work] =
+        settleTicks.map( ticks => dispatchWork( eventClass ) + dispatchWork( None ) * ticks )
+
+    // Reports the cycles of after( 0 ms ) transitions as fatal errors.
+    def check() : Unit =
+        for cycle <- zeroDelayCycles do
+            logger.fatal( s"The after( 0 ms ) transitions of ${cycle.mkString( ", " )} can fire one after another" +
+                          " without end, unless their guards stop them. Settling has no bound but maxSteps." )
+
+    private def label( eventClass : Option[String] ) : String = eventClass.getOrElse( "TICK" )
+
+    // One line per event class, for the log.
+    def summary : Seq[String] =
+        for eventClass <- namedEventClasses.map( Some( _ ) ) ++ ( if hasAfterTransitions then Seq( None ) else Seq() ) yield
+            val w = dispatchWork( eventClass )
+            s"Worst case for ${label( eventClass )}: ${w.guards} guards, ${w.actions} actions, ${w.enters} entries," +
+            s" ${w.exits} exits, weight ${w.weight}" +
+            settleWork( eventClass ).map( s => s"; with settling, weight ${s.weight}" ).getOrElse( "" )
+
+    // The report, in JSON.
+    def report( chartName : String, cogentVersion : String ) : String =
+        def string( s : String ) : String =
+            "\"" + s.toSeq.map( c => c match
+                case '"' => "\\\""
+                case '\\' => "\\\\"
+                case c if c < ' ' => "\\u%04x".format( c.toInt )
+                case c => c.toString ).mkString + "\""
+        def work( w : Work ) : String =
+            s"""{ "guards": ${w.guards}, "actions": ${w.actions}, "enters": ${w.enters}, "exits": ${w.exits}, "weight": ${w.weight} }"""
+        val events = for eventClass <- namedEventClasses.map( Some( _ ) ) ++ ( if hasAfterTransitions then Seq( None ) else Seq() ) yield
+            s"""    { "event": ${string( label( eventClass ) )},
+               |      "dispatch": ${work( dispatchWork( eventClass ) )},
+               |      "settle": ${settleWork( eventClass ).map( work ).getOrElse( "null" )} }""".stripMargin
+        s"""{
+           |  "chart": ${string( chartName )},
+           |  "cogentVersion": ${string( cogentVersion )},
+           |  "costs": { "annotated": ${! annotations.isEmpty}, "enter": ${annotations.enterCost}, "exit": ${annotations.exitCost} },
+           |  "zeroDelayCycles": [${zeroDelayCycles.map( _.map( string ).mkString( "[ ", ", ", " ]" ) ).mkString( ", " )}],
+           |  "settleTicks": ${settleTicks.map( _.toString ).getOrElse( "null" )},
+           |  "events": [
+           |${events.mkString( ",\n" )}
+           |  ]
+           |}
+           |""".stripMargin
+
+end LatencyAnalysis
+
+object LatencyAnalysis :
+
+    // Counts of work, and their weight.
+    case class Work( guards : Long, actions : Long, enters : Long, exits : Long, weight : Long ) :
+        def +( that : Work ) : Work =
+            Work( guards + that.guards, actions + that.actions, enters + that.enters, exits + that.exits, weight + that.weight )
+        def *( n : Long ) : Work = Work( guards * n, actions * n, enters * n, exits * n, weight * n )
+        def max( that : Work ) : Work =
+            Work( guards max that.guards, actions max that.actions, enters max that.enters, exits max that.exits, weight max that.weight )
+
+    object Work :
+        val zero : Work = Work( 0, 0, 0, 0, 0 )
+
+end LatencyAnalysis
@@ -5,6 +5,7 @@ import java.io.IOException
 import net.sourceforge.plantuml.SourceFileReader
 import net.sourceforge.plantuml.BlockUml
 import net.sourceforge.plantuml.core.Diagram
+import scala.collection.mutable
 import scala.jdk.CollectionConverters._
 
 import Logger.Level._
@@ -17,6 +18,13 @@ object Main :
         val commit = gitCommit.gitCommit( )
         logger.log( Info, s"Cogent version $commit.")
         var argCounter = 0
+        var useCache = false
+        var cacheDirectoryName = ""
+        var watch = false
+        var batch = false
+        var manifestName = ""
+        var jobCount = Runtime.getRuntime().availableProcessors()
+        var logLevel : Logger.Level = Info
         if args.length == 0 then
             printHelp( logger )
             return ()
@@ -25,14 +33,100 @@ object Main :
         do
             if args(argCounter) == "--fatal" then
                 logger.setLogLevel( Fatal )
+                logLevel = Fatal
             else if args(argCounter) == "--warning" then
                 logger.setLogLevel( Warning )
+                logLevel = Warning
             else if args(argCounter) == "--info" then
                 logger.setLogLevel( Info )
+                logLevel = Info
             else if args(argCounter) == "--debug" then
                 logger.setLogLevel( Debug )
+                logLevel = Debug
             else if args(argCounter) == "--date" then
                 generationOptions.outputGenerationDate = true
+            else if args(argCounter) == "--context" then
+                generationOptions.contextStruct = true
+            else if args(argCounter) == "--style=switch" then
+                generationOptions.tableStyle = false
+            else if args(argCounter) == "--style=table" then
+                generationOptions.tableStyle = true
+            else if args(argCounter) == "--inline-transitions" then
+                generationOptions.inlineTransitions = true
+            else if args(argCounter) == "--timer-list" then
+                generationOptions.timerList = true
+            else if args(argCounter) == "--queue" || args(argCounter) == "--queue=spsc" then
+                generationOptions.queueKind = "spsc"
+            else if args(argCounter) == "--queue=mpsc" then
+                generationOptions.queueKind = "mpsc"
+            else if args(argCounter) == "--trace=strings" then
+                generationOptions.binaryTrace = false
+            else if args(argCounter) == "--trace=binary" then
+                generationOptions.binaryTrace = true
+            else if args(argCounter) == "--decode-trace" then
+                if args.length < argCounter + 3 then
+                    logger.log( Fatal, "--decode-trace needs a symbol map file and a dump file" )
+                    printHelp(logger)
+                else
+                    TraceDecoder( logger ).decode( new File( args(argCounter+1) ), new File( args(argCounter+2) ), println( _ ) )
+                return ()
+            else if args(argCounter) == "--compact" then
+                generationOptions.compact = true
+            else if args(argCounter) == "--settle-changed" then
+                generationOptions.settleChanged = true
+            else if args(argCounter) == "--snapshot" then
+                generationOptions.snapshot = true
+            else if args(argCounter) == "--bench" then
+                generationOptions.bench = true
+            else if args(argCounter) == "--profile" then
+                generationOptions.profile = true
+            else if args(argCounter) == "--profile-report" then
+                if args.length < argCounter + 3 then
+                    logger.log( Fatal, "--profile-report needs a symbol map file and a dump file" )
+                    printHelp(logger)
+                else
+                    ProfileReport( logger ).report( new File( args(argCounter+1) ), new File( args(argCounter+2) ), println( _ ) )
+                return ()
+            else if args(argCounter) == "--fleet" then
+                generationOptions.fleet = true
+            else if args(argCounter) == "--flat" then
+                generationOptions.flatLimit = 64
+            else if args(argCounter).startsWith( "--flat=" ) then
+                generationOptions.flatLimit = args(argCounter).drop( 7 ).toIntOption.getOrElse( -1 )
+                if generationOptions.flatLimit < 0 then
+                    logger.log( Fatal, s"Bad limit in ${args(argCounter)}" )
+                    printHelp(logger)
+                    return ()
+            else if args(argCounter) == "--shared-submachines" then
+                generationOptions.sharedSubmachines = true
+            else if args(argCounter) == "--latency-report" then
+                generationOptions.latencyReport = true
+            else if args(argCounter).startsWith( "--annotations=" ) then
+                generationOptions.annotationsFile = args(argCounter).drop( 14 )
+            else if args(argCounter) == "--frontend=plantuml" then
+                generationOptions.frontEnd = "plantuml"
+            else if args(argCounter) == "--frontend=native" then
+                generationOptions.frontEnd = "native"
+            else if args(argCounter) == "--frontend=check" then
+                generationOptions.frontEnd = "check"
+            else if args(argCounter) == "--cache" then
+                useCache = true
+            else if args(argCounter).startsWith( "--cache=" ) then
+                useCache = true
+                cacheDirectoryName = args(argCounter).drop( 8 )
+            else if args(argCounter) == "--watch" then
+                watch = true
+            else if args(argCounter) == "--batch" then
+                batch = true
+            else if args(argCounter).startsWith( "--manifest=" ) then
+                batch = true
+                manifestName = args(argCounter).drop( 11 )
+            else if args(argCounter).startsWith( "--jobs=" ) then
+                jobCount = args(argCounter).drop( 7 ).toIntOption.getOrElse( 0 )
+                if jobCount < 1 then
+                    logger.log( Fatal, s"Bad number of jobs in ${args(argCounter)}" )
+                    printHelp(logger)
+                    return ()
             else if args(argCounter) == "--help" then
                 printHelp(logger)
                 return ()
@@ -43,45 +137,237 @@ object Main :
             end if
             argCounter += 1
         end while
+        // A fleet needs a context per machine and a mailbox that any thread can post to.
+        if generationOptions.fleet then
+            if generationOptions.queueKind == "spsc" then
+                logger.log( Fatal, "--fleet needs the multi-producer queue, so it can not be used with --queue=spsc" )
+                return ()
+            generationOptions.contextStruct = true
+            generationOptions.queueKind = "mpsc"
+        end if
         logger.log( Debug, s"args.length is ${args.length}")
         for i <- 0 until args.length do
             logger.log( Info, s"args($i) is ${args(i)}")
+        def cacheFor( chartLogger : Logger, outFile : File ) : Option[CompileCache] =
+            if ! useCache then None
+            else if generationOptions.outputGenerationDate then
+                chartLogger.info( "--cache has no effect with --date, since the output changes every time." )
+                None
+            else
+                val directory = if cacheDirectoryName.nonEmpty then new File( cacheDirectoryName )
+                                else new File( outFile.getAbsoluteFile().getParentFile(), ".cogent-cache" )
+                Some( CompileCache( chartLogger, directory ) )
+        if batch then
+            if watch then
+                logger.log( Fatal, "--watch can not be used with --batch or --manifest" )
+                return ()
+            val named = args.drop( argCounter ).toSeq.map( name => ChartJob( name, name + ".puml", name + ".c" ) )
+            val listed = if manifestName.isEmpty then Seq() else readManifest( logger, new File( manifestName ) )
+            if logger.hasFatality then return ()
+            val jobs = named ++ listed
+            if jobs.isEmpty then
+                logger.log( Fatal, "No charts to compile" )
+                return ()
+            if ! buildAll( logger, logLevel, generationOptions, commit, jobs, jobCount, cacheFor ) then
+                System.exit( 1 )
+            return ()
+        end if
         val chartName : String = if( args != null && args.length > argCounter ) then args(argCounter) else "foo"
         val inFileName : String = if args != null && args.length > (argCounter+1) then args(argCounter+1) else chartName + ".puml"
         var outFileName : String = if args != null && args.length > (argCounter+2) then args(argCounter+2) else chartName + ".c"
         logger.log( Info, s"Chart name:   ${chartName}" )
         logger.log( Info, s"Source file:  ${inFileName}" )
         logger.log( Info, s"Target file:  ${outFileName}" )
-        val f : File = new File( inFileName )
-        if ! f.exists() then
-            logger.log( Fatal, s"Input file ${f} does not exist.")
-            return ()
+        val outFile = new File( outFileName )
+        val cacheOpt = cacheFor( logger, outFile )
+        if watch then
+            watchAndBuild( logger, generationOptions, commit, chartName, new File( inFileName ), outFile, cacheOpt )
+        else
+            build( logger, generationOptions, commit, chartName, new File( inFileName ), outFile, cacheOpt )
+    end main
+
+    // A chart to compile in batch mode.
+    private case class ChartJob( chartName : String, inFileName : String, outFileName : String )
+
+    // Each line of a manifest names a chart, and optionally its source and output files,
+    // as on the command line. Files are relative to the manifest's directory. Blank lines
+    // and lines that start with # are ignored.
+    private def readManifest( logger : Logger, manifest : File ) : Seq[ChartJob] =
+        val lines =
+            try java.nio.file.Files.readAllLines( manifest.toPath() ).asScala.toSeq
+            catch case e : IOException =>
+                logger.log( Fatal, s"Can not read the manifest ${manifest}: ${e.getMessage()}" )
+                return Seq()
+        val directory = manifest.getAbsoluteFile().getParentFile()
+        def resolve( name : String ) : String =
+            if new File( name ).isAbsolute() then name else new File( directory, name ).getPath()
+        for line <- lines.map( _.trim ) if line.nonEmpty && ! line.startsWith( "#" ) yield
+            line.split( "\\s+" ).toSeq match
+                case Seq( name ) => ChartJob( name, resolve( name + ".puml" ), resolve( name + ".c" ) )
+                case Seq( name, in ) => ChartJob( name, resolve( in ), resolve( name + ".c" ) )
+                case Seq( name, in, out, rest* ) =>
+                    if rest.nonEmpty then logger.warning( s"Ignoring ${rest.mkString( " " )} in the manifest line for $name" )
+                    ChartJob( name, resolve( in ), resolve( out ) )
+
+    // Builds the charts on a pool of threads. Each chart has its own logger, and its
+    // messages are logged together, marked with its name, once it is done. The charts'
+    // messages come in the order the charts were given.
+    // Returns true if every chart was compiled without fatal errors.
+    private def buildAll( logger : Logger, logLevel : Logger.Level, generationOptions : GenerationOptions, commit : String,
+                          jobs : Seq[ChartJob], jobCount : Int,
+                          cacheFor : (Logger, File) => Option[CompileCache] ) : Boolean =
+        import scala.concurrent.{Await, ExecutionContext, Future}
+        import scala.concurrent.duration.Duration
+        logger.info( s"Compiling ${jobs.size} charts, ${jobCount} at a time." )
+        val pool = java.util.concurrent.Executors.newFixedThreadPool( jobCount )
+        given ExecutionContext = ExecutionContext.fromExecutorService( pool )
+        try
+            val started = for job <- jobs yield
+                val chartLogger = BufferedLogger( logLevel )
+                val result = Future {
+                    val outFile = new File( job.outFileName )
+                    try build( chartLogger, generationOptions.copy, commit, job.chartName, new File( job.inFileName ),
+                               outFile, cacheFor( chartLogger, outFile ) )
+                    catch case e : Exception =>
+                        chartLogger.log( Fatal, s"Exception while building ${e.getMessage()} ${e}" )
+                        false }
+                ( job, chartLogger, result )
+            val failed = mutable.ArrayBuffer[String]()
+            for (job, chartLogger, result) <- started do
+                val succeeded = Await.result( result, Duration.Inf )
+                chartLogger.replay( logger, s"${job.chartName}: " )
+                if ! succeeded then failed += job.chartName
+            end for
+            if failed.isEmpty then
+                logger.info( s"All ${jobs.size} charts were compiled." )
+            else
+                logger.log( Fatal, s"${failed.size} of ${jobs.size} charts failed: ${failed.mkString( ", " )}" )
+            failed.isEmpty
+        finally pool.shutdown()
+
+    // Puts the cached output in place when the cache has it for these sources and options.
+    // Otherwise compiles the chart, and caches the output if there were no fatal errors.
+    // Returns true if there were no fatal errors.
+    private[cogent] def build( logger : Logger, generationOptions : GenerationOptions, commit : String, chartName : String,
+                               inFile : File, outFile : File, cacheOpt : Option[CompileCache] ) : Boolean =
+        if ! inFile.exists() then
+            logger.log( Fatal, s"Input file ${inFile} does not exist.")
+            return false
+        val keyOpt = cacheOpt.map( _.key( Seq( commit, generationOptions.fingerprint, chartName, outFile.getName() ),
+                                          CompileCache.sources( inFile ) ++ annotationSources( generationOptions ) ) )
+        val entryOpt = for cache <- cacheOpt ; key <- keyOpt ; entry <- cache.lookup( key ) yield entry
+        entryOpt match
+            case Some( entry ) =>
+                logger.info( "The sources have not changed since they were compiled. Using the cached output." )
+                for (level, message) <- entry.messages do logger.log( level, message )
+                val outDir = outFile.getAbsoluteFile().getParentFile()
+                for file <- entry.files do
+                    if OutputFiles.copy( file, new File( outDir, file.getName() ) ) then
+                        logger.info( s"Updated ${file.getName()}" )
+                logger.log( Info, "Code generation complete." )
+                true
+            case None =>
+                val recorder = CompileCache.RecordingLogger( logger )
+                val written = compile( recorder, generationOptions, commit, chartName, inFile, outFile )
+                if ! recorder.hasFatality then
+                    for cache <- cacheOpt ; key <- keyOpt do cache.store( key, written, recorder.recorded.toSeq )
+                ! recorder.hasFatality
 
-        val sfr : SourceFileReader = 
+    // Builds, and then builds again each time the source file or a file that it includes
+    // changes, until the program is stopped. The files are looked at four times a second.
+    private def watchAndBuild( logger : Logger, generationOptions : GenerationOptions, commit : String, chartName : String,
+                               inFile : File, outFile : File, cacheOpt : Option[CompileCache] ) : Unit =
+        logger.info( s"Watching ${inFile} and the files it includes. Stop with Ctrl-C." )
+        var lastStamp = Seq[(String, Long, Long)]()
+        while true do
+            lastStamp = watchStep( logger, generationOptions, commit, chartName, inFile, outFile, cacheOpt, lastStamp )
+            Thread.sleep( 250 )
+        end while
+
+    // One look at the sources for watchAndBuild. Builds if they differ from the last look,
+    // whose stamp is given, and returns their stamp.
+    private[cogent] def watchStep( logger : Logger, generationOptions : GenerationOptions, commit : String, chartName : String,
+                                   inFile : File, outFile : File, cacheOpt : Option[CompileCache],
+                                   lastStamp : Seq[(String, Long, Long)] ) : Seq[(String, Long, Long)] =
+        val sources = ( if inFile.exists() then CompileCache.sources( inFile ) else Seq( inFile ) ) ++
+                      annotationSources( generationOptions )
+        val stamp = sources.map( f => ( f.getPath(), f.lastModified(), f.length() ) )
+        if stamp != lastStamp then
+            // compile turns off the options that do not apply to the chart, so each build gets a fresh copy.
+            try build( logger, generationOptions.copy, commit, chartName, inFile, outFile, cacheOpt )
+            catch case e : Exception => logger.log( Fatal, s"Exception while building ${e.getMessage()} ${e}" )
+            logger.info( "Waiting for changes." )
+        end if
+        stamp
+
+    // The annotation file is a source of the generated code, like the chart's own files.
+    private def annotationSources( generationOptions : GenerationOptions ) : Seq[File] =
+        if generationOptions.annotationsFile.isEmpty then Seq() else Seq( new File( generationOptions.annotationsFile ) )
+
+    private val plantUmlLock = new Object
+
+    // PlantUML keeps some global state, such as the directory that includes are found in,
+    // so charts compiled at the same time are parsed one at a time.
+    private[cogent] def parse( logger : Logger, f : File ) : Option[java.util.List[BlockUml]] = plantUmlLock.synchronized {
+        val sfrOpt : Option[SourceFileReader] = 
             try
-                new SourceFileReader( f )
+                Some( new SourceFileReader( f ) )
             catch (e : Throwable) =>
                 logger.log( Fatal, s"Exception making SourceFileReader ${e.getMessage()} ${e}" )
-                return ()
-
-        // Step 0. Parse
-        logger.info( "Parsing with PlantUML" ) 
-        var blockList : java.util.List[BlockUml] =
+                None
+        sfrOpt.flatMap{ sfr =>
+            logger.info( "Parsing with PlantUML" ) 
             try
-                sfr.getBlocks()
+                val blocks = sfr.getBlocks()
+                // The diagrams are made when they are first asked for, so make them here too.
+                blocks.forEach( block => try block.getDiagram() catch case e : Throwable => () )
+                Some( blocks )
             catch 
                 case (e : IOException) =>
                     logger.log( Fatal, s"IOException getting blocklist ${e.getMessage()} ${e}" )
-                    return ()
+                    None
                 case (e : Throwable) =>
                     logger.log( Fatal, s"Exception getting blocklist ${e.getMessage()} ${e}" )
-                    return ()
-        
-        // Step 1: Create a list of StateChart objects
-        val blocks = blockList.asScala
-        logger.info( "Parsing successful. Extracting statecharts." ) 
+                    None }
+    }
+
+    // Reads the source again with the native front end, and reports a fatal error if it
+    // fails or finds statecharts other than those PlantUML found.
+    private def checkNativeFrontEnd( logger : Logger, chartName : String, f : File, fromPlantUml : List[StateChart] ) : Unit =
+        val nativeLogger = BufferedLogger( Logger.Level.Debug )
+        val fromNative = NativeFrontEnd( nativeLogger ).processFile( f, chartName )
+        if nativeLogger.hasFatality then
+            nativeLogger.replay( logger, "native front end: " )
+            logger.log( Fatal, "The native front end could not read the source, though PlantUML could." )
+        else
+            val differences = NativeFrontEnd.differences( fromPlantUml, fromNative )
+            if differences.isEmpty then
+                logger.info( s"The native front end found the same ${fromNative.size} statecharts as PlantUML." )
+            else
+                differences.foreach( logger.info( _ ) )
+                logger.log( Fatal, s"The native front end and PlantUML disagree on ${differences.size} points." )
+
+    // Compiles the chart in the source file. Returns the files that were written.
+    private def compile( logger : Logger, generationOptions : GenerationOptions, commit : String, chartName : String,
+                         f : File, outFile : File ) : Seq[File] =
+        val written = mutable.ArrayBuffer[File]()
+
+        // Step 0 and 1: Parse, and create a list of StateChart objects
         val middleEnd = MiddleEnd( logger ) 
-        val stateChartList = middleEnd.processBlocks( blocks, chartName )
+        val stateChartList =
+            if generationOptions.frontEnd == "native" then
+                NativeFrontEnd( logger ).processFile( f, chartName )
+            else
+                var blockList : java.util.List[BlockUml] =
+                    parse( logger, f ) match
+                        case Some( blocks ) => blocks
+                        case None => return written.toSeq
+                val blocks = blockList.asScala
+                logger.info( "Parsing successful. Extracting statecharts." ) 
+                val charts = middleEnd.processBlocks( blocks, chartName )
+                if generationOptions.frontEnd == "check" && ! logger.hasFatality then
+                    checkNativeFrontEnd( logger, chartName, f, charts )
+                charts
         if ! logger.hasFatality then
             if stateChartList.size == 0 then
                 logger.log( Fatal, "No statecharts to process")
@@ -105,16 +391,109 @@ object Main :
                     logger.info( "Preparation complete. Checking for errors.")
                     val checker = Checker( logger )
                     checker.check( stateChart )
+                    if generationOptions.annotationsFile.nonEmpty then
+                        generationOptions.annotations = Annotations.read( logger, new File( generationOptions.annotationsFile ) )
+                        generationOptions.annotations.check( logger, stateChart )
+                        if generationOptions.tableStyle && generationOptions.annotations.pureGuards.nonEmpty then
+                            logger.info( "Pure guards are not remembered in table-driven code, though their costs are used." )
+                    // Step 3a: Optionally bound the work of a dispatch. A cycle of after( 0 ms )
+                    // transitions is a fatal error, but the report is written anyway.
+                    if generationOptions.latencyReport && ! logger.hasFatality then
+                        val analysis = LatencyAnalysis( logger, stateChart, generationOptions.annotations )
+                        val reportFile = new File( outFile.getAbsoluteFile().getParentFile(), s"${chartName}_latency.json" )
+                        logger.log( Info, s"Latency report: ${reportFile}" )
+                        OutputFiles.write( reportFile, "UTF-8" ){ _.print( analysis.report( chartName, commit ) ) }
+                        written += reportFile
+                        analysis.summary.foreach( logger.info( _ ) )
+                        analysis.check()
+                    // Step 3b: Optionally flatten small charts
+                    val flatChartOpt =
+                        if generationOptions.flatLimit > 0 && ! generationOptions.tableStyle && ! logger.hasFatality then
+                            logger.info( "Flattening the chart." )
+                            Flattener( logger, generationOptions.flatLimit ).flatten( stateChart )
+                        else None
+                    // Compact storage is only for the hierarchical switch code.
+                    if generationOptions.compact && ( generationOptions.tableStyle || flatChartOpt.nonEmpty ) then
+                        logger.info( "--compact has no effect on table-driven or flat code." )
+                        generationOptions.compact = false
+                    // Step 3c: Optionally let the instances of submachines share code. This lays
+                    // out the global indices again, so it must come before any code is generated.
+                    val sharingOpt =
+                        if ! generationOptions.sharedSubmachines || logger.hasFatality then None
+                        else if generationOptions.tableStyle || flatChartOpt.nonEmpty || generationOptions.inlineTransitions
+                                || generationOptions.compact || generationOptions.timerList
+                                || generationOptions.binaryTrace || generationOptions.profile then
+                            logger.info( "--shared-submachines has no effect on table-driven or flat code, or with --inline-transitions," +
+                                         " --compact, --timer-list, --trace=binary or --profile." )
+                            generationOptions.sharedSubmachines = false
+                            None
+                        else
+                            val sharing = SharedSubmachines( logger, stateChart )
+                            sharing.layOut()
+                            if sharing.shared.isEmpty then
+                                logger.info( "No submachine has instances that can share code." )
+                                None
+                            else Some( sharing )
                     if ! logger.hasFatality then
                         // Step 4: Convert to a C file
                         logger.log( Info, "Checking complete. Code generation begins." )
-                        val outFile = new File( outFileName )
-                        import java.io.PrintWriter
-                        val cout = COutputter( new PrintWriter( outFile ) )
-                        val backend = Backend( logger, cout, generationOptions )
-                        backend.generateCCode( stateChart, chartName, commit ) 
+                        val backend = writeFile( logger, outFile, written ){ cout =>
+                            val backend = Backend( logger, cout, generationOptions, flatChartOpt, sharingOpt )
+                            backend.generateCCode( stateChart, chartName, commit ) 
+                            backend }
+                        if generationOptions.compact then
+                            backend.memoryReport( stateChart ).foreach( logger.info( _ ) )
+                        if sharingOpt.nonEmpty then
+                            backend.sharingReport( stateChart, commit ).foreach( logger.info( _ ) )
+                        if generationOptions.snapshot then
+                            logger.log( Info, s"Snapshots take at most ${backend.snapshotSize( stateChart )} bytes." )
+                        if generationOptions.contextStruct then
+                            val headerFile = new File( outFile.getAbsoluteFile().getParentFile(), backend.contextHeaderName )
+                            logger.log( Info, s"Context header: ${headerFile}" )
+                            writeFile( logger, headerFile, written ){ out =>
+                                Backend( logger, out, generationOptions, flatChartOpt ).generateContextHeader( stateChart, chartName, commit ) }
+                        if generationOptions.binaryTrace || generationOptions.profile then
+                            val symbolFile = new File( outFile.getAbsoluteFile().getParentFile(), s"${chartName}_symbols.txt" )
+                            logger.log( Info, s"Symbol map: ${symbolFile}" )
+                            OutputFiles.write( symbolFile, "UTF-8" ){ _.print( backend.symbols( stateChart ).text ) }
+                            written += symbolFile
+                        if generationOptions.queueKind.nonEmpty then
+                            val outDir = outFile.getAbsoluteFile().getParentFile()
+                            val queueHeaderFile = new File( outDir, s"${chartName}_queue.h" )
+                            val queueCodeFile = new File( outDir, s"${chartName}_queue.c" )
+                            logger.log( Info, s"Queue files: ${queueHeaderFile} ${queueCodeFile}" )
+                            writeFile( logger, queueHeaderFile, written ){ out =>
+                                QueueBackend( logger, out, generationOptions ).generateQueueHeader( chartName, commit ) }
+                            writeFile( logger, queueCodeFile, written ){ out =>
+                                QueueBackend( logger, out, generationOptions ).generateQueueCode( chartName, commit ) }
+                        if generationOptions.fleet then
+                            val outDir = outFile.getAbsoluteFile().getParentFile()
+                            val fleetHeaderFile = new File( outDir, s"${chartName}_fleet.h" )
+                            val fleetCodeFile = new File( outDir, s"${chartName}_fleet.c" )
+                            logger.log( Info, s"Fleet files: ${fleetHeaderFile} ${fleetCodeFile}" )
+                            writeFile( logger, fleetHeaderFile, written ){ out =>
+                                FleetBackend( logger, out, generationOptions ).generateFleetHeader( chartName, commit ) }
+                            writeFile( logger, fleetCodeFile, written ){ out =>
+                                FleetBackend( logger, out, generationOptions ).generateFleetCode( chartName, commit ) }
+                        if generationOptions.bench then
+                            val benchFile = new File( outFile.getAbsoluteFile().getParentFile(), s"${chartName}_bench.c" )
+                            logger.log( Info, s"Benchmark: ${benchFile}" )
+                            writeFile( logger, benchFile, written ){ out =>
+                                BenchBackend( logger, out, generationOptions ).generateBench( stateChart, chartName, commit, outFile.getName() ) }
                         logger.log( Info, "Code generation complete." )
-    end main
+        written.toSeq
+    end compile
+
+    // The outputter buffers its lines, and the file is only replaced if its content changed.
+    private def writeFile[T]( logger : Logger, file : File, written : mutable.Buffer[File] )( generate : COutputter => T ) : T =
+        var result : Option[T] = None
+        val changed = OutputFiles.write( file ){ writer =>
+            val out = COutputter( writer )
+            result = Some( generate( out ) )
+            out.close }
+        if ! changed then logger.debug( s"${file} is unchanged." )
+        written += file
+        result.get
 
     private def printHelp( logger : Logger ) : Unit = 
         logger.setLogLevel( Info )
@@ -128,6 +507,52 @@ object Main :
         logger.info( "    --info    - fatal, warning and info messages are reported. This is the default." )
         logger.info( "    --debug   - debug messages are also reported" )
         logger.info( "    --date    - the date and time of code generation are placed in the generated file" )
+        logger.info( "    --context - all machine state is kept in a context struct declared in chartName_context.h;" )
+        logger.info( "                every generated function, action and guard takes a pointer to it" )
+        logger.info( "    --style=switch - generate nested switch statements and if commands. This is the default." )
+        logger.info( "    --style=table  - generate constant tables and a small interpreter for them;" )
+        logger.info( "                     the interpreter has a fixed size, so this is larger than the usual code" )
+        logger.info( "                     on small charts and can be smaller on large ones; it is slower" )
+        logger.info( "    --inline-transitions - expand the enter and exit functions in place in each transition" )
+        logger.info( "    --timer-list - keep the running 'after' timers in a list sorted by deadline, so that a TICK" )
+        logger.info( "                   only visits states with expired timers" )
+        logger.info( "    --queue[=spsc|mpsc] - also generate chartName_queue.h and chartName_queue.c: a lock-free" )
+        logger.info( "                   event queue for one (spsc, the default) or many (mpsc) producers" )
+        logger.info( "                   and a drain function that dispatches and settles queued events" )
+        logger.info( "    --trace=binary - trace into a ring buffer of 8 byte records instead of calling the LOG_ macros" )
+        logger.info( "                     with strings, and write the symbol map chartName_symbols.txt" )
+        logger.info( "    --trace=strings - call the LOG_ macros with strings. This is the default." )
+        logger.info( "    --decode-trace symbolMap dumpFile - print a dump of the trace ring buffer, then exit" )
+        logger.info( "    --compact - store the state in as little RAM as possible, and report the memory used" )
+        logger.info( "    --settle-changed - dispatchAndSettle_chartName revisits only the regions that changed in the previous" )
+        logger.info( "                   step, at the cost of a change stamp per state that every dispatch keeps" )
+        logger.info( "    --snapshot - generate snapshot_chartName and restore_chartName, to save and restore the configuration" )
+        logger.info( "    --bench - write chartName_bench.c, a program that times dispatching with stub guards and actions" )
+        logger.info( "    --profile - count and time each transition, guard and action, and write the symbol map" )
+        logger.info( "    --profile-report symbolMap dumpFile - print the profile counters, busiest first, then exit" )
+        logger.info( "    --fleet   - also generate chartName_fleet.h and chartName_fleet.c: a runtime that runs many" )
+        logger.info( "                machines on a pool of threads, with work stealing. Implies --context and --queue=mpsc" )
+        logger.info( "    --flat[=N] - if the chart has no AND states and at most N reachable configurations (default 64)," )
+        logger.info( "                 generate a flat state machine with one case per configuration" )
+        logger.info( "    --shared-submachines - the instances of a submachine that is used more than once share the code" )
+        logger.info( "                for the states inside them, and the savings are reported" )
+        logger.info( "    --annotations=FILE - read 'guard name [pure] [cost=N]' and 'action name cost=N' lines from FILE." )
+        logger.info( "                A pure guard is evaluated at most once per dispatch, and the operands of 'and' and 'or'" )
+        logger.info( "                are tried cheapest first where that can not change what the guard does" )
+        logger.info( "    --latency-report - write chartName_latency.json, the most guards, actions, entries and exits," )
+        logger.info( "                and their weight by the annotated costs, of a dispatch of each event class" )
+        logger.info( "    --frontend=plantuml - read the source with PlantUML. This is the default." )
+        logger.info( "    --frontend=native - read the source with Cogent's own, faster reader of the state diagram subset" )
+        logger.info( "    --frontend=check - read the source both ways and report a fatal error if the statecharts differ" )
+        logger.info( "    --cache[=DIR] - keep the generated files in DIR (default .cogent-cache beside the output file)," )
+        logger.info( "                    keyed by a hash of the sources and options, and reuse them when nothing changed" )
+        logger.info( "    --watch   - stay running, and generate the code again whenever the source file or a file" )
+        logger.info( "                that it includes changes" )
+        logger.info( "    --batch   - compile each of the chartNames that follow, from chartName.puml to chartName.c," )
+        logger.info( "                several at a time. The exit status is 1 if any chart fails" )
+        logger.info( "    --manifest=FILE - compile the charts listed in FILE, one 'chartName [inputFile [outputFile]]'" )
+        logger.info( "                per line, in batch mode" )
+        logger.info( "    --jobs=N  - in batch mode, compile N charts at a time (default: the number of processors)" )
         logger.info( "    --help    - print this message and exit")
         logger.info( "To generate png files use:")
         logger.info( "    java -cp cogent.jar net.sourceforge.plantuml.Run *.puml" )
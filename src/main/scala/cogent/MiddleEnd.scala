@@ -281,17 +281,21 @@ class MiddleEnd(val logger : Logger) :
         if plantStereotype == null then
             return cogent.Stereotype.None
         else
-            plantStereotype.toString() match {
-                case "<<submachine>>" => cogent.Stereotype.Submachine
-                case "<<entrypoint>>" => cogent.Stereotype.EntryPoint
-                case "<<exitpoint>>" => cogent.Stereotype.ExitPoint
-                case "<<choice>>" => cogent.Stereotype.Choice
-                case _ =>
-                    logger.info( s"Node $name has an unknown stereotype ${plantStereotype.toString}. The stereotype will be ignored.")
-                    cogent.Stereotype.None
-            }
+            stereotypeNamed( plantStereotype.toString(), name )
     }
 
+    // The stereotype written as text, such as <<choice>>. Also used by the native front end.
+    def stereotypeNamed( text : String, name : String ) : cogent.Stereotype =
+        text match {
+            case "<<submachine>>" => cogent.Stereotype.Submachine
+            case "<<entrypoint>>" => cogent.Stereotype.EntryPoint
+            case "<<exitpoint>>" => cogent.Stereotype.ExitPoint
+            case "<<choice>>" => cogent.Stereotype.Choice
+            case _ =>
+                logger.info( s"Node $name has an unknown stereotype ${text}. The stereotype will be ignored.")
+                cogent.Stereotype.None
+        }
+
     def filterLeaves( leaves : Seq[ILeaf] ) : Seq[ILeaf] =
         leaves.filter( (leaf) =>
             val name = leaf.getCode().getName()
@@ -371,30 +375,36 @@ class MiddleEnd(val logger : Logger) :
                 val targetNode = entityToNodeMap.apply( target )
                 val label = link.getLabel()
                 val labelAsString = display2String( label ) 
-                var result : parsers.ParseResult[(Option[Trigger], Option[Guard], Seq[Action] )] =
-                    try
-                        parsers.parseEdgeLabel(labelAsString)
-                    catch (e : Throwable) =>
-                        // This shouldn't happen, but if it does, we want to know what happened.
-                        val message = s"Unexpected exception ${e.toString} while parsing edge label <<${labelAsString}>>."
-                        parsers.Error( message, null )
-                    end try
-                logger.log( Debug, s"Parser input <<${labelAsString}>>")
-                logger.log( Debug, s"Parser result ${result}.")
-                val edge = result match
-                    case parsers.Success( (triggerOpt, guardOpt, actions), _ ) =>
-                        Edge(sourceNode, targetNode, triggerOpt, guardOpt, actions ) 
-                    case parsers.Failure( message, _) =>
-                        reportError( message  )
-                        Edge(sourceNode, targetNode, None, None, List.empty ) 
-                    case parsers.Error( message, _) =>
-                        reportError( message  )
-                        Edge(sourceNode, targetNode, None, None, List.empty )  
+                val edge = edgeFor( sourceNode, targetNode, labelAsString )
                 edgeSet.add( edge )
             end if
         end for
     end extractEdgesFromLinks
 
+    // The edge with the given label. A label that does not parse is reported, and the
+    // edge is made without a trigger, guard or actions. Also used by the native front end.
+    def edgeFor( sourceNode : Node, targetNode : Node, labelAsString : String ) : Edge =
+        var result : parsers.ParseResult[(Option[Trigger], Option[Guard], Seq[Action] )] =
+            try
+                parsers.parseEdgeLabel(labelAsString)
+            catch (e : Throwable) =>
+                // This shouldn't happen, but if it does, we want to know what happened.
+                val message = s"Unexpected exception ${e.toString} while parsing edge label <<${labelAsString}>>."
+                parsers.Error( message, null )
+            end try
+        logger.log( Debug, s"Parser input <<${labelAsString}>>")
+        logger.log( Debug, s"Parser result ${result}.")
+        result match
+            case parsers.Success( (triggerOpt, guardOpt, actions), _ ) =>
+                Edge(sourceNode, targetNode, triggerOpt, guardOpt, actions ) 
+            case parsers.Failure( message, _) =>
+                reportError( message  )
+                Edge(sourceNode, targetNode, None, None, List.empty ) 
+            case parsers.Error( message, _) =>
+                reportError( message  )
+                Edge(sourceNode, targetNode, None, None, List.empty )  
+    end edgeFor
+
     def indexTheNodes( stateChart : StateChart ) : Unit = 
         var globalIndex = 0
         // Sort the nodes so we have OR states first, followed by other states
@@ -443,7 +453,7 @@ class MiddleEnd(val logger : Logger) :
                     end if
                 case 1 =>
                     val startMarker = startMarkers.head
-                    val edges = stateChart.edges.filter( e => e.source == startMarker )
+                    val edges = stateChart.edgesFrom( startMarker )
                     edges.size match
                         case 0 =>
                             logger.log( Info, s"Or state ${orState.getFullName} has no initial state.")
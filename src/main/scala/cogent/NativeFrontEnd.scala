@@ -0,0 +1,386 @@
+package cogent
+
+import java.io.File
+import java.nio.charset.Charset
+import java.nio.file.Files
+import scala.collection.mutable
+
+import Logger.Level._
+
+// Reads the part of PlantUML's state diagram language that Cogent uses, without running
+// PlantUML, and builds the same statecharts that MiddleEnd.processBlocks builds from
+// PlantUML's diagrams. Edge labels are parsed and stereotypes are interpreted by the
+// middle end, so the two front ends can only differ in how they read the diagram.
+//
+// Understood: @startuml ... @enduml blocks, !include, state declarations with
+// stereotypes and { } bodies, -- and || between regions, transitions with their
+// arrow styles and directions, [*], notes, state descriptions, comments, and the
+// commands that only affect the picture, such as skinparam and hide. Anything else is
+// reported as a fatal error, since PlantUML may have given it a meaning.
+class NativeFrontEnd( val logger : Logger ) :
+
+    private val middleEnd = MiddleEnd( logger )
+
+    // A line of source and where it came from.
+    private case class SourceLine( text : String, file : File, number : Int ) :
+        def location : String = s"${file.getPath()}:$number"
+
+    private enum Kind { case State; case Start; case End; case History; case ForkJoin; case Note }
+
+    // Anything in a diagram with a name. Groups are states with { } bodies, and have one
+    // region, or more if their body has -- or || in it.
+    private class Entity( val name : String, var kind : Kind, val region : Region ) :
+        var stereotype : Option[String] = None
+        var isGroup = false
+        val regions = mutable.ArrayBuffer[Region]()
+        def lastRegion : Region =
+            if regions.isEmpty then regions += Region( this )
+            regions.last
+    end Entity
+
+    private class Region( val owner : Entity ) :
+        val children = mutable.ArrayBuffer[Entity]()
+        def index : Int = owner.regions.indexOf( this )
+        // As PlantUML names the start marker of a region, except that regions after the
+        // first are named as the middle end names them.
+        def markerSuffix : String =
+            if owner.region == null then ""
+            else if index <= 0 then s"*${owner.name}"
+            else s"*${owner.name}_region_${index}"
+    end Region
+
+    private case class Link( source : String, target : String, label : String, line : SourceLine )
+
+    private val includeRX = """(?i)!include(_many|_once)?\s+(.*)""".r
+    private val includeSubRX = """(?i)!includesub\s+.*""".r
+    private val ignoredPreprocessorRX = """(?i)!(pragma|theme)\b.*""".r
+    private val startRX = """(?i)@startuml\b.*""".r
+    private val endRX = """(?i)@enduml\b.*""".r
+
+    private val namePattern = """\[\*\]|\[H\*?\]|"[^"]*"|[\p{L}\p{N}_.]+"""
+    private val arrowPattern = """(<)?-(?:\[[^\]]*\])?(?:(?:left|right|up|down|le|ri|do|l|r|u|d)(?:\[[^\]]*\])?-)?-*(?:\[[^\]]*\])?-*(>)?"""
+    private val linkRX = s"""($namePattern)\\s*(?:<<[^>]*>>\\s*)?$arrowPattern\\s*($namePattern)\\s*(?:<<[^>]*>>\\s*)?(?::\\s*(.*))?""".r
+    private val stateRX = s"""(?i)state\\s+(?:"[^"]*"\\s+as\\s+)?($namePattern)(?:\\s+as\\s+"[^"]*")?(.*)""".r
+    private val descriptionRX = s"""($namePattern)\\s*:.*""".r
+    private val noteAsRX = """(?i)note\s+"[^"]*"\s+as\s+(\S+)""".r
+    private val noteBlockAsRX = """(?i)note\s+as\s+(\S+)""".r
+    private val noteOfRX = """(?i)note\s+(?:(?:left|right|top|bottom)\s+of\s+\S+|on\s+link)\s*(:.*)?""".r
+    private val regionRX = """--+|\|\|+""".r
+    private val stereotypeRX = """<<[^>]*>>""".r
+    private val pictureOnlyRX =
+        """(?i)(hide|show|scale|title|caption|header|footer|skin|skinparam|allowmixing|left\s+to\s+right\s+direction|top\s+to\s+bottom\s+direction)\b.*""".r
+
+    // The statecharts of all the blocks in the file. The first is the chart named chartName.
+    def processFile( file : File, chartName : String ) : List[StateChart] =
+        logger.info( "Parsing with the native front end" )
+        val blocks = readBlocks( file )
+        val charts = for (block, i) <- blocks.zipWithIndex yield processBlock( block, i == 0, chartName )
+        charts.toList.flatten
+
+    // Splits the file into its blocks, with the includes in each block expanded.
+    private def readBlocks( file : File ) : Seq[Seq[SourceLine]] =
+        val blocks = mutable.ArrayBuffer[Seq[SourceLine]]()
+        var current : Option[mutable.ArrayBuffer[SourceLine]] = None
+        // The files included into the current block, for !include_once.
+        var included = mutable.Set[File]()
+        for line <- readLines( file ) do
+            line.text.trim match
+                case startRX() =>
+                    current = Some( mutable.ArrayBuffer( line ) )
+                    included = mutable.Set[File]()
+                case endRX() =>
+                    current.foreach( blocks += _.toSeq )
+                    current = None
+                case _ => current.foreach( _ ++= expand( line, Set( file.getCanonicalFile() ), included ) )
+        end for
+        if current.nonEmpty then logger.log( Fatal, s"The block that starts at ${current.get.head.location} has no @enduml" )
+        blocks.toSeq
+
+    private def readLines( file : File ) : Seq[SourceLine] =
+        try
+            val text = new String( Files.readAllBytes( file.toPath() ), Charset.defaultCharset() )
+            for (lineText, i) <- text.linesIterator.toSeq.zipWithIndex yield SourceLine( lineText, file, i + 1 )
+        catch case e : java.io.IOException =>
+            logger.log( Fatal, s"Can not read ${file}: ${e.getMessage()}" )
+            Seq()
+
+    // The line, or the lines of the file that it includes. As in PlantUML, only the first
+    // block of an included file that has blocks is included.
+    private def expand( line : SourceLine, including : Set[File], included : mutable.Set[File] ) : Seq[SourceLine] =
+        line.text.trim match
+            case includeRX( kind, target0 ) =>
+                val target = target0.trim
+                if target.startsWith( "<" ) || target.contains( "://" ) then
+                    logger.log( Warning, s"${line.location}: The native front end ignores the include of ${target}" )
+                    Seq()
+                else if target.contains( "!" ) then
+                    logger.log( Fatal, s"${line.location}: The native front end can not include part of a file. Use --frontend=plantuml" )
+                    Seq()
+                else
+                    val file = new File( line.file.getAbsoluteFile().getParentFile(), target ).getCanonicalFile()
+                    if including contains file then
+                        logger.log( Fatal, s"${line.location}: ${target} includes itself" )
+                        Seq()
+                    else if kind != null && kind.equalsIgnoreCase( "_once" ) && ( included contains file ) then
+                        Seq()
+                    else if ! file.isFile() then
+                        logger.log( Fatal, s"${line.location}: Can not find the included file ${target}" )
+                        Seq()
+                    else
+                        included += file
+                        val lines = readLines( file )
+                        val firstBlock =
+                            if ! lines.exists( l => startRX.matches( l.text.trim ) ) then lines
+                            else lines.dropWhile( l => ! startRX.matches( l.text.trim ) ).drop( 1 )
+                                      .takeWhile( l => ! endRX.matches( l.text.trim ) )
+                        firstBlock.flatMap( expand( _, including + file, included ) )
+            case includeSubRX() =>
+                logger.log( Fatal, s"${line.location}: The native front end can not include part of a file. Use --frontend=plantuml" )
+                Seq()
+            case _ => Seq( line )
+
+    private def processBlock( lines : Seq[SourceLine], isFirst : Boolean, chartName : String ) : Option[StateChart] =
+        val lineDescription = lines.head.location
+        logger.log( Info, s"Processing diagram")
+        val root = Entity( "root", Kind.State, null )
+        root.isGroup = true
+        val entities = mutable.HashMap[String, Entity]()
+        val links = mutable.ArrayBuffer[Link]()
+        // The regions that the states being declared go into, innermost first.
+        var regions = List( root.lastRegion )
+
+        // The entity with the name. As in PlantUML, names are global to the diagram, and an
+        // entity is made in the current region when its name is first used.
+        def entityNamed( name : String, kind : Kind = Kind.State ) : Entity =
+            entities.getOrElseUpdate( name, {
+                val region = regions.head
+                val entity = Entity( name, kind, region )
+                region.children += entity
+                entity } )
+
+        // [*] is a start marker as a source and an end marker as a target.
+        def endpoint( text : String, isSource : Boolean ) : String =
+            val suffix = regions.head.markerSuffix
+            val (name, kind) =
+                if text == "[*]" then
+                    if isSource then ( s"*start$suffix", Kind.Start ) else ( s"*end$suffix", Kind.End )
+                else if text.startsWith( "[H" ) then ( s"$text$suffix", Kind.History )
+                else ( text.stripPrefix( "\"" ).stripSuffix( "\"" ), Kind.State )
+            entityNamed( name, kind )
+            name
+
+        // Lines up to the one that ends the multi-line command.
+        var skipUntil : Option[String => Boolean] = None
+        var braceDepth = 0
+
+        for line <- lines.drop( 1 ) do
+            val text = line.text.trim
+            if skipUntil.nonEmpty then
+                if skipUntil.get( text ) then skipUntil = None
+            else if text.isEmpty || text.startsWith( "'" ) then ()
+            else if text.startsWith( "/'" ) then
+                if ! text.endsWith( "'/" ) || text.length < 4 then skipUntil = Some( (t : String) => t.endsWith( "'/" ) )
+            else text match
+                case regionRX() =>
+                    val region = regions.head
+                    if region.owner eq root then
+                        middleEnd.reportError( s"${line.location}: Regions must be inside a state" )
+                    else
+                        region.owner.regions += Region( region.owner )
+                        regions = region.owner.regions.last :: regions.tail
+                case "}" =>
+                    if regions.tail.isEmpty then middleEnd.reportError( s"${line.location}: Unmatched }" )
+                    else regions = regions.tail
+                case linkRX( sourceText, inverse, forward, targetText, label ) if inverse != null || forward != null =>
+                    val (s, t) = if inverse != null && forward == null then ( targetText, sourceText ) else ( sourceText, targetText )
+                    val source = endpoint( s, true )
+                    val target = endpoint( t, false )
+                    links += Link( source, target, if label == null then "" else label, line )
+                case stateRX( nameText, rest ) =>
+                    val entity = entityNamed( nameText.stripPrefix( "\"" ).stripSuffix( "\"" ) )
+                    val declaration = rest.takeWhile( _ != ':' )
+                    for stereotype <- stereotypeRX.findAllIn( declaration ) do
+                        stereotype.toLowerCase match
+                            case "<<choice>>" => entity.stereotype = Some( "<<choice>>" )
+                            case "<<start>>" => entity.kind = Kind.Start
+                            case "<<end>>" => entity.kind = Kind.End
+                            case "<<fork>>" | "<<join>>" => entity.kind = Kind.ForkJoin
+                            case "<<history>>" | "<<history*>>" => entity.kind = Kind.History
+                            case _ => entity.stereotype = Some( stereotype )
+                    // What is left may be colours, and a { that starts the state's body.
+                    val remainder = stereotypeRX.replaceAllIn( declaration, " " ).replace( "{", " { " ).split( "\\s+" ).filter( _.nonEmpty )
+                    val hasBody = remainder.lastOption.contains( "{" )
+                    if ! remainder.dropRight( if hasBody then 1 else 0 ).forall( _.startsWith( "#" ) ) then
+                        middleEnd.reportError( s"${line.location}: The native front end does not understand: ${text}. Use --frontend=plantuml" )
+                    else if hasBody then
+                        entity.isGroup = true
+                        regions = entity.lastRegion :: regions
+                case noteAsRX( name ) =>
+                    entityNamed( name, Kind.Note )
+                case noteBlockAsRX( name ) =>
+                    entityNamed( name, Kind.Note )
+                    skipUntil = Some( isEndNote )
+                case noteOfRX( oneLine ) =>
+                    middleEnd.reportWarning( s"${line.location}: Note ignored." )
+                    if oneLine == null then skipUntil = Some( isEndNote )
+                case descriptionRX( nameText ) =>
+                    // Descriptions are shown in the picture but do not change the chart.
+                    entityNamed( nameText.stripPrefix( "\"" ).stripSuffix( "\"" ) )
+                case pictureOnlyRX( command ) =>
+                    if text.endsWith( "{" ) then
+                        braceDepth = 1
+                        skipUntil = Some( (t : String) => {
+                            braceDepth += t.count( _ == '{' ) - t.count( _ == '}' )
+                            braceDepth <= 0 } )
+                    else if text.equalsIgnoreCase( command ) && Set( "title", "header", "footer" ).contains( command.toLowerCase ) then
+                        // The text is on the lines up to end title, end header or end footer.
+                        skipUntil = Some( (t : String) => t.toLowerCase.replace( " ", "" ) == s"end${command.toLowerCase}" )
+                case ignoredPreprocessorRX( _ ) => ()
+                case _ if text.toLowerCase.startsWith( "legend" ) =>
+                    skipUntil = Some( (t : String) => t.toLowerCase.replace( " ", "" ) == "endlegend" )
+                case _ =>
+                    middleEnd.reportError( s"${line.location}: The native front end does not understand: ${text}. Use --frontend=plantuml" )
+            end if
+        end for
+        if regions.tail.nonEmpty then middleEnd.reportError( s"$lineDescription: A { has no matching }" )
+
+        if entities.isEmpty then
+            logger.info( s"Diagram at $lineDescription: Diagrams without states are ignored." )
+            return None
+        constructStateChart( root, links.toSeq, lineDescription, isFirst, chartName )
+    end processBlock
+
+    private def isEndNote( text : String ) : Boolean = text.toLowerCase.replace( " ", "" ) == "endnote"
+
+    // As MiddleEnd.constructStateChart.
+    private def constructStateChart( root : Entity, links : Seq[Link], lineDescription : String,
+                                     isFirst : Boolean, chartName : String ) : Option[StateChart] =
+        // The node made for each entity, and for each region of an AND state.
+        val nodes = mutable.HashMap[AnyRef, Node]()
+        val rootStateOpt = groupNode( root, "root", 0, nodes )
+        if rootStateOpt.isEmpty then return None
+        val rootState = rootStateOpt.get
+        logger.log( Debug, s"The root of the tree is\n${rootState.show}" )
+        val nodeSet = nodes.values.toSet
+
+        val parentMutMap = new mutable.HashMap[Node,Node]
+        rootState.computeParentMap( parentMutMap )
+        val parentMap = parentMutMap.toMap
+
+        val nodeNamed = nodes.collect{ case (entity : Entity, node) => entity.name -> node }
+        val edgeSet = mutable.Set[Edge]()
+        for link <- links do
+            ( nodeNamed.get( link.source ), nodeNamed.get( link.target ) ) match
+                case ( Some( sourceNode ), Some( targetNode ) ) =>
+                    edgeSet += middleEnd.edgeFor( sourceNode, targetNode, labelString( link.label ) )
+                case _ =>
+                    middleEnd.reportWarning( s"${link.line.location}: Link from ${link.source} to ${link.target} ignored." )
+
+        val childrenOfRoot = rootState.childNodes
+        val name =
+            (if isFirst then chartName else if childrenOfRoot.isEmpty then "*unknown*" else childrenOfRoot.head.getFullName)
+        val stateChart = StateChart( name, lineDescription, rootState, nodeSet, edgeSet.toSet, parentMap, isFirst )
+        logger.log( Debug, stateChart.show )
+        Some( stateChart )
+    end constructStateChart
+
+    // PlantUML breaks labels into lines at \n, and the middle end ends each line with a newline.
+    private def labelString( label : String ) : String =
+        if label.trim.isEmpty then ""
+        else label.trim.split( """\\n""", -1 ).map( _ + "\n" ).mkString
+
+    // The children that become nodes. The others are reported as MiddleEnd.filterLeaves reports them.
+    private def relevant( children : Seq[Entity] ) : Seq[Entity] =
+        children.filter{ child =>
+            child.kind match
+                case Kind.State | Kind.Start => true
+                case Kind.Note =>
+                    middleEnd.reportWarning( s"Note ${child.name} ignored." )
+                    false
+                case Kind.End =>
+                    middleEnd.reportError( s"Found final state ${child.name}. Final state are not supported yet." )
+                    false
+                case Kind.History =>
+                    middleEnd.reportError( s"Found history ${child.name}. History pseudo-states are not supported yet." )
+                    false
+                case Kind.ForkJoin =>
+                    middleEnd.reportError( s"Found fork or join ${child.name}. Fork and join pseudo-states are not supported yet." )
+                    false }
+
+    // As MiddleEnd.extractState: a group with several regions is an AND state whose
+    // children are OR states, one per region. Other groups are OR states. Groups come
+    // before leaves among the children.
+    private def groupNode( group : Entity, name : String, depth : Int, nodes : mutable.Map[AnyRef, Node] ) : Option[Node] =
+        val stereotype = group.stereotype.map( middleEnd.stereotypeNamed( _, name ) ).getOrElse( Stereotype.None )
+        val node =
+            if group.regions.size > 1 then
+                logger.log( Debug, s"State $name identified as an AND state" )
+                val children = group.regions.toSeq.zipWithIndex.flatMap( (region, i) =>
+                    val regionNode = orNode( region.children.toSeq, s"${name}_region_${i}", Stereotype.None, depth + 1, nodes )
+                    regionNode.foreach( n => nodes( region ) = n )
+                    regionNode )
+                val st = if stereotype == Stereotype.Submachine then Stereotype.Submachine else Stereotype.None
+                Some( Node.AndState( StateInformation( name, depth, st ), children ) )
+            else
+                logger.log( Debug, s"State $name identified as an OR state" )
+                orNode( group.lastRegion.children.toSeq, name, stereotype, depth, nodes )
+        node.foreach( n => nodes( group ) = n )
+        node
+
+    private def orNode( members : Seq[Entity], name : String, stereotype : Stereotype, depth : Int,
+                        nodes : mutable.Map[AnyRef, Node] ) : Option[Node] =
+        val (groups, leaves) = relevant( members ).partition( _.isGroup )
+        if groups.isEmpty && leaves.isEmpty then
+            middleEnd.reportError( s"State $name is a group but has no children that are states" )
+            None
+        else
+            val children = groups.flatMap( g => groupNode( g, g.name, depth + 1, nodes ) )
+                        ++ leaves.map( leafNode( _, depth + 1, nodes ) )
+            Some( Node.OrState( StateInformation( name, depth, stereotype ), children ) )
+
+    private def leafNode( leaf : Entity, depth : Int, nodes : mutable.Map[AnyRef, Node] ) : Node =
+        val name = leaf.name
+        val node =
+            if leaf.kind == Kind.Start then
+                Node.StartMarker( StateInformation( name, depth, Stereotype.None ) )
+            else
+                val stereotype = leaf.stereotype.map( middleEnd.stereotypeNamed( _, name ) ).getOrElse( Stereotype.None )
+                val stateInfo = StateInformation( name, depth, stereotype )
+                stereotype match
+                    case Stereotype.Choice => Node.ChoicePseudoState( stateInfo )
+                    case Stereotype.EntryPoint => Node.EntryPointPseudoState( stateInfo )
+                    case Stereotype.ExitPoint => Node.ExitPointPseudoState( stateInfo )
+                    case Stereotype.Submachine | Stereotype.None => Node.BasicState( stateInfo )
+        nodes( leaf ) = node
+        node
+
+end NativeFrontEnd
+
+object NativeFrontEnd :
+
+    // What the check of the two front ends compares: each chart's name, its nodes with
+    // their kinds, depths, stereotypes and parents, and its edges. The order of children
+    // does not matter. Start markers are named by their parents, since PlantUML names
+    // those in regions with a sequence number of its own.
+    def describe( chart : StateChart ) : Set[String] =
+        def nameOf( node : Node ) : String =
+            if node.isStartMarker then s"start of ${nameOf( chart.parentOf( node ) )}"
+            else node.getFullName
+        def parentOf( node : Node ) : String =
+            chart.parentMap.get( node ).map( nameOf ).getOrElse( "nothing" )
+        val nodes = for node <- chart.nodeSet yield
+            s"${node.productPrefix} ${nameOf( node )} at depth ${node.getDepth} <<${node.getStereotype}>> in ${parentOf( node )}"
+        val edges = for edge <- chart.edgeSet yield
+            s"edge ${nameOf( edge.source )} -- ${edge.triggerOpt.getOrElse( "" )} ${edge.guardOpt.getOrElse( "" )} / ${edge.actions.mkString( ";" )} --> ${nameOf( edge.target )}"
+        Set( s"chart ${chart.name}${if chart.isFirst then " (first)" else ""}" ) ++ nodes ++ edges
+
+    // How the charts from the native front end differ from those from PlantUML.
+    def differences( fromPlantUml : Seq[StateChart], fromNative : Seq[StateChart] ) : Seq[String] =
+        if fromPlantUml.size != fromNative.size then
+            Seq( s"PlantUML found ${fromPlantUml.size} statecharts and the native front end found ${fromNative.size}" )
+        else
+            fromPlantUml.zip( fromNative ).flatMap( (p, n) =>
+                ( describe( p ) diff describe( n ) ).toSeq.sorted.map( d => s"${p.name}: only PlantUML has $d" )
+                ++ ( describe( n ) diff describe( p ) ).toSeq.sorted.map( d => s"${n.name}: only the native front end has $d" ) )
+
+end NativeFrontEnd
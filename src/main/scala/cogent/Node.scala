@@ -231,7 +231,8 @@ class StateInformation( val fullName : String, val depth : Int, val stereotype :
     private var globalIndex : Option[Int] = None
     private var cName : Option[String] = None
     private var initialState : Option[Node] = None
-
+    // For the top state of a copy of a submachine, the name of the submachine.
+    private var submachine : Option[String] = None
 
     def copy( newFullName : String, newDepth : Int, newStereotype : Stereotype ) = {
         val result = StateInformation( newFullName, newDepth, newStereotype ) 
@@ -242,6 +243,7 @@ class StateInformation( val fullName : String, val depth : Int, val stereotype :
         globalIndex.map( x => result.setGlobalIndex( x ) )
         cName.map( x => result.setCName( x ) )
         initialState.map( x => result.setInitialState( x ) )
+        submachine.map( x => result.setSubmachine( x ) )
         result
     }
 
@@ -276,4 +278,8 @@ class StateInformation( val fullName : String, val depth : Int, val stereotype :
     def getInitialState = initialState.head
 
     def setInitialState( state : Node ) : Unit = { initialState = Some(state) }
+
+    def submachineOpt : Option[String] = submachine
+
+    def setSubmachine( name : String ) : Unit = { submachine = Some(name) }
 end StateInformation
\ No newline at end of file
@@ -0,0 +1,45 @@
+package cogent
+
+import java.io.{File, PrintWriter}
+import java.nio.file.{Files, StandardCopyOption}
+
+// Generated files are written beside their targets and moved into place only when their
+// content differs, so a build that depends on them is not redone for nothing.
+object OutputFiles :
+
+    // Writes the file with the generator. Returns true if the file changed.
+    def write( file : File, charset : String = java.nio.charset.Charset.defaultCharset.name )
+             ( generate : PrintWriter => Unit ) : Boolean =
+        val temporary = temporaryFor( file )
+        val writer = new PrintWriter( temporary, charset )
+        try generate( writer )
+        catch case e : Throwable =>
+            writer.close()
+            temporary.delete()
+            throw e
+        writer.close()
+        replace( temporary, file )
+
+    // Copies from into file. Returns true if the file changed.
+    def copy( from : File, file : File ) : Boolean =
+        val temporary = temporaryFor( file )
+        Files.copy( from.toPath, temporary.toPath, StandardCopyOption.REPLACE_EXISTING )
+        replace( temporary, file )
+
+    private def temporaryFor( file : File ) : File =
+        val directory = file.getAbsoluteFile.getParentFile
+        File.createTempFile( s".${file.getName}.", ".tmp", directory )
+
+    private def replace( temporary : File, file : File ) : Boolean =
+        if sameContent( temporary, file ) then
+            Files.delete( temporary.toPath )
+            false
+        else
+            Files.move( temporary.toPath, file.toPath, StandardCopyOption.REPLACE_EXISTING )
+            true
+
+    private def sameContent( a : File, b : File ) : Boolean =
+        b.isFile && a.length == b.length &&
+            java.util.Arrays.equals( Files.readAllBytes( a.toPath ), Files.readAllBytes( b.toPath ) )
+
+end OutputFiles
@@ -2,34 +2,51 @@ package cogent
 
 import java.io.PrintWriter
 import scala.collection.mutable
+import scala.concurrent.{Await, ExecutionContext, Future}
+import scala.concurrent.duration.Duration
 
+// Lines are written to the writer as they are finished. The writer is only flushed by close.
+//
+// Independent parts of the output can be rendered on several threads with inParts. Each
+// part is rendered into a buffer of its own, and the buffers are written in order, so the
+// output is the same as if the parts had been rendered one after another.
 class Outputter( val writer : PrintWriter ) :
 
-    protected val lines = mutable.ArrayBuffer[String]()
-    protected var currentLine = mutable.StringBuilder()
-    protected var atStartOfLine = true
-    protected var indentation = 0
-    
+    // Where the lines being rendered go, and the state of the line being built.
+    protected class Target( val finishLine : String => Unit, var indentation : Int ) :
+        var currentLine = mutable.StringBuilder()
+        var atStartOfLine = true
+    end Target
+
+    private val mainTarget = Target( writer.println( _ ), 0 )
+
+    // Set on the threads that are rendering a part.
+    private val partTarget = ThreadLocal[Target]()
+
+    protected def target : Target =
+        val t = partTarget.get
+        if t == null then mainTarget else t
+
     def putLine( str : String ) : Unit = {
         put( str )
         endLine
     }
 
     def put( str :  String ) : Unit = {
-        if atStartOfLine then
-            currentLine.append("    "*indentation)
-            atStartOfLine = false
+        val t = target
+        if t.atStartOfLine then
+            t.currentLine.append("    "*t.indentation)
+            t.atStartOfLine = false
         end if
-        currentLine.append( str )
+        t.currentLine.append( str )
     }
 
     def endLine : Unit = {
-        if ! atStartOfLine then
-            lines += currentLine.toString
-            writer.println( currentLine.toString )
-            writer.flush()
-            currentLine = mutable.StringBuilder()
-            atStartOfLine = true
+        val t = target
+        if ! t.atStartOfLine then
+            t.finishLine( t.currentLine.toString )
+            t.currentLine = mutable.StringBuilder()
+            t.atStartOfLine = true
         end if
     }
 
@@ -39,13 +56,42 @@ class Outputter( val writer : PrintWriter ) :
         endLine
     }
 
-    def indent : Unit = indentation += 1
+    def indent : Unit = target.indentation += 1
 
-    def dedent : Unit = {assert( indentation > 0 ) ; indentation -= 1 ; }
+    def dedent : Unit = {assert( target.indentation > 0 ) ; target.indentation -= 1 ; }
 
     def indented( contents : => Unit) : Unit = {
         indent
         contents
         dedent
     }
+
+    // Renders each item as a part and writes the parts in order. Each part must start and
+    // end at the start of a line, at the same indentation. The parts run on the shared pool
+    // only when there is more than one, no part is being rendered already, and the output
+    // is at the start of a line; otherwise they run here, one after another.
+    def inParts[A]( items : Seq[A] )( render : A => Unit ) : Unit = {
+        val t = target
+        if items.size < 2 || ( t ne mainTarget ) || ! t.atStartOfLine then
+            items.foreach( render )
+        else
+            given ExecutionContext = ExecutionContext.global
+            val parts = for item <- items yield Future {
+                val text = mutable.StringBuilder()
+                val part = Target( line => text.append( line ).append( System.lineSeparator ), t.indentation )
+                partTarget.set( part )
+                try
+                    render( item )
+                    assert( part.atStartOfLine && part.indentation == t.indentation )
+                    text.toString
+                finally partTarget.remove()
+            }
+            for part <- parts do writer.print( Await.result( part, Duration.Inf ) )
+        end if
+    }
+
+    def close : Unit = {
+        endLine
+        writer.close()
+    }
 end Outputter
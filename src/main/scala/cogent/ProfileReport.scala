@@ -0,0 +1,51 @@
+package cogent
+
+import java.io.File
+
+import SymbolMap.littleEndian
+
+// Turns a dump of the profile counters, as written by profileDump_<chart>, into a
+// report of the transitions, guards and actions, busiest first, named as in the chart.
+class ProfileReport( val logger : Logger ) :
+
+    private case class Counter( id : Int, count : Long, trues : Long, time : Long )
+
+    def report( mapFile : File, dumpFile : File, emit : String => Unit ) : Unit =
+        SymbolMap.readWithDump( logger, mapFile, dumpFile, "CGPF", 20, "profile dump" ) match
+            case None => ()
+            case Some( (map, bytes) ) =>
+                val counts = ( 0 until 3 ).map( i => littleEndian( bytes, 8 + 4 * i, 4 ).toInt )
+                if bytes.length < 20 + 24 * counts.sum then
+                    logger.fatal( s"${dumpFile} is truncated." )
+                    return ()
+                var at = 20
+                def readTable( n : Int ) : Seq[Counter] =
+                    for i <- 0 until n yield
+                        val counter = Counter( i, littleEndian( bytes, at, 8 ), littleEndian( bytes, at + 8, 8 ), littleEndian( bytes, at + 16, 8 ) )
+                        at += 24
+                        counter
+                val edges = readTable( counts(0) )
+                val guards = readTable( counts(1) )
+                val actions = readTable( counts(2) )
+                // Without a PROFILE_CLOCK all the times are 0, so rank by count instead.
+                val timed = ( edges ++ guards ++ actions ).exists( _.time != 0 )
+                def section( title : String, kind : String, counters : Seq[Counter], withTrues : Boolean ) : Unit =
+                    val names = map.getOrElse( kind, Map() )
+                    emit( title )
+                    val header = f"${"count"}%12s" + ( if withTrues then f"  ${"true"}%12s" else "" ) +
+                                 ( if timed then f"  ${"time"}%14s  ${"mean"}%10s" else "" )
+                    emit( s"$header  name" )
+                    val ranked = counters.filter( _.count > 0 ).sortBy( c => ( -( if timed then c.time else c.count ), c.id ) )
+                    for c <- ranked do
+                        val name = names.getOrElse( c.id, s"<unknown $kind ${c.id}>" )
+                        val line = f"${c.count}%12d" + ( if withTrues then f"  ${c.trues}%12d" else "" ) +
+                                   ( if timed then f"  ${c.time}%14d  ${c.time.toDouble / c.count}%10.1f" else "" )
+                        emit( s"$line  $name" )
+                    val never = counters.size - ranked.size
+                    if never > 0 then emit( s"    ($never never run)" )
+                    emit( "" )
+                section( "Transitions", "edge", edges, false )
+                section( "Guards", "guard", guards, true )
+                section( "Actions", "action", actions, false )
+
+end ProfileReport
@@ -0,0 +1,233 @@
+package cogent
+
+// Generates the optional companion files chartName_queue.h and chartName_queue.c.
+// They provide a fixed-capacity ring buffer of events, a post function that
+// producers (including interrupt handlers) can call without locks, and a drain
+// function that dispatches queued events in batches, settling after each one.
+//
+// The single-producer queue needs only atomic loads and stores, so it is safe
+// between one interrupt handler (or thread) and the main loop on targets without
+// compare-and-swap. The multi-producer queue uses C11 compare-and-swap on the
+// tail and a sequence number per slot.
+class QueueBackend( override val logger : Logger, override val out : COutputter, override val generationOptions : GenerationOptions )
+    extends Backend( logger, out, generationOptions ) :
+
+    private def multiProducer : Boolean = generationOptions.queueKind == "mpsc"
+
+    private def upperName : String = chartName.toUpperCase
+
+    private def capacityMacro : String = s"${upperName}_QUEUE_CAPACITY"
+
+    private def settleStepsMacro : String = s"${upperName}_SETTLE_STEPS"
+
+    private def queueTypeName : String = s"${chartName}_queue_t"
+
+    // In context mode each machine has its own queue, so the queue is passed explicitly.
+    // Otherwise there is one static queue in the generated C file.
+    private def queueParam : String =
+        if generationOptions.contextStruct then s"$queueTypeName *q, " else ""
+
+    private def queueOnlyParam : String =
+        if generationOptions.contextStruct then s"$queueTypeName *q" else "void"
+
+    private def queue : String =
+        if generationOptions.contextStruct then "q" else s"(&${chartName}_queue)"
+
+    def queueHeaderName : String = s"${chartName}_queue.h"
+
+    def generateQueueHeader( chartName : String, cogentVersion : String ) : Unit = {
+        this.chartName = chartName
+        val guardMacroName = s"${upperName}_QUEUE_H"
+        generateComment( cogentVersion )
+        out.comment( s"Include this file after the declarations of $boolType, $eventType and $timeType (if not the default)." )
+        out.blankLine
+        out.putLine( s"#ifndef $guardMacroName" )
+        out.putLine( s"#define $guardMacroName" )
+        out.blankLine
+        if generationOptions.contextStruct then
+            out.putLine( s"#include \"${contextHeaderName}\"" )
+            out.blankLine
+        end if
+        // Only the queue for many producers claims positions with compare-and-swap.
+        val casMacro =
+            if multiProducer then
+                "\n    #define QUEUE_CAS_WEAK(p, expected, desired) atomic_compare_exchange_weak_explicit( (p), (expected), (desired), memory_order_relaxed, memory_order_relaxed )"
+            else ""
+        out.putLines( s"""|#ifndef $timeType
+                          |    #define $timeType unsigned int
+                          |#endif
+                          |
+                          |/* The number of slots. It must be a power of 2. */
+                          |#ifndef $capacityMacro
+                          |    #define $capacityMacro 16
+                          |#endif
+                          |
+                          |/* The most TICKs dispatched to settle the machine after each event. */
+                          |#ifndef $settleStepsMacro
+                          |    #define $settleStepsMacro 16
+                          |#endif
+                          |
+                          |/* Atomic access to the queue positions. Define these in the preamble for
+                          | * compilers without C11 atomics; for a single core with an interrupt
+                          | * handler as the producer, volatile accesses and a compiler barrier suffice. */
+                          |#ifndef QUEUE_POSITION_T
+                          |    #include <stdatomic.h>
+                          |    #define QUEUE_POSITION_T atomic_uint
+                          |    #define QUEUE_LOAD_RELAXED(p) atomic_load_explicit( (p), memory_order_relaxed )
+                          |    #define QUEUE_LOAD_ACQUIRE(p) atomic_load_explicit( (p), memory_order_acquire )
+                          |    #define QUEUE_STORE_RELEASE(p, v) atomic_store_explicit( (p), (v), memory_order_release )
+                          |    #define QUEUE_STORE_RELAXED(p, v) atomic_store_explicit( (p), (v), memory_order_relaxed )$casMacro
+                          |#endif
+                          |""".stripMargin )
+        out.blankLine
+        if multiProducer then
+            out.putLines( s"""|/* A slot is free for the producer that claims position p when its sequence is p,
+                              | * and full for the consumer when its sequence is p + 1. */
+                              |typedef struct ${chartName}_queue_slot_s {
+                              |    QUEUE_POSITION_T sequence ;
+                              |    $eventType event ;
+                              |} ${chartName}_queue_slot_t ;
+                              |
+                              |typedef struct ${chartName}_queue_s {
+                              |    /* The next position to claim; shared by the producers. */
+                              |    QUEUE_POSITION_T tail ;
+                              |    /* The next position to dispatch; written only by the consumer. */
+                              |    QUEUE_POSITION_T head ;
+                              |    ${chartName}_queue_slot_t slots_a[ $capacityMacro ] ;
+                              |} $queueTypeName ;""".stripMargin )
+        else
+            out.putLines( s"""|typedef struct ${chartName}_queue_s {
+                              |    /* The next position to dispatch; written only by the consumer. */
+                              |    QUEUE_POSITION_T head ;
+                              |    /* The next position to fill; written only by the producer. */
+                              |    QUEUE_POSITION_T tail ;
+                              |    $eventType events_a[ $capacityMacro ] ;
+                              |} $queueTypeName ;""".stripMargin )
+        end if
+        out.blankLine
+        out.putLine( s"void initQueue_${chartName}( ${queueOnlyParam} ) ;" )
+        out.putLine( s"${boolType} post_${chartName}( ${queueParam}const ${eventType} *${eventPointerName} ) ;" )
+        out.putLine( s"int drain_${chartName}( ${contextParam}${queueParam}$timeType $now, int budget ) ;" )
+        out.putLine( s"${boolType} pending_${chartName}( ${queueOnlyParam} ) ;" )
+        out.blankLine
+        out.putLine( s"#endif" )
+    }
+
+    def generateQueueCode( chartName : String, cogentVersion : String ) : Unit = {
+        this.chartName = chartName
+        val q = queue
+        generateComment( cogentVersion )
+        generateInclude( chartName )
+        out.putLine( s"#include \"${queueHeaderName}\"" )
+        out.blankLine
+        out.putLines( s"""|#if ( $capacityMacro & ( $capacityMacro - 1 ) ) != 0
+                          |    #error "$capacityMacro must be a power of 2"
+                          |#endif
+                          |#define QUEUE_MASK ( $capacityMacro - 1u )
+                          |""".stripMargin )
+        out.blankLine
+        if ! generationOptions.contextStruct then
+            out.putLine( s"${boolType} dispatchAndSettle_${chartName}( ${eventType} *${eventPointerName}, $timeType $now, int maxSteps, int *steps_p ) ;" )
+            out.blankLine
+            out.putLine( s"static $queueTypeName ${chartName}_queue ;" )
+            out.blankLine
+        end if
+
+        out.comment( "Empties the queue. Call it before any producer can post." )
+        out.endLine
+        out.put( s"void initQueue_${chartName}( ${queueOnlyParam} ) " )
+        out.block{
+            if multiProducer then
+                out.putLine( "unsigned i ;" )
+                out.putLine( s"for( i = 0 ; i < $capacityMacro ; ++i ) QUEUE_STORE_RELAXED( &$q->slots_a[ i ].sequence, i ) ;" )
+                out.putLine( s"QUEUE_STORE_RELAXED( &$q->tail, 0 ) ;" )
+                out.put( s"QUEUE_STORE_RELAXED( &$q->head, 0 ) ;" )
+            else
+                out.putLine( s"QUEUE_STORE_RELAXED( &$q->head, 0 ) ;" )
+                out.put( s"QUEUE_STORE_RELAXED( &$q->tail, 0 ) ;" )
+        }
+
+        out.blankLine
+        if multiProducer then
+            out.comment( "Copies the event into the queue. Any number of producers may call this concurrently." )
+        else
+            out.comment( "Copies the event into the queue. Only one producer may call this, e.g. one interrupt handler." )
+        out.endLine
+        out.comment( "Returns false, and drops the event, if the queue is full." )
+        out.endLine
+        out.put( s"${boolType} post_${chartName}( ${queueParam}const ${eventType} *${eventPointerName} ) " )
+        out.block{
+            if multiProducer then
+                out.putLines( s"""|unsigned pos = QUEUE_LOAD_RELAXED( &$q->tail ) ;
+                                  |${chartName}_queue_slot_t *slot_p ;
+                                  |for( ;; ) {
+                                  |    int diff ;
+                                  |    slot_p = &$q->slots_a[ pos & QUEUE_MASK ] ;
+                                  |    diff = (int)( QUEUE_LOAD_ACQUIRE( &slot_p->sequence ) - pos ) ;
+                                  |    if( diff == 0 ) {
+                                  |        if( QUEUE_CAS_WEAK( &$q->tail, &pos, pos + 1 ) ) break ;
+                                  |    } else if( diff < 0 ) {
+                                  |        return $falseConst ;
+                                  |    } else {
+                                  |        pos = QUEUE_LOAD_RELAXED( &$q->tail ) ;
+                                  |    }
+                                  |}
+                                  |slot_p->event = *${eventPointerName} ;
+                                  |QUEUE_STORE_RELEASE( &slot_p->sequence, pos + 1 ) ;""".stripMargin )
+            else
+                out.putLines( s"""|unsigned tail = QUEUE_LOAD_RELAXED( &$q->tail ) ;
+                                  |if( tail - QUEUE_LOAD_ACQUIRE( &$q->head ) == $capacityMacro ) return $falseConst ;
+                                  |$q->events_a[ tail & QUEUE_MASK ] = *${eventPointerName} ;
+                                  |QUEUE_STORE_RELEASE( &$q->tail, tail + 1 ) ;""".stripMargin )
+            out.put( s"return $trueConst ;" )
+        }
+
+        val dispatch = s"dispatchAndSettle_${chartName}( ${contextArg}"
+        out.blankLine
+        out.comment( "Dispatches up to budget queued events, in order, settling the machine after each." )
+        out.endLine
+        out.comment( "Events are dispatched in place and their slots are freed as soon as they have been handled." )
+        out.endLine
+        out.comment( "Returns the number of events dispatched. Only one consumer may call this." )
+        out.endLine
+        out.put( s"int drain_${chartName}( ${contextParam}${queueParam}$timeType $now, int budget ) " )
+        out.block{
+            out.putLine( "int count = 0 ;" )
+            if multiProducer then
+                out.putLines( s"""|unsigned head = QUEUE_LOAD_RELAXED( &$q->head ) ;
+                                  |while( count < budget ) {
+                                  |    ${chartName}_queue_slot_t *slot_p = &$q->slots_a[ head & QUEUE_MASK ] ;
+                                  |    if( QUEUE_LOAD_ACQUIRE( &slot_p->sequence ) != head + 1 ) break ;
+                                  |    ${dispatch}&slot_p->event, $now, $settleStepsMacro, 0 ) ;
+                                  |    QUEUE_STORE_RELEASE( &slot_p->sequence, head + $capacityMacro ) ;
+                                  |    head += 1 ;
+                                  |    QUEUE_STORE_RELAXED( &$q->head, head ) ;
+                                  |    count += 1 ;
+                                  |}""".stripMargin )
+            else
+                // The tail is read once per batch, which is enough to drain a burst.
+                out.putLines( s"""|unsigned head = QUEUE_LOAD_RELAXED( &$q->head ) ;
+                                  |unsigned tail = QUEUE_LOAD_ACQUIRE( &$q->tail ) ;
+                                  |while( count < budget && head != tail ) {
+                                  |    ${dispatch}&$q->events_a[ head & QUEUE_MASK ], $now, $settleStepsMacro, 0 ) ;
+                                  |    head += 1 ;
+                                  |    QUEUE_STORE_RELEASE( &$q->head, head ) ;
+                                  |    count += 1 ;
+                                  |}""".stripMargin )
+            out.put( "return count ;" )
+        }
+
+        out.blankLine
+        out.comment( "Returns true if an event is waiting to be dispatched." )
+        out.endLine
+        out.put( s"${boolType} pending_${chartName}( ${queueOnlyParam} ) " )
+        out.block{
+            out.putLine( s"unsigned head = QUEUE_LOAD_RELAXED( &$q->head ) ;" )
+            if multiProducer then
+                out.put( s"return QUEUE_LOAD_ACQUIRE( &$q->slots_a[ head & QUEUE_MASK ].sequence ) == head + 1 ;" )
+            else
+                out.put( s"return QUEUE_LOAD_ACQUIRE( &$q->tail ) != head ;" )
+        }
+    }
+
+end QueueBackend
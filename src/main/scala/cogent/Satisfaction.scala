@@ -1,8 +1,12 @@
 package cogent
 
 import cogent.Logger
-import scala.compiletime.ops.int
 
+// Answers the questions the backend asks about guards: can this be true, must it be,
+// can two be true together, does one imply another. Atoms are the guards that are not
+// built from others; two atoms are the same when they are equal as guards. The answers
+// come from binary decision diagrams (see Bdd); findAtoms and evaluate give the
+// truth-table meaning that they must agree with.
 object Satisfaction {
     def findAtoms(logger : Logger, guard : Guard ) : Set[Guard] = {
         guard match {
@@ -51,43 +55,42 @@ object Satisfaction {
         }
     }
 
+    // Each thread keeps its own diagrams, so the caches carry over from one query to the
+    // next. They are dropped once they grow past a limit, between queries.
+    private val nodeLimit = 1 << 20
+
+    private val diagrams = ThreadLocal.withInitial[Bdd]( () => Bdd() )
+
+    private def bdd : Bdd =
+        if diagrams.get.size > nodeLimit then diagrams.set( Bdd() )
+        diagrams.get
+
     def is_satisfiable( logger : Logger, guard : Guard ) : Boolean = {
-        val atoms = findAtoms( logger, guard )
-        val atomList = List.from(atoms)
-        val n = atomList.size
-        val interps : LazyList[Map[Guard,Boolean]] = 
-            for i <- LazyList.range(0,(1<<n)) yield (
-                Map.from( for j <- 0 until n yield
-                    (atomList(j), 0 != ((1<<j)&i) )))
-        interps.exists( (sigma) => evaluate(guard, sigma))
+        bdd.of( logger, guard ) != Bdd.FALSE
     }
 
     def is_tautology( logger : Logger, g0 : Guard ) : Boolean = {
-        ! is_satisfiable( logger, Guard.NotGuard(g0) )
+        bdd.of( logger, g0 ) == Bdd.TRUE
     }
 
     def ambiguity( logger : Logger, g0 : Guard, g1 : Guard) : Boolean = {
-        is_satisfiable( logger, Guard.AndGuard(g0, g1) )
+        val b = bdd
+        b.and( b.of( logger, g0 ), b.of( logger, g1 ) ) != Bdd.FALSE
     }
 
     def possibly_none( logger: Logger, gs : Iterable[Guard] ) : Boolean = {
-        if gs.isEmpty then
-            true
-        else
-            val disjunction = gs.reduce((g0, g1) => Guard.OrGuard(g0, g1))
-            is_satisfiable( logger, Guard.NotGuard(disjunction) )
+        val b = bdd
+        gs.foldLeft( Bdd.FALSE )( (u, g) => b.or( u, b.of( logger, g ) ) ) != Bdd.TRUE
     }
 
     def definitely_at_least_one( logger: Logger, gs : Iterable[Guard] ) : Boolean = {
-        if gs.isEmpty then
-            false
-        else
-            val disjunction = gs.reduce((g0, g1) => Guard.OrGuard(g0, g1))
-            is_tautology( logger, disjunction )
+        val b = bdd
+        gs.nonEmpty && gs.foldLeft( Bdd.FALSE )( (u, g) => b.or( u, b.of( logger, g ) ) ) == Bdd.TRUE
     }
 
     def entails( logger : Logger, g0 : Guard, g1 : Guard ) : Boolean = {
-        is_tautology( logger, Guard.ImpliesGuard(g0, g1) )
+        val b = bdd
+        b.and( b.of( logger, g0 ), b.not( b.of( logger, g1 ) ) ) == Bdd.FALSE
     }
 
     def sort_by_entailment( logger : Logger, es : Seq[Edge] ) = {
@@ -0,0 +1,184 @@
+package cogent
+
+import scala.collection.mutable
+
+// Lets the instances of a submachine share one copy of the code for the states inside them.
+//
+// The combiner expands each use of a submachine into a copy of the same expanded definition,
+// so the nodes of the instances correspond one to one, child by child. Instance 0 stands for
+// all of them: the shared code is generated from its nodes and is given the number of the
+// instance to work on.
+//
+// The shared code finds the states of an instance through their global indices, so those are
+// laid out again. The OR states of the instances of a submachine are put together, instance
+// after instance, each in the same order, and likewise the other states. The global index of
+// a state of instance k is then first + k * size + offset, where offset is the index of the
+// corresponding state of instance 0 less first.
+//
+// Only the states below an instance's top state are shared. The top state, and the
+// transitions that enter and leave the instance through its entry and exit points, which
+// differ from one use of the submachine to the next, are generated for each instance.
+class SharedSubmachines( val logger : Logger, val stateChart : StateChart ) :
+    import SharedSubmachines.Shared
+
+    private val sharedList = mutable.ArrayBuffer[Shared]()
+
+    // For each node of a shared instance: the submachine, the instance number and the position.
+    private val places = mutable.HashMap[Node, (Shared, Int, Int)]()
+
+    // The submachines whose instances share code.
+    def shared : Seq[Shared] = sharedList.toSeq
+
+    // For a node of a shared instance, top state included: the submachine, the instance
+    // number, and the corresponding node of instance 0.
+    def placeOf( node : Node ) : Option[(Shared, Int, Node)] =
+        places.get( node ).map( (shared, instance, position) => (shared, instance, shared.members( position )) )
+
+    // Whether the code of the node is shared, that is, it is below the top state of an instance.
+    def isShared( node : Node ) : Boolean = places.get( node ).exists( _._3 > 0 )
+
+    // Chooses the submachines whose instances share code, and lays out the global indices of
+    // their states. This must be done once, after the middle end has indexed the nodes, and
+    // before any code is generated.
+    def layOut() : Unit =
+        val topsByName = stateChart.nodes.filter( _.stateInfo.submachineOpt.nonEmpty )
+                                         .groupBy( _.stateInfo.submachineOpt.get ).toSeq
+        // Larger submachines first, so that a submachine that is used inside a shared one is
+        // shared along with it.
+        val candidates = topsByName.sortBy( (name, tops) => ( - nodesBelow( tops.head ).size, name ) )
+        val claimed = mutable.HashSet[Node]()
+        val chosen = mutable.ArrayBuffer[(String, Seq[Node], Seq[Seq[Node]])]()
+        for (name, allTops) <- candidates do
+            val tops = allTops.filter( top => ! claimed.contains( top ) )
+            if tops.size > 1 then
+                val instances = tops.map( top => top +: nodesBelow( top ) )
+                whyNotShared( instances ) match
+                    case Some( reason ) =>
+                        logger.info( s"The instances of submachine $name do not share code: $reason." )
+                    case None =>
+                        chosen += ( (name, tops, instances) )
+                        instances.foreach( claimed ++= _ )
+            end if
+        end for
+
+        val states = stateChart.nodes.filter( _.isState ).sortBy( _.getGlobalIndex )
+        def block( orStates : Boolean ) : Seq[Node] =
+            states.filter( s => s.isOrState == orStates && ! claimed.contains( s ) ) ++
+            chosen.toSeq.flatMap( (_, _, instances) => instances.flatten.filter( s => s.isState && s.isOrState == orStates ) )
+        val pseudoStates = stateChart.nodes.filter( ! _.isState ).sortBy( _.getGlobalIndex )
+        for (node, index) <- ( block( true ) ++ block( false ) ++ pseudoStates ).zipWithIndex do
+            logger.debug( s"Mapping ${node.getFullName} to $index" )
+            node.setGlobalIndex( index )
+
+        for (name, tops, instances) <- chosen do
+            val orStates = instances.head.filter( _.isOrState )
+            val otherStates = instances.head.filter( s => s.isState && ! s.isOrState )
+            val shared = Shared( name, tops, instances, wiredPositions( instances ),
+                                 orStates.headOption.map( _.getGlobalIndex ).getOrElse( 0 ), orStates.size,
+                                 otherStates.headOption.map( _.getGlobalIndex ).getOrElse( 0 ), otherStates.size )
+            sharedList += shared
+            for (instance, k) <- instances.zipWithIndex ; (node, position) <- instance.zipWithIndex do
+                places( node ) = (shared, k, position)
+            logger.info( s"The ${tops.size} instances of submachine $name share the code of ${otherStates.size + orStates.size - 1} states." )
+        end for
+    end layOut
+
+    // The nodes below a node, parents before children.
+    private def nodesBelow( node : Node ) : Seq[Node] =
+        node.childNodes.flatMap( child => child +: nodesBelow( child ) )
+
+    // A transition is internal to an instance if it stays below the instance's top state.
+    private def isInternal( edge : Edge, top : Node, inside : collection.Set[Node] ) : Boolean =
+        inside.contains( edge.source ) && inside.contains( edge.target ) && {
+            val leastCommonOr = stateChart.leastCommonOrOf( edge.source, edge.target )
+            leastCommonOr == top || inside.contains( leastCommonOr ) }
+
+    // Why the instances can not share code, if they can not.
+    private def whyNotShared( instances : Seq[Seq[Node]] ) : Option[String] =
+        val template = instances.head
+        def sameShape( a : Node, b : Node ) : Boolean =
+            a.ordinal == b.ordinal && a.childNodes.size == b.childNodes.size && a.getLocalIndex == b.getLocalIndex
+        val insides = instances.map( _.tail.toSet )
+        // A transition from a state must stay inside, since the code for the state is shared.
+        // A transition from a choice may leave; it is then generated for each instance.
+        val leaving = instances.lazyZip( insides ).flatMap( (instance, inside) =>
+            instance.tail.filter( _.isState ).flatMap( stateChart.edgesFrom )
+                         .filter( ! isInternal( _, instance.head, inside ) ) )
+        def keys( instance : Seq[Node], inside : Set[Node] ) : Seq[Seq[String]] =
+            val positions = instance.zipWithIndex.toMap
+            instance.map( node => stateChart.edgesFrom( node ).filter( isInternal( _, instance.head, inside ) )
+                                                               .map( edgeKey( _, positions ) ).sorted )
+        lazy val templateKeys = keys( template, insides.head )
+        if instances.exists( instance => instance.size != template.size ||
+                                         ! instance.lazyZip( template ).forall( sameShape ) ) then
+            Some( "the copies differ" )
+        else if leaving.nonEmpty then
+            Some( s"the transition ${leaving.head} leaves the submachine" )
+        else if instances.lazyZip( insides ).exists( (instance, inside) => keys( instance, inside ) != templateKeys ) then
+            Some( "the transitions of the copies differ" )
+        else None
+
+    // An edge, with the nodes of its instance replaced by their positions.
+    private def edgeKey( edge : Edge, positions : Map[Node, Int] ) : String =
+        def place( node : Node ) : String =
+            positions.get( node ).map( p => s"#$p" ).getOrElse( node.getFullName )
+        def guardKey( guard : Guard ) : String =
+            guard match
+                case Guard.InGuard( name ) => s"in ${stateChart.stateNamed( name ).map( place ).getOrElse( name )}"
+                case Guard.NotGuard( operand ) => s"not (${guardKey( operand )})"
+                case Guard.AndGuard( left, right ) => s"(${guardKey( left )}) and (${guardKey( right )})"
+                case Guard.OrGuard( left, right ) => s"(${guardKey( left )}) or (${guardKey( right )})"
+                case Guard.ImpliesGuard( left, right ) => s"(${guardKey( left )}) ==> (${guardKey( right )})"
+                case _ => guard.toString
+        s"${edge.triggerOpt.getOrElse( "" )}|${edge.guardOpt.map( guardKey ).getOrElse( "" )}|" +
+        s"${edge.actions.mkString( ";" )}|${place( edge.target )}"
+
+    // The positions of the choices with a transition that leaves its instance, in any instance.
+    private def wiredPositions( instances : Seq[Seq[Node]] ) : Seq[Int] =
+        val wired = for instance <- instances yield
+            val inside = instance.tail.toSet
+            instance.indices.filter( p => p > 0 && instance( p ).isChoicePseudostate &&
+                stateChart.edgesFrom( instance( p ) ).exists( ! isInternal( _, instance.head, inside ) ) )
+        wired.flatten.distinct.sorted
+
+end SharedSubmachines
+
+object SharedSubmachines :
+
+    // A submachine whose instances share code. instances( k ) is the top state of instance k
+    // followed by the nodes below it, and corresponding nodes are at the same position in
+    // each. The OR states of instance k start at global index orFirst + k * orSize, and its
+    // other states at first + k * size. wired are the positions of the choices from which a
+    // transition leaves the instance.
+    class Shared( val name : String, val tops : Seq[Node], val instances : Seq[Seq[Node]], val wired : Seq[Int],
+                  val orFirst : Int, val orSize : Int, val first : Int, val size : Int ) :
+
+        def top : Node = tops.head
+
+        def members : Seq[Node] = instances.head
+
+        val cName : String = name.map( c => if c.isLetterOrDigit && c < 128 || c == '_' then c else '_' )
+
+        private lazy val positions : Map[Node, Int] = members.zipWithIndex.toMap
+
+        def positionOf( member : Node ) : Int = positions( member )
+
+        // The index of a state of instance 0 in its instance's block.
+        def offsetOf( member : Node ) : Int =
+            member.getGlobalIndex - ( if member.isOrState then orFirst else first )
+
+        // The members' names in the submachine, as far as they can be recovered from the names
+        // that the combiner gave the members of instance 0, which end with the name of the
+        // submachine and then the same suffix as the top state's. These name the shared functions.
+        private lazy val localNames : Map[Node, String] =
+            val suffix = s"__$name${top.getFullName.stripPrefix( name )}"
+            val names = members.map( member =>
+                val c = member.getCName
+                s"${cName}_${if c.endsWith( suffix ) then c.dropRight( suffix.length ) else c}" )
+            if names.distinct.size == names.size then members.zip( names ).toMap
+            else members.map( member => member -> s"${cName}_${member.getCName}" ).toMap
+
+        def localName( member : Node ) : String = localNames( member )
+    end Shared
+
+end SharedSubmachines
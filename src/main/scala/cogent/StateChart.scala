@@ -14,7 +14,58 @@ class StateChart(
 
     val nodes : Seq[Node] = nodeSet.toSeq.sortBy( _.getFullName )
 
-    val edges : Seq[Edge] = edgeSet.toSeq.sortBy( _.toString )
+    // An edge's string is costly to build, so it is built once per edge rather than per comparison.
+    val edges : Seq[Edge] = edgeSet.toSeq.map( e => (e.toString, e) ).sortBy( _._1 ).map( _._2 )
+
+    // The work done through the indices below: one for each lookup, and one for each node
+    // or edge that an index is built from or that a lookup returns. Passes that use the
+    // indices as they should do work in proportion to the size of the chart.
+    private val workCount = java.util.concurrent.atomic.AtomicLong()
+
+    def work : Long = workCount.get
+
+    private def counted[T]( items : Seq[T] ) : Seq[T] =
+        workCount.addAndGet( 1 + items.size )
+        items
+
+    // Indices over the edges. Each list keeps the order of edges, so that a pass that uses
+    // an index sees the same edges in the same order as one that filters edges.
+    private lazy val outgoing : Map[Node, Seq[Edge]] = counted( edges ).groupBy( _.source )
+
+    private lazy val incoming : Map[Node, Seq[Edge]] = counted( edges ).groupBy( _.target )
+
+    private lazy val outgoingByTrigger : Map[(Node, Trigger), Seq[Edge]] =
+        counted( edges ).filter( _.triggerOpt.nonEmpty ).groupBy( e => (e.source, e.triggerOpt.get) )
+
+    private lazy val childStateMap : Map[Node, Seq[Node]] =
+        counted( nodes ).map( n => n -> n.childStates ).toMap
+
+    // The edges that leave the node.
+    def edgesFrom( node : Node ) : Seq[Edge] = counted( outgoing.getOrElse( node, Seq() ) )
+
+    // The edges that enter the node.
+    def edgesInto( node : Node ) : Seq[Edge] = counted( incoming.getOrElse( node, Seq() ) )
+
+    // The edges that leave the node on the given trigger.
+    def edgesFromOn( node : Node, trigger : Trigger ) : Seq[Edge] =
+        counted( outgoingByTrigger.getOrElse( (node, trigger), Seq() ) )
+
+    // The children of the node that are states.
+    def childStatesOf( node : Node ) : Seq[Node] = counted( childStateMap.getOrElse( node, node.childStates ) )
+
+    // The state with the given C name. C names are only set by the middle end, so this
+    // must not be used before then.
+    def stateNamed( cName : String ) : Option[Node] =
+        workCount.incrementAndGet()
+        stateByCName.get( cName )
+
+    private lazy val stateByCName : Map[String, Node] =
+        counted( nodes ).filter( _.isState ).map( n => n.getCName -> n ).toMap
+
+    // The depth is kept in the node's state information, so it needs no index.
+    def depthOf( node : Node ) : Int =
+        workCount.incrementAndGet()
+        node.getDepth
 
     val description = s"${if isFirst then "Statechart" else "Submachine"} $name at $location"
 
@@ -33,8 +84,8 @@ class StateChart(
     def parentOf( node : Node ) : Node = parentMap( node ) 
 
     def leastCommonOrOf( source : Node, target : Node ) : Node =
-        assert( nodes contains source)
-        assert( nodes contains target)
+        assert( nodeSet contains source)
+        assert( nodeSet contains target)
         assert( source != root )
         assert( target != root )
         var p = source
@@ -43,9 +94,9 @@ class StateChart(
         p = parentMap(p) 
         q = parentMap(q)
         // Climb up from the deeper one until p and q are at the same depth.
-        while( p.getDepth > q.getDepth ) p = parentMap(p)
-        while( q.getDepth > p.getDepth ) q = parentMap(q)
-        assert( p.getDepth == q.getDepth )
+        while( depthOf(p) > depthOf(q) ) p = parentMap(p)
+        while( depthOf(q) > depthOf(p) ) q = parentMap(q)
+        assert( depthOf(p) == depthOf(q) )
         // Keep climbing until we have a common ancestor that is an Or.
         // Since the root is an or state, this must exist.
         while( p != q || ! p.isOrState ) { p = parentMap(p) ; q = parentMap(q) }
@@ -0,0 +1,120 @@
+package cogent
+
+import java.io.{File, IOException}
+import java.nio.file.Files
+
+// Numbers for the states, edges, guards and actions of a chart, so that generated
+// code can refer to them compactly, e.g. in binary trace records. The numbering
+// depends only on the chart, so every backend agrees on it.
+//
+// The map is written next to the generated code as a text file with one symbol per
+// line, "kind number description", and read back by the tools that decode what the
+// generated code records.
+class SymbolMap( val chartName : String, stateChart : StateChart ) :
+
+    // States are numbered by their global indices.
+    val states : Seq[Node] = stateChart.nodes.filter( _.isState ).sortBy( _.getGlobalIndex )
+
+    val edges : Seq[Edge] = stateChart.edges
+
+    private val edgeIds : Map[Edge, Int] = edges.zipWithIndex.toMap
+
+    val guards : Seq[String] = edges.flatMap( _.guardOpt ).map( _.toString ).distinct
+
+    private val guardIds : Map[String, Int] = guards.zipWithIndex.toMap
+
+    val actions : Seq[String] = edges.flatMap( _.actions ).map( SymbolMap.actionText ).distinct
+
+    private val actionIds : Map[String, Int] = actions.zipWithIndex.toMap
+
+    def stateId( state : Node ) : Int = state.getGlobalIndex
+
+    def edgeId( edge : Edge ) : Int = edgeIds( edge )
+
+    def guardId( guard : Guard ) : Int = guardIds( guard.toString )
+
+    def actionId( action : Action ) : Int = actionIds( SymbolMap.actionText( action ) )
+
+    lazy val text : String =
+        val sb = new StringBuilder()
+        sb.append( s"${SymbolMap.header}\n" )
+        sb.append( s"chart $chartName\n" )
+        for state <- states do sb.append( s"state ${stateId(state)} ${state.getFullName}\n" )
+        for (edge, i) <- edges.zipWithIndex do sb.append( s"edge $i ${SymbolMap.oneLine( SymbolMap.describe( edge ) )}\n" )
+        for (guard, i) <- guards.zipWithIndex do sb.append( s"guard $i ${SymbolMap.oneLine( guard )}\n" )
+        for (action, i) <- actions.zipWithIndex do sb.append( s"action $i ${SymbolMap.oneLine( action )}\n" )
+        sb.toString
+
+    // Lets a decoder check that a recording was made by code generated with this map.
+    lazy val hash : Long = SymbolMap.fnv1a( text )
+
+end SymbolMap
+
+object SymbolMap :
+    val header = "cogent-symbols 1"
+
+    // The text of an action as it appears in trace messages.
+    def actionText( action : Action ) : String =
+        action match
+            case Action.NamedAction( name ) => name
+            case Action.RawAction( rawCCode ) => s"{ ${rawCCode} ; }"
+
+    def describe( edge : Edge ) : String =
+        s"${edge.source.getFullName} -> ${edge.target.getFullName}"
+        + edge.triggerOpt.map( t => s" : $t" ).getOrElse( "" )
+        + edge.guardOpt.map( g => s" $g" ).getOrElse( "" )
+        + ( if edge.actions.isEmpty then "" else edge.actions.mkString( " / ", "; ", "" ) )
+
+    def oneLine( str : String ) : String = str.replaceAll( "\\s+", " " )
+
+    // 32-bit FNV-1a over the UTF-8 bytes.
+    def fnv1a( str : String ) : Long =
+        var h = 0x811c9dc5L
+        for b <- str.getBytes( "UTF-8" ) do
+            h = ( ( h ^ ( b & 0xff ) ) * 0x01000193L ) & 0xffffffffL
+        h
+
+    // The symbols of a map file, by kind and then by number.
+    def read( lines : Seq[String] ) : Either[String, Map[String, Map[Int, String]]] =
+        if lines.headOption != Some( header ) then
+            Left( s"The first line should be '$header'" )
+        else
+            val entries = lines.drop( 1 ).filter( _.nonEmpty ).map( _.split( " ", 3 ) )
+            entries.find( e => e.length < 2 || ( e(0) != "chart" && ( e.length < 3 || e(1).toIntOption.isEmpty ) ) ) match
+                case Some( bad ) => Left( s"Bad line '${bad.mkString( " " )}'" )
+                case None =>
+                    Right( entries.filter( _(0) != "chart" )
+                                  .groupBy( _(0) )
+                                  .map( (kind, es) => kind -> es.map( e => e(1).toInt -> e(2) ).toMap ) )
+
+    // Reads a map file and a dump of something that code generated with it recorded. The
+    // dump starts with the 4 characters of magic and the hash of the map, and is at least
+    // minLength bytes long. Returns the symbols and the bytes of the dump, or reports a fatal
+    // error and returns None. Warns if the dump was recorded with a different map.
+    def readWithDump( logger : Logger, mapFile : File, dumpFile : File, magic : String, minLength : Int,
+                      what : String ) : Option[(Map[String, Map[Int, String]], Array[Byte])] =
+        val text =
+            try Right( Files.readString( mapFile.toPath ) )
+            catch case e : IOException => Left( s"Can not read ${mapFile}: ${e.getMessage()}" )
+        val bytes =
+            try Files.readAllBytes( dumpFile.toPath )
+            catch case e : IOException =>
+                logger.fatal( s"Can not read ${dumpFile}: ${e.getMessage()}" )
+                return None
+        text.flatMap( t => read( t.linesIterator.toSeq ) ) match
+            case Left( message ) =>
+                logger.fatal( s"${mapFile} is not a symbol map. $message" )
+                None
+            case Right( map ) =>
+                if bytes.length < minLength || new String( bytes, 0, 4, "US-ASCII" ) != magic then
+                    logger.fatal( s"${dumpFile} is not a $what." )
+                    None
+                else
+                    if littleEndian( bytes, 4, 4 ) != fnv1a( text.toOption.get ) then
+                        logger.warning( s"${dumpFile} was not recorded by code generated with ${mapFile}. Names may be wrong." )
+                    Some( ( map, bytes ) )
+
+    // The unsigned number in count bytes of a dump, least significant first.
+    def littleEndian( bytes : Array[Byte], at : Int, count : Int ) : Long =
+        ( 0 until count ).foldRight( 0L )( (i, acc) => ( acc << 8 ) | ( bytes( at + i ) & 0xffL ) )
+end SymbolMap
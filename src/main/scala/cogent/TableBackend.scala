@@ -0,0 +1,446 @@
+package cogent
+
+// Generates const tables describing the chart plus a small generic interpreter
+// that walks them. The public functions, the per-machine state and the
+// semantics are the same as for the switch style generated by Backend, but the
+// code size hardly grows with the size of the chart: each state and transition
+// costs a few bytes of table instead of its own code.
+class TableBackend( override val logger : Logger, override val out : COutputter, override val generationOptions : GenerationOptions )
+    extends Backend( logger, out, generationOptions ) :
+
+    private val vertexTable = "vertices_a"
+    private val vertexNameTable = "vertexNames_a"
+    private val childTable = "children_a"
+    private val groupTable = "groups_a"
+    private val edgeTable = "edges_a"
+    private val edgeTraceTable = "edgeTraceIds_a"
+    private val indexType = "TABLE_INDEX_T"
+    private val stateNamesMacro = "TABLE_STATE_NAMES"
+
+    // One row of the edge table.
+    private case class EdgeRow( edge : Edge, guardName : String, actionName : String, isElse : Boolean )
+
+    // One row of the group table: the edges leaving a vertex on one trigger.
+    private case class GroupRow( eventClass : String, isAfter : Boolean, duration : Int, firstEdge : Int, edgeCount : Int )
+
+    // One row of the vertex table.
+    private case class VertexRow( vertex : Node, firstChild : Int, childCount : Int, firstGroup : Int, groupCount : Int )
+
+    // The rows of each table generated, for the memory report.
+    private var tableRows = Seq[(String, Int, String)]()
+
+    override def generateCCode( stateChart : StateChart, chartName : String, cogentVersion : String ) : Unit = {
+        this.chartName = chartName
+
+        // Lay out the tables first, so that any errors are reported before output starts.
+        val vertices = stateChart.nodes.filter( n => n.isState || n.isChoicePseudostate ).toSeq.sortBy( _.getGlobalIndex )
+        for (v, i) <- vertices.zipWithIndex do assert( v.getGlobalIndex == i )
+        val childRows = scala.collection.mutable.ArrayBuffer[Node]()
+        val groupRows = scala.collection.mutable.ArrayBuffer[GroupRow]()
+        val edgeRows = scala.collection.mutable.ArrayBuffer[EdgeRow]()
+        val guardFunctions = scala.collection.mutable.LinkedHashMap[(String, Boolean), (String, Guard, Node)]()
+        val actionFunctions = scala.collection.mutable.LinkedHashMap[String, (String, Seq[Action])]()
+
+        def addGroup( eventClass : String, isAfter : Boolean, duration : Int,
+                      description : Option[String], vertex : Node, edges : Seq[Edge] ) : Unit =
+            for group <- classifyEdges( description, vertex, edges ) do
+                val firstEdge = edgeRows.size
+                val ordered = group.unguarded.toSeq ++ group.conditional ++ group.elseEdge.toSeq
+                for edge <- ordered do
+                    val isElse = group.elseEdge.contains( edge )
+                    val guardName = if isElse || edge.guardOpt.isEmpty then "0" else
+                        val guard = edge.guardOpt.get
+                        val key = ( guard.toString, vertex.isState )
+                        guardFunctions.getOrElseUpdate( key, ( s"guard_${guardFunctions.size}", guard, vertex ) )._1
+                    val actionName = if edge.actions.isEmpty then "0" else
+                        val key = edge.actions.mkString( ";" )
+                        actionFunctions.getOrElseUpdate( key, ( s"actions_${actionFunctions.size}", edge.actions ) )._1
+                    edgeRows += EdgeRow( edge, guardName, actionName, isElse )
+                end for
+                groupRows += GroupRow( eventClass, isAfter, duration, firstEdge, ordered.size )
+            end for
+
+        val vertexRows = for vertex <- vertices yield
+            val firstChild = childRows.size
+            val children = vertex.childStates.sortBy( _.getLocalIndex )
+            childRows ++= children
+            val firstGroup = groupRows.size
+            val edges = stateChart.edgesFrom( vertex )
+            if vertex.isChoicePseudostate then
+                addGroup( "0", false, 0, None, vertex, edges )
+            else
+                val names = edges.flatMap( _.triggerOpt ).collect{ case Trigger.NamedTrigger( name ) => name }.distinct.sorted
+                for name <- names do
+                    val named = edges.filter( _.triggerOpt.contains( Trigger.NamedTrigger( name ) ) )
+                    addGroup( s"$eventMacro($name)", false, 0, Some( name ), vertex, named )
+                val durations = edges.flatMap( _.triggerOpt ).collect{ case Trigger.AfterTrigger( d ) => d }.distinct.sorted
+                for d <- durations do
+                    val timed = edges.filter( _.triggerOpt.contains( Trigger.AfterTrigger( d ) ) )
+                    val intDuration = checkedDuration( d )
+                    addGroup( "TICK", true, intDuration, Some( s"after $intDuration ms" ), vertex, timed )
+            end if
+            VertexRow( vertex, firstChild, children.size, firstGroup, groupRows.size - firstGroup )
+        if logger.hasFatality then return
+
+        def depth( n : Node ) : Int = if n == stateChart.root then 1 else 1 + depth( stateChart.parentOf( n ) )
+        val maxDepth = vertices.map( depth ).max
+        val largest = Seq( vertices.size, childRows.size, groupRows.size, edgeRows.size ).max
+        val tableIndexCType = if largest < 128 then "signed char" else if largest < 32768 then "short" else "int"
+        tableRows = ( if generationOptions.binaryTrace then Seq() else Seq( ( vertexNameTable, vertices.size, "const char *" ) ) ) ++
+                    Seq( ( vertexTable, vertices.size, "table_vertex_t" ),
+                         ( childTable, childRows.size max 1, tableIndexCType ),
+                         ( groupTable, groupRows.size max 1, "table_group_t" ),
+                         ( edgeTable, edgeRows.size max 1, "table_edge_t" ) ) ++
+                    ( if generationOptions.binaryTrace || generationOptions.profile then Seq( ( edgeTraceTable, edgeRows.size max 1, "unsigned short" ) )
+                      else Seq() )
+
+        generateComment( cogentVersion )
+
+        generateInclude( chartName )
+
+        // The table of state names is only read by the state logging macros, so it is only
+        // generated if the preamble defines one of them. The defaults ignore their argument.
+        if ! generationOptions.binaryTrace then
+            out.putLine( s"#if defined( $logEnterStateMacro ) || defined( $logExitStateMacro )" )
+            out.indented{ out.putLine( s"#define $stateNamesMacro" ) }
+            out.putLine( "#endif" )
+            out.blankLine
+
+        generateMacroDeclarations()
+
+        generateTraceSupport( stateChart )
+
+        generateProfileSupport( stateChart )
+
+        generateDefines( stateChart )
+
+        out.putLine( s"#define VERTEX_COUNT ${vertices.size}" )
+        out.putLine( s"#define TABLE_MAX_DEPTH $maxDepth" )
+        out.putLine( s"#define $indexType $tableIndexCType" )
+        out.putLine( "#define VERTEX_BASIC 0" )
+        out.putLine( "#define VERTEX_OR 1" )
+        out.putLine( "#define VERTEX_AND 2" )
+        out.putLine( "#define VERTEX_CHOICE 3" )
+        out.blankLine
+
+        if generationOptions.contextStruct then
+            out.putLine( "// All per-machine state lives in the context struct" )
+            out.putLine( s"#include \"${contextHeaderName}\"" )
+            out.blankLine
+        else
+            for v <- stateVariables( stateChart ) do
+                out.putLine( s"// ${v.comment}" )
+                out.putLine( s"static ${v.cType} ${declarator( v, true )} ;" )
+            end for
+            out.blankLine
+        end if
+
+        generateTableTypes()
+
+        generateGuardAndActionFunctions( guardFunctions.values.toSeq, actionFunctions.values.toSeq, stateChart )
+
+        generateTables( vertexRows, childRows.toSeq, groupRows.toSeq, edgeRows.toSeq, stateChart )
+
+        generateInterpreter( stateChart )
+
+        if generationOptions.snapshot then
+            generateSnapshotFunctions( stateChart )
+    }
+
+    // The interpreter has no one place where a dispatch starts, so pure guards are evaluated each time.
+    override protected def memoisesGuards : Boolean = false
+
+    // The table style keeps no change stamps, since settling TICKs the whole configuration.
+    override protected def settlesChangedOnly : Boolean = false
+
+    // The size of the table rows depends on the target's pointers and struct layout, so rows are counted instead of bytes.
+    override protected def constantReport( stateChart : StateChart ) : Seq[String] =
+        Seq( s"Constant tables: ${tableRows.map( _._2 ).sum} rows; measure their bytes, and the interpreter's, with the size command" ) ++
+        tableRows.map( (name, rows, rowType) => s"    $name: $rows of $rowType" + ( if name == vertexNameTable then s" (only if $stateNamesMacro is defined)" else "" ) )
+
+    // The interpreter polls the timed states of the active configuration on each TICK.
+    override def usesTimerList( stateChart : StateChart ) : Boolean = false
+
+    private def generateTableTypes() : Unit = {
+        val callParams = s"${contextParam}${eventType} *${eventPointerName}, $statusType $statusVarName, $timeType $now"
+        out.putLines( s"""|typedef $boolType table_guard_t( $callParams ) ;
+                          |typedef $statusType table_action_t( $callParams ) ;
+                          |
+                          |typedef struct {
+                          |    unsigned char kind ;            /* VERTEX_BASIC, VERTEX_OR, VERTEX_AND or VERTEX_CHOICE */
+                          |    $indexType parent ;          /* -1 for the root */
+                          |    $indexType localIndex ;
+                          |    $indexType firstChild ;      /* Children, in order of local index, are in $childTable */
+                          |    $indexType childCount ;
+                          |    $indexType firstGroup ;      /* Transitions, grouped by trigger, are in $groupTable */
+                          |    $indexType groupCount ;
+                          |} table_vertex_t ;
+                          |
+                          |typedef struct {
+                          |    $eventClassType eventClass ;       /* TICK for after triggers; unused for choices */
+                          |    unsigned char isAfter ;
+                          |    $timeType duration ;
+                          |    $indexType firstEdge ;       /* Edges, in the order their guards are tried, are in $edgeTable */
+                          |    $indexType edgeCount ;
+                          |} table_group_t ;
+                          |
+                          |typedef struct {
+                          |    table_guard_t *guard ;          /* Null if unguarded or else */
+                          |    table_action_t *action ;        /* Null if there are no actions */
+                          |    $indexType target ;
+                          |    $indexType leastCommonOr ;
+                          |    unsigned char isElse ;
+                          |} table_edge_t ;
+                          |""".stripMargin )
+        out.blankLine
+    }
+
+    private def generateGuardAndActionFunctions( guards : Seq[(String, Guard, Node)], actions : Seq[(String, Seq[Action])], stateChart : StateChart ) : Unit = {
+        val callParams = s"${contextParam}${eventType} *${eventPointerName}, $statusType $statusVarName, $timeType $now"
+        for (name, guard, source) <- guards do
+            out.put( s"static $boolType $name( $callParams ) " )
+            out.block{
+                out.ifComm{ generateGuardExpression( guard, stateChart, source ) }{
+                    out.putLine( traceStatement( s"${logGuardTrueMacro}( \"${guard.toString()}\")",
+                                                 "TRACE_GUARD_TRUE", symbols( stateChart ).guardId( guard ) ) )
+                    out.put( s"return $trueConst ;" )
+                }
+                out.endLine
+                out.put( s"return $falseConst ;" )
+            }
+            out.blankLine
+        end for
+        for (name, actionSeq) <- actions do
+            out.put( s"static $statusType $name( $callParams ) " )
+            out.block{
+                actionSeq.foreach( generateActionCode( _, stateChart ) )
+                out.put( s"return $statusVarName ;" )
+            }
+            out.blankLine
+        end for
+    }
+
+    private def generateTables( vertexRows : Seq[VertexRow], childRows : Seq[Node], groupRows : Seq[GroupRow],
+                                edgeRows : Seq[EdgeRow], stateChart : StateChart ) : Unit = {
+        def kind( n : Node ) : String =
+            n match
+                case Node.OrState( _, _ ) => "VERTEX_OR"
+                case Node.AndState( _, _ ) => "VERTEX_AND"
+                case Node.BasicState( _ ) => "VERTEX_BASIC"
+                case _ => "VERTEX_CHOICE"
+        def index( n : Node ) : String =
+            if n.isState then globalMacro( n ) else s"${n.getGlobalIndex} /* ${n.getCName} */"
+        def rows( header : String, items : Seq[String] ) : Unit =
+            out.put( header )
+            out.blockNoNewLine{
+                for (item, i) <- items.zipWithIndex do
+                    out.put( item )
+                    if i < items.size - 1 then out.put( "," )
+                    out.endLine
+            }
+            out.putLine( " ;" )
+            out.blankLine
+
+        if ! generationOptions.binaryTrace then
+            out.putLine( s"#ifdef $stateNamesMacro" )
+            rows( s"static const char * const ${vertexNameTable}[ VERTEX_COUNT ] = ",
+                  vertexRows.map( r => out.stringify( r.vertex.getFullName ) ) )
+            out.putLine( "#endif" )
+            out.blankLine
+        rows( s"static const table_vertex_t ${vertexTable}[ VERTEX_COUNT ] = ",
+              vertexRows.map{ r =>
+                  val parent = if r.vertex == stateChart.root then "-1" else index( stateChart.parentOf( r.vertex ) )
+                  s"{ ${kind(r.vertex)}, $parent, ${r.vertex.getLocalIndex}, ${r.firstChild}, ${r.childCount}, ${r.firstGroup}, ${r.groupCount} } /* ${r.vertex.getCName} */" } )
+        // C does not allow empty arrays, so each table has at least one row.
+        rows( s"static const $indexType ${childTable}[] = ",
+              if childRows.isEmpty then Seq( "-1" ) else childRows.map( index ) )
+        rows( s"static const table_group_t ${groupTable}[] = ",
+              if groupRows.isEmpty then Seq( "{ 0, 0, 0, 0, 0 }" ) else
+              groupRows.map( g => s"{ ${g.eventClass}, ${if g.isAfter then 1 else 0}, ${toDuration}(${g.duration}), ${g.firstEdge}, ${g.edgeCount} }" ) )
+        rows( s"static const table_edge_t ${edgeTable}[] = ",
+              if edgeRows.isEmpty then Seq( "{ 0, 0, 0, 0, 0 }" ) else
+              edgeRows.map{ r =>
+                  val lca = stateChart.leastCommonOrOf( r.edge.source, r.edge.target )
+                  s"{ ${r.guardName}, ${r.actionName}, ${index(r.edge.target)}, ${index(lca)}, ${if r.isElse then 1 else 0} } /* ${r.edge.source.getCName} -> ${r.edge.target.getCName} */" } )
+        // The rows are in a different order from the symbol map's edges.
+        if generationOptions.binaryTrace || generationOptions.profile then
+            rows( s"static const unsigned short ${edgeTraceTable}[] = ",
+                  if edgeRows.isEmpty then Seq( "0" ) else edgeRows.map( r => symbols( stateChart ).edgeId( r.edge ).toString ) )
+    }
+
+    // The interpreter. It mirrors the enter_, exit_ and dispatch code of the
+    // switch style: inner states pre-empt outer ones, after groups are tried in
+    // order of duration, and status is threaded through guards and actions.
+    private def generateInterpreter( stateChart : StateChart ) : Unit = {
+        val isIn = stateData( isInArrayName )
+        val timeEntered = stateData( timeEnteredArrayName )
+        val currentChild = stateData( currentChildArrayName )
+        val ctxP = contextParam
+        val ctxA = contextArg
+        val edgeTrace = ( if generationOptions.binaryTrace then s"\n    $traceRecordMacro( TRACE_EDGE, $edgeTraceTable[ e ] ) ;" else "" )
+                        + ( if generationOptions.profile then s"\n    profileStart( &$profileEdgeTable[ $edgeTraceTable[ e ] ] ) ;" else "" )
+        val edgeDone = if generationOptions.profile then s"\n    profileDone( &$profileEdgeTable[ $edgeTraceTable[ e ] ] ) ;" else ""
+        out.putLines( s"""|static void enterVertex( ${ctxP}$indexType v, $localIndexType childIndex, $timeType $now ) ;
+                          |static void exitVertex( ${ctxP}$indexType v, $localIndexType childIndex ) ;
+                          |static $boolType fireGroup( ${ctxP}$indexType v, $indexType g, $eventType *$eventPointerName, $statusType $statusVarName, $timeType $now ) ;
+                          |
+                          |static void enterVertex( ${ctxP}$indexType v, $localIndexType childIndex, $timeType $now ) {
+                          |    const table_vertex_t *vp = &$vertexTable[ v ] ;
+                          |    $indexType i ;
+                          |    $isIn[ v ] = $trueConst ;
+                          |    $timeEntered[ v ] = $now ;
+                          |    if( vp->parent >= 0 && $vertexTable[ vp->parent ].kind == VERTEX_OR ) $currentChild[ vp->parent ] = vp->localIndex ;
+                          |    ${vertexTrace( logEnterStateMacro, "TRACE_ENTER_STATE" )}
+                          |    if( vp->kind == VERTEX_OR ) {
+                          |        if( childIndex == -1 ) enterVertex( ${ctxA}$childTable[ vp->firstChild ], -1, $now ) ;
+                          |    } else if( vp->kind == VERTEX_AND ) {
+                          |        for( i = 0 ; i < vp->childCount ; ++i ) {
+                          |            if( i != childIndex ) enterVertex( ${ctxA}$childTable[ vp->firstChild + i ], -1, $now ) ;
+                          |        }
+                          |    }
+                          |}
+                          |
+                          |static void exitVertex( ${ctxP}$indexType v, $localIndexType childIndex ) {
+                          |    const table_vertex_t *vp = &$vertexTable[ v ] ;
+                          |    $indexType i ;
+                          |    if( vp->kind == VERTEX_OR ) {
+                          |        if( childIndex == -1 ) exitVertex( ${ctxA}$childTable[ vp->firstChild + $currentChild[ v ] ], -1 ) ;
+                          |    } else if( vp->kind == VERTEX_AND ) {
+                          |        for( i = 0 ; i < vp->childCount ; ++i ) {
+                          |            if( i != childIndex ) exitVertex( ${ctxA}$childTable[ vp->firstChild + i ], -1 ) ;
+                          |        }
+                          |    }
+                          |    ${vertexTrace( logExitStateMacro, "TRACE_EXIT_STATE" )}
+                          |    $isIn[ v ] = $falseConst ;
+                          |}
+                          |
+                          |/* Takes edge e out of vertex v: exits up to the least common OR state, runs the actions, */
+                          |/* and enters down to the target, continuing through choice pseudostates. */
+                          |static void takeEdge( ${ctxP}$indexType v, $indexType e, $eventType *$eventPointerName, $statusType $statusVarName, $timeType $now ) {
+                          |    const table_edge_t *ep = &$edgeTable[ e ] ;$edgeTrace
+                          |    $indexType path[ TABLE_MAX_DEPTH ] ;
+                          |    int n = 0 ;
+                          |    $indexType child = v ;
+                          |    $indexType p = $vertexTable[ v ].parent ;
+                          |    $indexType q ;
+                          |    if( $vertexTable[ v ].kind != VERTEX_CHOICE ) exitVertex( ${ctxA}v, -1 ) ;
+                          |    while( p != ep->leastCommonOr ) {
+                          |        exitVertex( ${ctxA}p, $vertexTable[ child ].localIndex ) ;
+                          |        child = p ;
+                          |        p = $vertexTable[ p ].parent ;
+                          |    }
+                          |    if( ep->action ) $statusVarName = ep->action( ${ctxA}$eventPointerName, $statusVarName, $now ) ;
+                          |    for( q = ep->target ; q != ep->leastCommonOr ; q = $vertexTable[ q ].parent ) path[ n++ ] = q ;
+                          |    while( n > 1 ) {
+                          |        n -= 1 ;
+                          |        enterVertex( ${ctxA}path[ n ], $vertexTable[ path[ n-1 ] ].localIndex, $now ) ;
+                          |    }
+                          |    if( $vertexTable[ ep->target ].kind == VERTEX_CHOICE ) {
+                          |        fireGroup( ${ctxA}ep->target, $vertexTable[ ep->target ].firstGroup, $eventPointerName, $statusVarName, $now ) ;
+                          |    } else {
+                          |        enterVertex( ${ctxA}ep->target, -1, $now ) ;
+                          |    }$edgeDone
+                          |}
+                          |
+                          |/* Tries the edges of group g out of vertex v in order and takes the first enabled one. */
+                          |/* Returns true if a guarded or unguarded edge was taken. */
+                          |static $boolType fireGroup( ${ctxP}$indexType v, $indexType g, $eventType *$eventPointerName, $statusType $statusVarName, $timeType $now ) {
+                          |    const table_group_t *gp = &$groupTable[ g ] ;
+                          |    $indexType e ;
+                          |    for( e = gp->firstEdge ; e < gp->firstEdge + gp->edgeCount ; ++e ) {
+                          |        const table_edge_t *ep = &$edgeTable[ e ] ;
+                          |        if( ep->isElse ) {
+                          |            takeEdge( ${ctxA}v, e, $eventPointerName, $statusVarName, $now ) ;
+                          |            return $falseConst ;
+                          |        }
+                          |        if( ep->guard == 0 || ep->guard( ${ctxA}$eventPointerName, $statusVarName, $now ) ) {
+                          |            takeEdge( ${ctxA}v, e, $eventPointerName, $statusVarName, $now ) ;
+                          |            return $trueConst ;
+                          |        }
+                          |    }
+                          |    if( $vertexTable[ v ].kind == VERTEX_CHOICE ) assertUnreachable() ;
+                          |    return $falseConst ;
+                          |}
+                          |
+                          |static $boolType dispatchVertex( ${ctxP}$indexType v, $eventType *$eventPointerName, $eventClassType $eventClassVarName, $timeType $now ) {
+                          |    const table_vertex_t *vp = &$vertexTable[ v ] ;
+                          |    $boolType $handledVarName = $falseConst ;
+                          |    $indexType i ;
+                          |    if( vp->kind == VERTEX_OR ) {
+                          |        $handledVarName = dispatchVertex( ${ctxA}$childTable[ vp->firstChild + $currentChild[ v ] ], $eventPointerName, $eventClassVarName, $now ) ;
+                          |    } else if( vp->kind == VERTEX_AND ) {
+                          |        for( i = 0 ; i < vp->childCount ; ++i ) {
+                          |            if( dispatchVertex( ${ctxA}$childTable[ vp->firstChild + i ], $eventPointerName, $eventClassVarName, $now ) ) $handledVarName = $trueConst ;
+                          |        }
+                          |    }
+                          |    for( i = vp->firstGroup ; ! $handledVarName && i < vp->firstGroup + vp->groupCount ; ++i ) {
+                          |        const table_group_t *gp = &$groupTable[ i ] ;
+                          |        if( gp->isAfter ? $eventClassVarName == TICK && ( gp->duration == 0 || $isAfter( gp->duration, $timeEntered[ v ], $now ) )
+                          |                        : $eventClassVarName == gp->eventClass ) {
+                          |            $handledVarName = fireGroup( ${ctxA}v, i, $eventPointerName, $okStatusConstant, $now ) ;
+                          |        }
+                          |    }
+                          |    return $handledVarName ;
+                          |}
+                          |
+                          |static void deadlineForVertex( ${ctxP}$indexType v, $timeType $now, $boolType *found_p, $timeType *remaining_p ) {
+                          |    const table_vertex_t *vp = &$vertexTable[ v ] ;
+                          |    $indexType i ;
+                          |    for( i = vp->firstGroup ; i < vp->firstGroup + vp->groupCount ; ++i ) {
+                          |        const table_group_t *gp = &$groupTable[ i ] ;
+                          |        if( gp->isAfter ) {
+                          |            $timeType left = $isAfter( gp->duration, $timeEntered[ v ], $now ) ? 0 : ($timeType)( $afterDeadline( gp->duration, $timeEntered[ v ] ) - $now ) ;
+                          |            if( ! *found_p || left < *remaining_p ) {
+                          |                *found_p = $trueConst ;
+                          |                *remaining_p = left ;
+                          |            }
+                          |        }
+                          |    }
+                          |    if( vp->kind == VERTEX_OR ) {
+                          |        deadlineForVertex( ${ctxA}$childTable[ vp->firstChild + $currentChild[ v ] ], $now, found_p, remaining_p ) ;
+                          |    } else if( vp->kind == VERTEX_AND ) {
+                          |        for( i = 0 ; i < vp->childCount ; ++i ) deadlineForVertex( ${ctxA}$childTable[ vp->firstChild + i ], $now, found_p, remaining_p ) ;
+                          |    }
+                          |}
+                          |
+                          |void initStateMachine_${chartName}( ${ctxP}$timeType $now) {
+                          |    enterVertex( ${ctxA}${globalMacro(stateChart.root)}, -1, $now ) ;
+                          |}
+                          |
+                          |$boolType dispatchEvent_${chartName}( ${ctxP}$eventType *$eventPointerName, $timeType $now ) {
+                          |    return dispatchVertex( ${ctxA}${globalMacro(stateChart.root)}, $eventPointerName, $eventClassOf($eventPointerName), $now ) ;
+                          |}
+                          |
+                          |$boolType nextDeadline_${chartName}( ${ctxP}$timeType $now, $timeType *deadline_p ) {
+                          |    $boolType found = $falseConst ;
+                          |    $timeType remaining = 0 ;
+                          |    deadlineForVertex( ${ctxA}${globalMacro(stateChart.root)}, $now, &found, &remaining ) ;
+                          |    if( found ) *deadline_p = ($timeType)( $now + remaining ) ;
+                          |    return found ;
+                          |}
+                          |
+                          |$boolType dispatchTimeouts_${chartName}( ${ctxP}$timeType $now ) {
+                          |    return dispatchVertex( ${ctxA}${globalMacro(stateChart.root)}, $tickEventPointer, TICK, $now ) ;
+                          |}
+                          |
+                          |$boolType dispatchAndSettle_${chartName}( ${ctxP}$eventType *$eventPointerName, $timeType $now, int maxSteps, int *steps_p ) {
+                          |    int steps = 0 ;
+                          |    int ticks = 0 ;
+                          |    $boolType $handledVarName = dispatchEvent_${chartName}( ${ctxA}$eventPointerName, $now ) ;
+                          |    while( $handledVarName && ticks < maxSteps ) {
+                          |        steps += 1 ;
+                          |        $handledVarName = dispatchTimeouts_${chartName}( ${ctxA}$now ) ;
+                          |        ticks += 1 ;
+                          |    }
+                          |    if( $handledVarName ) steps += 1 ;
+                          |    if( steps_p ) *steps_p = steps ;
+                          |    return ! $handledVarName ;
+                          |}""".stripMargin )
+    }
+
+    // State tracing in the interpreter, where the state is only known at run time.
+    private def vertexTrace( logMacro : String, kind : String ) : String =
+        if generationOptions.binaryTrace then s"$traceRecordMacro( $kind, v ) ;"
+        else s"$logMacro( $vertexNameTable[ v ] )"
+
+end TableBackend
@@ -0,0 +1,42 @@
+package cogent
+
+import java.io.File
+
+import SymbolMap.littleEndian
+
+// Turns a dump of the binary trace ring, as written by traceDump_<chart>, back into
+// readable lines, using the symbol map that was written with the generated code.
+class TraceDecoder( val logger : Logger ) :
+
+    private val kinds = Map(
+        1 -> ( "enter", "state" ),
+        2 -> ( "exit", "state" ),
+        3 -> ( "guard", "guard" ),
+        4 -> ( "guard true", "guard" ),
+        5 -> ( "action", "action" ),
+        6 -> ( "action done", "action" ),
+        7 -> ( "transition", "edge" ) )
+
+    def decode( mapFile : File, dumpFile : File, emit : String => Unit ) : Unit =
+        SymbolMap.readWithDump( logger, mapFile, dumpFile, "CGTR", 12, "trace dump" ) match
+            case None => ()
+            case Some( (map, bytes) ) =>
+                val count = littleEndian( bytes, 8, 4 ).toInt
+                if bytes.length < 12 + 8 * count then
+                    logger.warning( s"${dumpFile} is truncated." )
+                for i <- 0 until Math.min( count, ( bytes.length - 12 ) / 8 ) do
+                    val at = 12 + 8 * i
+                    val time = littleEndian( bytes, at, 4 )
+                    val kind = bytes( at + 4 ) & 0xff
+                    val machine = bytes( at + 5 ) & 0xff
+                    val id = littleEndian( bytes, at + 6, 2 ).toInt
+                    val line = kinds.get( kind ) match
+                        case Some( (what, symbolKind) ) =>
+                            val name = map.getOrElse( symbolKind, Map() ).getOrElse( id, s"<unknown $symbolKind $id>" )
+                            f"$time%10d  m$machine%-3d $what%-12s $name"
+                        case None =>
+                            f"$time%10d  m$machine%-3d <unknown record kind $kind> $id"
+                    emit( line )
+                end for
+
+end TraceDecoder
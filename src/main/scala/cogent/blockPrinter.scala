@@ -44,9 +44,7 @@ object blockPrinter {
             logger.log( Debug, " "*lenSource + "  " + labelAsString)
             logger.log( Debug, s"$sourceAsString--${"-"*lenLabel}->$targetAsString" ) )
 
-    var indentLevel = 0
-
-    def printEntity( entity : IEntity )(using logger : Logger) : Unit =
+    def printEntity( entity : IEntity, indentLevel : Int = 0 )(using logger : Logger) : Unit =
         val indent1 = "|   "*(indentLevel) + "+--"
         val indent  = "|   "*(indentLevel) + "|  "
         logger.log( Debug, indent1 + s"codeName: ${entity.getCode().getName()}")
@@ -78,12 +76,10 @@ object blockPrinter {
                 case (group : IGroup) =>
                     logger.log( Debug, indent + "It's a group." )
                     logger.log( Debug, indent + s"Group type is ${group.getGroupType()}" )
-                    indentLevel += 1
                     val leaves = group.getLeafsDirect()
-                    leaves.forEach {(leaf) => printEntity( leaf ) }
+                    leaves.forEach {(leaf) => printEntity( leaf, indentLevel + 1 ) }
                     val groups = group.getChildren() 
-                    groups.forEach {(child) => printEntity(child)}
-                    indentLevel -= 1
+                    groups.forEach {(child) => printEntity( child, indentLevel + 1 )}
                 case _ => logger.log( Debug, indent + "It's a group that isn't an IGroup!" )
         else 
             entity match 
@@ -11,11 +11,13 @@ class LoggerForTesting
 
     var fatalCount = 0
     var warnCount = 0
+    var neverCount = 0
 
     def hasFatality = fatalCount > 0
 
     def log( level : Logger.Level,  message : String ) : Unit =
         level match
+            case Level.Never => neverCount += 1
             case Level.Fatal => fatalCount += 1
             case Level.Warning => warnCount += 1
             case _ => ()
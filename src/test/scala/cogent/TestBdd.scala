@@ -0,0 +1,105 @@
+package cogent
+
+import org.scalatest.flatspec.AnyFlatSpec
+
+class TestBdd extends AnyFlatSpec :
+
+    // The truth-table meaning of satisfiability, for comparison.
+    def bySearch( logger : Logger, guard : Guard ) : Boolean =
+        val atoms = Satisfaction.findAtoms( logger, guard ).toList
+        ( 0 until ( 1 << atoms.size ) ).exists( i =>
+            Satisfaction.evaluate( guard, atoms.zipWithIndex.map( (a, j) => a -> ( ( i & ( 1 << j ) ) != 0 ) ).toMap ) )
+
+    def randomGuard( random : scala.util.Random, depth : Int ) : Guard =
+        if depth == 0 || random.nextInt( 4 ) == 0 then
+            random.nextInt( 4 ) match
+                case 0 => Guard.InGuard( s"s${random.nextInt( 3 )}" )
+                case 1 => Guard.RawGuard( s"r${random.nextInt( 2 )}" )
+                case 2 => Guard.OKGuard()
+                case _ => Guard.NamedGuard( s"g${random.nextInt( 3 )}" )
+        else
+            random.nextInt( 4 ) match
+                case 0 => Guard.NotGuard( randomGuard( random, depth - 1 ) )
+                case 1 => Guard.AndGuard( randomGuard( random, depth - 1 ), randomGuard( random, depth - 1 ) )
+                case 2 => Guard.OrGuard( randomGuard( random, depth - 1 ), randomGuard( random, depth - 1 ) )
+                case _ => Guard.ImpliesGuard( randomGuard( random, depth - 1 ), randomGuard( random, depth - 1 ) )
+
+    def disjunction( gs : Seq[Guard] ) : Guard = gs.reduce( Guard.OrGuard( _, _ ) )
+
+    "the decision diagrams" should "agree with the truth tables on random guards" in {
+        val logger = new LoggerForTesting
+        val random = new scala.util.Random( 2024 )
+        for _ <- 0 until 500 do
+            val g0 = randomGuard( random, 4 )
+            val g1 = randomGuard( random, 4 )
+            assert( Satisfaction.is_satisfiable( logger, g0 ) == bySearch( logger, g0 ), g0 )
+            assert( Satisfaction.is_tautology( logger, g0 ) == ! bySearch( logger, Guard.NotGuard( g0 ) ), g0 )
+            assert( Satisfaction.ambiguity( logger, g0, g1 ) == bySearch( logger, Guard.AndGuard( g0, g1 ) ), (g0, g1) )
+            assert( Satisfaction.entails( logger, g0, g1 ) == ! bySearch( logger, Guard.AndGuard( g0, Guard.NotGuard( g1 ) ) ), (g0, g1) )
+            assert( Satisfaction.possibly_none( logger, List( g0, g1 ) ) == bySearch( logger, Guard.NotGuard( Guard.OrGuard( g0, g1 ) ) ), (g0, g1) )
+        end for
+        assert( logger.fatalCount == 0 )
+    }
+
+    it should "give the same answer when asked again" in {
+        val logger = new LoggerForTesting
+        val g = Guard.AndGuard( Guard.NamedGuard( "a" ), Guard.NotGuard( Guard.NamedGuard( "b" ) ) )
+        for _ <- 0 until 3 do
+            assert( Satisfaction.is_satisfiable( logger, g ) )
+            assert( ! Satisfaction.is_tautology( logger, g ) )
+            assert( Satisfaction.entails( logger, g, Guard.NamedGuard( "a" ) ) )
+    }
+
+    it should "tell atoms of different kinds apart" in {
+        val logger = new LoggerForTesting
+        val g = Guard.AndGuard( Guard.NamedGuard( "x" ), Guard.NotGuard( Guard.InGuard( "x" ) ) )
+        assert( Satisfaction.is_satisfiable( logger, g ) )
+    }
+
+    it should "treat an empty list of guards as never true" in {
+        val logger = new LoggerForTesting
+        assert( Satisfaction.possibly_none( logger, Nil ) )
+        assert( ! Satisfaction.definitely_at_least_one( logger, Nil ) )
+    }
+
+    it should "report an else guard each time it is asked about one" in {
+        val logger = new LoggerForTesting
+        val g = Guard.OrGuard( Guard.NamedGuard( "a" ), Guard.ElseGuard() )
+        val before = logger.neverCount
+        assert( ! Satisfaction.is_tautology( logger, g ) )
+        assert( ! Satisfaction.is_tautology( logger, g ) )
+        assert( logger.neverCount == before + 2 )
+    }
+
+    it should "handle guards with many atoms with small diagrams" in {
+        val logger = new LoggerForTesting
+        val n = 60
+        val atoms = ( 0 until n ).map( i => Guard.NamedGuard( s"a$i" ) )
+        // Sixty atoms is far beyond a truth table.
+        val wide = disjunction( atoms )
+        assert( Satisfaction.is_satisfiable( logger, wide ) )
+        assert( ! Satisfaction.is_tautology( logger, wide ) )
+        assert( Satisfaction.is_tautology( logger, Guard.OrGuard( wide, Guard.NotGuard( wide ) ) ) )
+        // Exactly one of the first twelve atoms, as a chain of edges would have it.
+        val twelve = atoms.take( 12 )
+        val exactlyOne = for i <- twelve.indices yield
+            twelve.indices.map( j => if i == j then twelve( j ) else Guard.NotGuard( twelve( j ) ) ).reduce( Guard.AndGuard( _, _ ) )
+        for i <- exactlyOne.indices ; j <- exactlyOne.indices if i != j do
+            assert( ! Satisfaction.ambiguity( logger, exactlyOne( i ), exactlyOne( j ) ) )
+        assert( Satisfaction.possibly_none( logger, exactlyOne ) )
+        assert( ! Satisfaction.definitely_at_least_one( logger, exactlyOne ) )
+        assert( Satisfaction.definitely_at_least_one( logger, exactlyOne :+ Guard.NotGuard( disjunction( exactlyOne ) ) ) )
+        val source = Node.BasicState( StateInformation( "x", 0, Stereotype.None ) )
+        val target = Node.BasicState( StateInformation( "y", 0, Stereotype.None ) )
+        val edges = exactlyOne.map( g => Edge( source, target, None, Some( g ), Nil ) )
+        assert( Satisfaction.sort_by_entailment( logger, edges ).size == edges.size )
+        // Building the chain of ors makes at most a node for each atom of each prefix of the chain.
+        // That bounds the time taken, and does not depend on the speed of the machine.
+        val diagrams = Bdd()
+        diagrams.of( logger, wide )
+        assert( diagrams.size <= 2 + n * ( n + 1 ) / 2 )
+        diagrams.of( logger, disjunction( exactlyOne ) )
+        assert( diagrams.size < n * n )
+    }
+
+end TestBdd
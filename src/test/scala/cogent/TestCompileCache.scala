@@ -0,0 +1,103 @@
+package cogent
+
+import org.scalatest.flatspec.AnyFlatSpec
+import java.io.File
+import java.nio.file.Files
+
+class TestCompileCache extends AnyFlatSpec :
+    import TestFiles.withFiles
+
+    val chart = "@startuml\n[*] -> A\nstate A\nstate B\nA -> B : go\nB -> A : back\n@enduml\n"
+
+    // A time well in the past, in whole seconds, since some file systems keep no more.
+    val longAgo = 1000000000000L
+
+    def read( file : File ) : String = Files.readString( file.toPath )
+
+    def options( configure : GenerationOptions => Unit = _ => () ) : GenerationOptions =
+        val o = GenerationOptions()
+        o.frontEnd = "native"
+        configure( o )
+        o
+
+    def entries( cacheDirectory : File ) : Seq[String] = cacheDirectory.listFiles.toSeq.map( _.getName ).sorted
+
+    "the output files" should "be replaced only when their content changes" in {
+        withFiles( "out.txt" -> "old" ){ directory =>
+            val file = new File( directory, "out.txt" )
+            file.setLastModified( longAgo )
+            assert( ! OutputFiles.write( file ){ _.print( "old" ) } )
+            assert( file.lastModified == longAgo )
+            assert( OutputFiles.write( file ){ _.print( "new" ) } )
+            assert( read( file ) == "new" )
+            // No temporary files are left behind.
+            assert( directory.listFiles.map( _.getName ).toSeq == Seq( "out.txt" ) )
+        }
+    }
+
+    "the compile cache" should "put its output in place without rewriting files that are the same" in {
+        withFiles( "chart.puml" -> chart ){ directory =>
+            val logger = new LoggerForTesting
+            val source = new File( directory, "chart.puml" )
+            val outFile = new File( directory, "chart.c" )
+            val cacheDirectory = new File( directory, "cache" )
+            val cache = CompileCache( logger, cacheDirectory )
+            assert( Main.build( logger, options(), "test", "chart", source, outFile, Some( cache ) ) )
+            assert( entries( cacheDirectory ).size == 1 )
+            val text = read( outFile )
+            outFile.setLastModified( longAgo )
+            assert( Main.build( logger, options(), "test", "chart", source, outFile, Some( cache ) ) )
+            assert( read( outFile ) == text && outFile.lastModified == longAgo )
+            // The output does come from the cache: a change to the cached copy shows up.
+            val cached = new File( new File( cacheDirectory, entries( cacheDirectory ).head ), "chart.c" )
+            Files.writeString( cached.toPath, text + "/* cached */\n" )
+            assert( Main.build( logger, options(), "test", "chart", source, outFile, Some( cache ) ) )
+            assert( read( outFile ).endsWith( "/* cached */\n" ) )
+            assert( logger.fatalCount == 0 )
+        }
+    }
+
+    it should "compile again when an option changes" in {
+        withFiles( "chart.puml" -> chart ){ directory =>
+            val logger = new LoggerForTesting
+            val source = new File( directory, "chart.puml" )
+            val outFile = new File( directory, "chart.c" )
+            val cacheDirectory = new File( directory, "cache" )
+            val cache = CompileCache( logger, cacheDirectory )
+            val sources = CompileCache.sources( source )
+            assert( cache.key( Seq( options().fingerprint ), sources ) != cache.key( Seq( options( o => o.snapshot = true ).fingerprint ), sources ) )
+            assert( Main.build( logger, options(), "test", "chart", source, outFile, Some( cache ) ) )
+            assert( ! read( outFile ).contains( "snapshot_chart" ) )
+            assert( Main.build( logger, options( o => o.snapshot = true ), "test", "chart", source, outFile, Some( cache ) ) )
+            assert( read( outFile ).contains( "snapshot_chart" ) )
+            assert( entries( cacheDirectory ).size == 2 )
+            assert( logger.fatalCount == 0 )
+        }
+    }
+
+    "watching" should "build each time with a fresh copy of the options" in {
+        withFiles( "chart.puml" -> chart ){ directory =>
+            val logger = new LoggerForTesting
+            val source = new File( directory, "chart.puml" )
+            val outFile = new File( directory, "chart.c" )
+            val cacheDirectory = new File( directory, "cache" )
+            val cache = Some( CompileCache( logger, cacheDirectory ) )
+            // Compiling turns --compact off for table-driven code, but only in its copy.
+            val watched = options{ o => o.tableStyle = true ; o.compact = true }
+            val stamp = Main.watchStep( logger, watched, "test", "chart", source, outFile, cache, Seq() )
+            assert( watched.compact )
+            assert( outFile.isFile && entries( cacheDirectory ).size == 1 )
+            // Nothing has changed, so nothing is built.
+            assert( Main.watchStep( logger, watched, "test", "chart", source, outFile, cache, stamp ) == stamp )
+            assert( entries( cacheDirectory ).size == 1 )
+            // With another option, the next change to the source is compiled with it.
+            watched.snapshot = true
+            Files.writeString( source.toPath, chart + "\n" )
+            assert( Main.watchStep( logger, watched, "test", "chart", source, outFile, cache, stamp ) != stamp )
+            assert( read( outFile ).contains( "snapshot_chart" ) )
+            assert( entries( cacheDirectory ).size == 2 )
+            assert( logger.fatalCount == 0 )
+        }
+    }
+
+end TestCompileCache
@@ -0,0 +1,35 @@
+package cogent
+
+import java.io.File
+import java.nio.file.{Files, Path}
+
+// Source files for the tests. Each call writes its files into a new temporary directory,
+// and deletes the directory before it returns.
+object TestFiles :
+
+    // Writes the files, given by name and contents, and calls use with their directory.
+    def withFiles[T]( files : (String, String)* )( use : File => T ) : T =
+        val directory = Files.createTempDirectory( "cogent" )
+        try
+            for (name, contents) <- files do Files.writeString( directory.resolve( name ), contents )
+            use( directory.toFile )
+        finally
+            val paths = Files.walk( directory )
+            try paths.sorted( java.util.Comparator.reverseOrder[Path]() ).forEach( path => Files.delete( path ) )
+            finally paths.close()
+
+    // Reads a chart with the native front end. The chart can include the other files given.
+    def read( logger : Logger, text : String, included : (String, String)* ) : List[StateChart] =
+        withFiles( ( ( "chart.puml" -> text ) +: included )* ){ directory =>
+            NativeFrontEnd( logger ).processFile( new File( directory, "chart.puml" ), "chart" ) }
+
+    // Reads a chart and prepares it for a back end.
+    def prepare( logger : Logger, text : String ) : StateChart =
+        MiddleEnd( logger ).prepareForBackEnd( Combiner( logger ).combine( read( logger, text ) ).get )
+
+    // Reads an annotation file.
+    def annotations( logger : Logger, text : String ) : Annotations =
+        withFiles( "chart.annotations" -> text ){ directory =>
+            Annotations.read( logger, new File( directory, "chart.annotations" ) ) }
+
+end TestFiles
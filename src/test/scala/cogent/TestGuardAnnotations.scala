@@ -0,0 +1,75 @@
+package cogent
+
+import org.scalatest.flatspec.AnyFlatSpec
+import java.io.{PrintWriter, StringWriter}
+
+class TestGuardAnnotations extends AnyFlatSpec :
+    import TestFiles.annotations
+
+    "the annotation file" should "declare guards pure and give their costs" in {
+        val logger = new LoggerForTesting
+        val a = annotations( logger, "# Sensors\nguard sensorReady pure cost=20\n\nguard tableHit cost=5\n" )
+        assert( logger.fatalCount == 0 )
+        assert( a.isPure( "sensorReady" ) && ! a.isPure( "tableHit" ) )
+        assert( a.guardCost( "sensorReady" ) == 20 && a.guardCost( "tableHit" ) == 5 && a.guardCost( "other" ) == 1 )
+        annotations( logger, "guard g cost=-1\nguard h fast\nstate f cost=2\n" )
+        assert( logger.fatalCount == 3 )
+        val b = annotations( logger, "action startMotor cost=40\nenter cost=2\n" )
+        assert( logger.fatalCount == 3 )
+        assert( b.actionCost( "startMotor" ) == 40 && b.actionCost( "other" ) == 1 && b.enterCost == 2 && b.exitCost == 0 )
+    }
+
+    "guards" should "list the named guards and states that they use, left to right" in {
+        import Guard.*
+        val guard = ImpliesGuard( NotGuard( NamedGuard( "a" ) ), OrGuard( AndGuard( InGuard( "S" ), RawGuard( "x" ) ), NamedGuard( "b" ) ) )
+        assert( guard.atoms == Seq( NamedGuard( "a" ), InGuard( "S" ), RawGuard( "x" ), NamedGuard( "b" ) ) )
+        assert( guard.namedGuards == Seq( "a", "b" ) )
+        assert( guard.queriedStates == Seq( "S" ) )
+        assert( ElseGuard().namedGuards.isEmpty )
+    }
+
+    "guard costs" should "order only the operands that can move" in {
+        import Guard.*
+        val logger = new LoggerForTesting
+        val options = GenerationOptions()
+        options.annotations = Annotations( Set( "slow", "quick" ), Map( "slow" -> 20, "quick" -> 2, "sideEffect" -> 0 ) )
+        val backend = Backend( logger, COutputter( PrintWriter( StringWriter() ) ), options )
+        // Pure guards move past each other and past 'in' guards.
+        assert( backend.costOrdered( AndGuard( NamedGuard( "slow" ), AndGuard( NamedGuard( "quick" ), InGuard( "A" ) ) ) )
+                == AndGuard( AndGuard( InGuard( "A" ), NamedGuard( "quick" ) ), NamedGuard( "slow" ) ) )
+        // A guard that is not pure, and a raw guard, stay where they are, and so nothing moves past them.
+        assert( backend.costOrdered( OrGuard( NamedGuard( "slow" ), OrGuard( NamedGuard( "sideEffect" ), NamedGuard( "quick" ) ) ) )
+                == OrGuard( OrGuard( NamedGuard( "slow" ), NamedGuard( "sideEffect" ) ), NamedGuard( "quick" ) ) )
+        assert( backend.costOrdered( AndGuard( RawGuard( "p != 0" ), InGuard( "A" ) ) )
+                == AndGuard( RawGuard( "p != 0" ), InGuard( "A" ) ) )
+    }
+
+    "pure guards" should "be evaluated once per dispatch, except in table-driven code" in {
+        def generate( tableStyle : Boolean ) : String =
+            val logger = new LoggerForTesting
+            val chart = TestFiles.prepare( logger, "@startuml\n[*] -> A\nstate A\nstate B\nA -> B : GO [ready]\nA -> A : STOP [ready]\n@enduml\n" )
+            val options = GenerationOptions()
+            options.tableStyle = tableStyle
+            options.annotations = Annotations( Set( "ready" ), Map() )
+            val text = StringWriter()
+            val out = COutputter( PrintWriter( text ) )
+            Backend( logger, out, options ).generateCCode( chart, "chart", "test" )
+            out.close
+            assert( logger.fatalCount == 0 )
+            text.toString
+        val code = generate( false )
+        assert( code.contains( "#define PURE_INDEX_ready 0" ) && code.contains( "guardValue_a[ PURE_GUARD_BYTES ]" ) )
+        assert( code.contains( "static bool_t rememberGuard( int i, bool_t value )" ) )
+        // Both transitions read the remembered answer, and only call the guard if there is none.
+        val read = "( ( ( guardKnown_a[ PURE_INDEX_ready >> 3 ] >> ( PURE_INDEX_ready & 7 ) ) & 1 ) ? " +
+                   "( ( guardValue_a[ PURE_INDEX_ready >> 3 ] >> ( PURE_INDEX_ready & 7 ) ) & 1 ) : rememberGuard( PURE_INDEX_ready, "
+        assert( code.sliding( read.length ).count( _ == read ) == 2 )
+        // The answers are forgotten at the start of each micro-step.
+        val core = code.indexOf( "static bool_t dispatch_chart( " )
+        val reset = code.indexOf( "for( i = 0 ; i < PURE_GUARD_BYTES ; ++i ) guardKnown_a[ i ] = 0 ;" )
+        assert( core >= 0 && reset > core && ! code.substring( core, reset ).contains( "switch" ) )
+        val table = generate( true )
+        assert( Seq( "guardKnown_a", "guardValue_a", "rememberGuard", "PURE_" ).forall( ! table.contains( _ ) ) )
+    }
+
+end TestGuardAnnotations
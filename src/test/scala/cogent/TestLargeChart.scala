@@ -0,0 +1,48 @@
+package cogent
+
+import org.scalatest.flatspec.AnyFlatSpec
+import java.io.{PrintWriter, StringWriter}
+
+class TestLargeChart extends AnyFlatSpec :
+
+    // A chart of groups of states. The states of a group form a ring of transitions, some
+    // guarded by an 'in' guard on the next group and some with after transitions, and the
+    // groups form a ring too.
+    def groupedChart( groups : Int, width : Int ) : String =
+        def state( g : Int, i : Int ) : String = s"G${g}S${i}"
+        val lines = for g <- 0 until groups yield
+            val inner = Seq( s"[*] -> ${state( g, 0 )}" ) ++
+                ( 0 until width ).map( i => s"state ${state( g, i )}" ) ++
+                ( 0 until width ).map( i => s"${state( g, i )} -> ${state( g, ( i + 1 ) % width )} : e${i % 4} [g$i or in G${( g + 1 ) % groups}] / a$i" ) ++
+                ( 1 until width by 5 ).map( i => s"${state( g, i )} -> ${state( g, 0 )} : after(${i}ms)" )
+            s"state G$g {\n${inner.mkString( "\n" )}\n}\nG$g -> G${( g + 1 ) % groups} : next"
+        s"@startuml\n[*] -> G0\n${lines.mkString( "\n" )}\n@enduml"
+
+    // The work done through the chart's indices by checking the chart, analysing its latency
+    // and generating code in both styles, for each node and edge of the chart.
+    def workPerElement( groups : Int, width : Int ) : Double =
+        val logger = new LoggerForTesting
+        val chart = TestFiles.prepare( logger, groupedChart( groups, width ) )
+        assert( logger.fatalCount == 0 )
+        assert( chart.nodes.count( _.isState ) > groups * width )
+        val before = chart.work
+        Checker( logger ).check( chart )
+        LatencyAnalysis( logger, chart, Annotations.none ).report( "chart", "test" )
+        for tableStyle <- Seq( false, true ) do
+            val options = GenerationOptions()
+            options.tableStyle = tableStyle
+            val out = COutputter( PrintWriter( StringWriter() ) )
+            Backend( logger, out, options ).generateCCode( chart, "chart", "test" )
+            out.close
+        assert( logger.fatalCount == 0 )
+        ( chart.work - before ).toDouble / ( chart.nodes.size + chart.edges.size )
+
+    // A pass that looks up every node for every node, or rebuilds an index for each lookup,
+    // does four times as much work per element on a chart four times as large.
+    "the indices of a large chart" should "keep the work in proportion to the size of the chart" in {
+        val small = workPerElement( 10, 50 )
+        val large = workPerElement( 40, 50 )
+        assert( large <= 1.5 * small, s"work per node and edge: $small for 500 states, $large for 2000 states" )
+    }
+
+end TestLargeChart
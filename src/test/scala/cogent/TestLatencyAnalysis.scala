@@ -0,0 +1,35 @@
+package cogent
+
+import org.scalatest.flatspec.AnyFlatSpec
+
+class TestLatencyAnalysis extends AnyFlatSpec :
+    import LatencyAnalysis.Work
+
+    def prepare( logger : Logger, transitions : String ) : StateChart =
+        TestFiles.prepare( logger, s"@startuml\n[*] -> A\nstate A\nstate B\n$transitions\n@enduml\n" )
+
+    "the latency analysis" should "bound the work of a dispatch and of settling" in {
+        val logger = new LoggerForTesting
+        val chart = prepare( logger, "A -> B : GO [ready] / act\nB -> A : after(0 ms)" )
+        val analysis = LatencyAnalysis( logger, chart, Annotations( Set(), Map( "ready" -> 5 ), Map( "act" -> 7 ) ) )
+        analysis.check()
+        assert( logger.fatalCount == 0 )
+        assert( analysis.dispatchWork( Some( "GO" ) ) == Work( 1, 1, 1, 1, 12 ) )
+        assert( analysis.dispatchWork( None ) == Work( 0, 0, 1, 1, 0 ) )
+        // One TICK fires B's after transition, and the next fires nothing.
+        assert( analysis.settleTicks == Some( 2 ) )
+        assert( analysis.settleWork( Some( "GO" ) ) == Some( Work( 1, 1, 3, 3, 12 ) ) )
+        assert( analysis.report( "chart", "test" ).contains( "\"settleTicks\": 2" ) )
+    }
+
+    it should "report a cycle of after( 0 ms ) transitions" in {
+        val logger = new LoggerForTesting
+        val chart = prepare( logger, "A -> B : after(0 ms)\nB -> A : after(0 ms)" )
+        val analysis = LatencyAnalysis( logger, chart, Annotations.none )
+        analysis.check()
+        assert( logger.fatalCount == 1 )
+        assert( analysis.settleTicks.isEmpty && analysis.settleWork( None ).isEmpty )
+        assert( analysis.zeroDelayCycles.map( _.toSet ) == Seq( Set( "A", "B" ) ) )
+    }
+
+end TestLatencyAnalysis
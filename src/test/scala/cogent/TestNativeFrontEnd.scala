@@ -0,0 +1,110 @@
+package cogent
+
+import org.scalatest.flatspec.AnyFlatSpec
+import java.io.File
+import scala.jdk.CollectionConverters._
+
+class TestNativeFrontEnd extends AnyFlatSpec :
+    import TestFiles.read
+
+    "the native front end" should "read states, choices and transitions" in {
+        val logger = new LoggerForTesting
+        val charts = read( logger, """@startuml
+            |    state IDLE
+            |    state RUNNING
+            |    state C <<choice>>
+            |    [*] -> IDLE
+            |    IDLE -> C : GO
+            |    C -> RUNNING : [ready?] / start
+            |    C -> IDLE : [else]
+            |    RUNNING -down-> IDLE : KILL / stop
+            |@enduml""".stripMargin )
+        assert( logger.fatalCount == 0 )
+        assert( charts.size == 1 )
+        val chart = charts.head
+        assert( chart.name == "chart" && chart.isFirst )
+        assert( chart.nodes.map( _.getFullName ).toSet == Set( "root", "*start", "IDLE", "RUNNING", "C" ) )
+        assert( chart.nodes.find( _.getFullName == "C" ).get.isChoicePseudostate )
+        assert( chart.edges.size == 5 )
+        assert( chart.edges.exists( _.toString == "RUNNING--KILL--/-stop;-->IDLE" ) )
+    }
+
+    it should "make an AND state of a state with regions" in {
+        val logger = new LoggerForTesting
+        val charts = read( logger, """@startuml
+            |state A {
+            |    note "B" as B
+            |    [*] -> C
+            |    state C
+            |    --
+            |    [*] -> F
+            |    state F
+            |}
+            |@enduml""".stripMargin )
+        assert( logger.fatalCount == 0 && logger.warnCount == 1 )
+        val chart = charts.head
+        val a = chart.nodes.find( _.getFullName == "A" ).get
+        assert( a.isInstanceOf[Node.AndState] )
+        assert( a.childNodes.map( _.getFullName ).toSet == Set( "A_region_0", "A_region_1" ) )
+        val f = chart.nodes.find( _.getFullName == "F" ).get
+        assert( chart.parentOf( f ).getFullName == "A_region_1" && f.getDepth == 3 )
+    }
+
+    it should "read submachines from later blocks and included files" in {
+        val logger = new LoggerForTesting
+        val charts = read( logger, """@startuml
+            |!include style.pinc
+            |    state Sub1 <<submachine>>
+            |    [*] -> Sub1
+            |@enduml
+            |
+            |@startuml Sub1
+            |    state Sub1 <<submachine>> {
+            |        state X <<entrypoint>>
+            |        state U
+            |        X -> U : / act1
+            |    }
+            |@enduml""".stripMargin,
+            "style.pinc" -> """skinparam state {
+            |  backgroundColor<<submachine>> Lavender
+            |}""".stripMargin )
+        assert( logger.fatalCount == 0 )
+        assert( charts.map( _.name ) == List( "chart", "Sub1" ) )
+        val x = charts( 1 ).nodes.find( _.getFullName == "X" ).get
+        assert( x.isEntryPseudostate && x.getStereotype == Stereotype.EntryPoint )
+    }
+
+    it should "report what it does not understand" in {
+        val logger = new LoggerForTesting
+        read( logger, """@startuml
+            |!define COLOUR red
+            |state A
+            |@enduml""".stripMargin )
+        assert( logger.fatalCount == 1 )
+    }
+
+    it should "find no differences between a chart and itself" in {
+        val logger = new LoggerForTesting
+        val text = "@startuml\nstate A {\n[*] -> B\nstate B\n--\n[*] -> C\nstate C\n}\nB -> C : e\n@enduml"
+        val charts = read( logger, text )
+        assert( NativeFrontEnd.differences( charts, read( logger, text ) ).isEmpty )
+        assert( NativeFrontEnd.differences( charts, Nil ).nonEmpty )
+    }
+
+    it should "read the examples as PlantUML does" in {
+        val examples = new File( "Examples" ).listFiles().toSeq
+        val files = ( examples ++ examples.filter( _.isDirectory ).flatMap( _.listFiles() ) )
+                    .filter( _.getName.endsWith( ".puml" ) ).sortBy( _.getPath )
+        assert( files.nonEmpty )
+        for file <- files do
+            val chartName = file.getName.stripSuffix( ".puml" )
+            val logger = new LoggerForTesting
+            val blocks = Main.parse( logger, file ).get.asScala
+            val fromPlantUml = MiddleEnd( logger ).processBlocks( blocks, chartName )
+            val fromNative = NativeFrontEnd( logger ).processFile( file, chartName )
+            assert( logger.fatalCount == 0, s"reading $file" )
+            val differences = NativeFrontEnd.differences( fromPlantUml, fromNative )
+            assert( differences.isEmpty, s"$file: ${differences.mkString( "; " )}" )
+    }
+
+end TestNativeFrontEnd
@@ -0,0 +1,47 @@
+package cogent
+
+import org.scalatest.flatspec.AnyFlatSpec
+import java.io.{PrintWriter, StringWriter}
+
+class TestParallelOutput extends AnyFlatSpec :
+
+    // An AND state of several regions, each an OR state with many children. Each child has
+    // a transition to the next, guarded in part by an 'in' guard on another region, and an
+    // after transition back to the first.
+    def wideChart( regions : Int, width : Int ) : String =
+        def state( r : Int, i : Int ) : String = s"R${r}S${i}"
+        val bodies = for r <- 0 until regions yield
+            ( Seq( s"[*] -> ${state( r, 0 )}" ) ++
+              ( 0 until width ).map( i => s"state ${state( r, i )}" ) ++
+              ( 0 until width ).map( i => s"${state( r, i )} -> ${state( r, ( i + 1 ) % width )} : e${i % 4} [g$i and not in ${state( ( r + 1 ) % regions, i )}] / a$i" ) ++
+              ( 1 until width ).map( i => s"${state( r, i )} -> ${state( r, 0 )} : after(${i}ms) / b$i" ) ).mkString( "\n" )
+        s"@startuml\n[*] -> A\nstate A {\n${bodies.mkString( "\n--\n" )}\n}\n@enduml"
+
+    // The code generated with the parts rendered on several threads, as Backend.apply arranges,
+    // and one after another, which a back end does when its logger is not a HoldingLogger.
+    def generateBothWays( chart : StateChart, options : GenerationOptions ) : (String, String) =
+        def generate( parallel : Boolean ) : String =
+            val logger = new LoggerForTesting
+            val text = StringWriter()
+            val out = COutputter( PrintWriter( text ) )
+            val backend = if parallel then Backend( logger, out, options ) else new Backend( logger, out, options )
+            backend.generateCCode( chart, "chart", "test" )
+            out.close
+            assert( logger.fatalCount == 0 )
+            text.toString
+        ( generate( true ), generate( false ) )
+
+    "parallel rendering" should "write the same code as rendering one part after another" in {
+        val logger = new LoggerForTesting
+        val chart = TestFiles.prepare( logger, wideChart( 4, 24 ) )
+        assert( logger.fatalCount == 0 )
+        for configure <- Seq[GenerationOptions => Unit]( _ => (), o => o.compact = true, o => o.timerList = true,
+                                                         o => o.inlineTransitions = true, o => o.settleChanged = true ) do
+            val options = GenerationOptions()
+            configure( options )
+            val (parallel, serial) = generateBothWays( chart, options )
+            assert( parallel.contains( "case L_INDEX_R0S23" ) )
+            assert( parallel == serial )
+    }
+
+end TestParallelOutput
@@ -0,0 +1,116 @@
+package cogent
+
+import org.scalatest.flatspec.AnyFlatSpec
+import java.io.{PrintWriter, StringWriter}
+
+class TestSharedSubmachines extends AnyFlatSpec :
+
+    // S is used twice, once inside each of P and Q, which are each used once.
+    val source = """@startuml
+        |    state P <<submachine>>
+        |    state Q <<submachine>>
+        |    [*] -> P
+        |    P -> Q : go
+        |    Q -> P : back
+        |@enduml
+        |
+        |@startuml P
+        |    state P <<submachine>> {
+        |        state S <<submachine>>
+        |        [*] -> S
+        |    }
+        |@enduml
+        |
+        |@startuml Q
+        |    state Q <<submachine>> {
+        |        state S <<submachine>>
+        |        [*] -> S
+        |    }
+        |@enduml
+        |
+        |@startuml S
+        |    state S <<submachine>> {
+        |        [*] -> A
+        |        state A
+        |        state B
+        |        A -> B : e
+        |        B -> A : f
+        |    }
+        |@enduml""".stripMargin
+
+    def prepare( logger : Logger ) : StateChart = TestFiles.prepare( logger, source )
+
+    "shared submachines" should "lay out the instances of a submachine evenly" in {
+        val logger = new LoggerForTesting
+        val chart = prepare( logger )
+        val sharing = SharedSubmachines( logger, chart )
+        sharing.layOut()
+        assert( logger.fatalCount == 0 )
+        assert( sharing.shared.map( _.name ) == Seq( "S" ) )
+        val shared = sharing.shared.head
+        assert( shared.tops.map( _.getFullName ) == Seq( "S__P", "S__Q" ) )
+        for (instance, k) <- shared.instances.zipWithIndex ; (node, position) <- instance.zipWithIndex if node.isState do
+            val member = shared.members( position )
+            val base = if node.isOrState then shared.orFirst + k * shared.orSize else shared.first + k * shared.size
+            assert( node.getGlobalIndex == base + shared.offsetOf( member ) )
+        val states = chart.nodes.filter( _.isState ).sortBy( _.getGlobalIndex )
+        assert( states.map( _.getGlobalIndex ) == states.indices )
+        assert( states.takeWhile( _.isOrState ).size == chart.nodes.count( _.isOrState ) )
+    }
+
+    it should "generate the code for the states inside the instances once" in {
+        val logger = new LoggerForTesting
+        val chart = prepare( logger )
+        val sharing = SharedSubmachines( logger, chart )
+        sharing.layOut()
+        val text = StringWriter()
+        val out = COutputter( PrintWriter( text ) )
+        Backend( logger, out, GenerationOptions(), None, Some( sharing ) ).generateCCode( chart, "chart", "test" )
+        out.close
+        val code = text.toString
+        assert( logger.fatalCount == 0 )
+        // One declaration and one definition.
+        assert( "static void enterShared_S_A ".r.findAllIn( code ).size == 2 )
+        assert( code.contains( "dispatchShared_S( 1, event_p, eventClass, now )" ) )
+        assert( ! code.contains( "enter_A__S__Q" ) )
+        assert( ! code.contains( "changedAt_a" ) )
+    }
+
+    it should "pass on and stamp the changes with --settle-changed" in {
+        val logger = new LoggerForTesting
+        val chart = prepare( logger )
+        val sharing = SharedSubmachines( logger, chart )
+        sharing.layOut()
+        val options = GenerationOptions()
+        options.settleChanged = true
+        val text = StringWriter()
+        val out = COutputter( PrintWriter( text ) )
+        Backend( logger, out, options, None, Some( sharing ) ).generateCCode( chart, "chart", "test" )
+        out.close
+        val code = text.toString
+        assert( logger.fatalCount == 0 )
+        assert( code.contains( "dispatchShared_S( 1, event_p, eventClass, now, changedOnly )" ) )
+        assert( code.contains( "changedAt_a" ) )
+    }
+
+    it should "write the same code when the shared code is rendered in parallel" in {
+        def generate( parallel : Boolean ) : String =
+            val logger = new LoggerForTesting
+            val chart = prepare( logger )
+            val sharing = SharedSubmachines( logger, chart )
+            sharing.layOut()
+            val text = StringWriter()
+            val out = COutputter( PrintWriter( text ) )
+            // Backend.apply renders in parallel; a back end whose logger is not a HoldingLogger does not.
+            val backend = if parallel then Backend( logger, out, GenerationOptions(), None, Some( sharing ) )
+                          else new Backend( logger, out, GenerationOptions(), Some( sharing ) )
+            backend.generateCCode( chart, "chart", "test" )
+            out.close
+            assert( logger.fatalCount == 0 )
+            text.toString
+        val parallel = generate( true )
+        assert( parallel.contains( "SHARED_G_INDEX_S( instance, " ) )
+        assert( parallel == generate( false ) )
+    }
+
+end TestSharedSubmachines